@@ -3,32 +3,54 @@
 //! # DS28EA00
 //!
 //! A no-std implementation of the DS28EA00 1-Wire temperature sensors in a group.
+//!
+//! With the `alloc` feature, [`Ds28ea00GroupVec`] holds as many devices as are found on the bus.
+#[cfg(feature = "alloc")]
+extern crate alloc;
+
+mod storage;
+
+#[cfg(feature = "alloc")]
+pub use storage::VecStorage;
+pub use storage::{DeviceStorage, InlineStorage};
+
 use embedded_hal::delay::DelayNs;
 use embedded_onewire::{
     OneWire, OneWireCrc, OneWireError, OneWireResult, OneWireSearch, OneWireSearchKind,
+    OneWireStatus,
 };
 use fixed::types::I12F4;
 
 #[derive(Debug)]
 /// Represents a group of DS28EA00 devices on the 1-Wire bus.
-/// This struct can handle up to `N` devices, where `N` is a compile-time constant.
-pub struct Ds28ea00Group<const N: usize> {
-    devices: usize,
-    roms: [(u64, Temperature); N],
+/// The devices are kept in `S`, see [`Ds28ea00Group`] and [`Ds28ea00GroupVec`].
+pub struct Ds28ea00Devices<S> {
+    storage: S,
+    crc_every: u16,
+    crc_max_jump: Temperature,
+    crc_errors: u32,
     resolution: ReadoutResolution,
     low: i8,
     high: i8,
     toggle_pio: bool,
     overdrive: bool,
+    parasite: bool,
 }
 
-impl<const N: usize> Default for Ds28ea00Group<N> {
+/// A group of up to `N` DS28EA00 devices, where `N` is a compile-time constant.
+pub type Ds28ea00Group<const N: usize> = Ds28ea00Devices<InlineStorage<N>>;
+
+/// A group of DS28EA00 devices on the heap, sized when the devices are enumerated or restored.
+#[cfg(feature = "alloc")]
+pub type Ds28ea00GroupVec = Ds28ea00Devices<VecStorage>;
+
+impl<S: DeviceStorage> Default for Ds28ea00Devices<S> {
     fn default() -> Self {
         Self::new()
     }
 }
 
-impl<const N: usize> Ds28ea00Group<N> {
+impl<S: DeviceStorage> Ds28ea00Devices<S> {
     #[inline]
     /// Returns the family code for the DS28EA00 devices.
     ///
@@ -39,13 +61,16 @@ impl<const N: usize> Ds28ea00Group<N> {
 
     fn new() -> Self {
         Self {
-            devices: 0,
-            roms: [(0, Temperature::ZERO); N],
+            storage: S::default(),
+            crc_every: 0,
+            crc_max_jump: Temperature::from_bits(5 << 4),
+            crc_errors: 0,
             resolution: ReadoutResolution::default(),
             low: -40,
             high: 85,
             toggle_pio: false,
             overdrive: false,
+            parasite: true,
         }
     }
 
@@ -76,12 +101,31 @@ impl<const N: usize> Ds28ea00Group<N> {
     /// When enabled, the PIO pins of all devices are turned on while setting the configuration register,
     /// and then turned off after the configuration is applied.
     /// When reading temperatures, all PIO pins are turned on before starting the temperature conversion,
-    /// and then turned off sequentially for each device after reading its temperature.
+    /// and then turned off together once every device is read, which costs two broadcasts per readout
+    /// instead of an extra addressing of every device.
     pub fn with_toggle_pio(mut self, toggle_pio: bool) -> Self {
         self.toggle_pio = toggle_pio;
         self
     }
 
+    /// Enables periodic CRC verification of the fast temperature readout.
+    ///
+    /// When [`Self::read_temperatures`] is called without CRC validation, each device is still read with
+    /// its full scratchpad and CRC every `every` reads. A device whose reading is suspicious (the power-on
+    /// value of 85 °C, or a change of more than `max_jump` since its last reading) is read back again with
+    /// CRC validation, and then read with CRC validation until [`CRC_SUSPECT_READS`] consecutive readings
+    /// are good. `every` of `0` disables the verification, which is the default.
+    pub fn with_crc_check(mut self, every: u16, max_jump: Temperature) -> Self {
+        self.crc_every = every;
+        self.crc_max_jump = max_jump;
+        self
+    }
+
+    /// Number of readings that failed CRC validation since the group was created.
+    pub fn crc_errors(&self) -> u32 {
+        self.crc_errors
+    }
+
     /// Enumerates the DS28EA00 devices on the 1-Wire bus.
     ///
     /// This method searches for devices on the bus, addresses them, and applies the configuration settings.
@@ -91,43 +135,118 @@ impl<const N: usize> Ds28ea00Group<N> {
     /// # Returns
     /// A result containing the number of devices found and configured, or an error if the operation fails.
     pub fn enumerate<O: OneWire>(&mut self, bus: &mut O) -> OneWireResult<usize, O::BusError> {
-        self.devices = 0; // reset device count
+        self.storage.clear(); // reset devices, and read every device with CRC validation first
         let mut search = OneWireSearch::with_family(bus, OneWireSearchKind::Normal, Self::family());
         // conduct search
         while let Some(rom) = search.next()? {
-            self.roms[self.devices].0 = rom;
-            self.devices += 1;
-            if self.devices == N {
+            self.storage.push(rom);
+            if self.storage.is_full() {
+                break;
+            }
+        }
+        self.configure(bus)?;
+        Ok(self.storage.len())
+    }
+
+    /// Restores a group from a known list of ROMs, e.g. saved from [`Self::roms`] after an earlier [`Self::enumerate`].
+    ///
+    /// Instead of searching the bus, every device is addressed by its ROM and checked with a scratchpad read,
+    /// which takes a few milliseconds for a full bus. The configuration settings are then applied as in
+    /// [`Self::enumerate`]. ROMs that do not fit the storage are left out.
+    /// # Arguments
+    /// * `bus` - A mutable reference to a type that implements the [`OneWire`] trait.
+    /// * `roms` - The ROM addresses of the devices expected on the bus.
+    ///
+    /// # Returns
+    /// A result containing the number of devices restored, or the error of the first device that did not
+    /// answer. Run [`Self::enumerate`] to find the devices on the bus in that case.
+    pub fn restore<O: OneWire>(
+        &mut self,
+        bus: &mut O,
+        roms: &[u64],
+    ) -> OneWireResult<usize, O::BusError> {
+        self.storage.clear(); // reset devices, and read every device with CRC validation first
+        for rom in roms {
+            if self.storage.is_full() {
                 break;
             }
+            self.storage.push(*rom);
+        }
+        if let Err(e) = self.verify(bus) {
+            self.storage.clear();
+            return Err(e);
+        }
+        self.configure(bus)?;
+        Ok(self.storage.len())
+    }
+
+    /// Checks that every device in the group answers at the current bus speed.
+    ///
+    /// Each device is addressed by its ROM, and its scratchpad is read back and validated with its CRC.
+    /// Use this to verify that the devices followed the bus into overdrive mode.
+    /// # Arguments
+    /// * `bus` - A mutable reference to a type that implements the [`OneWire`] trait.
+    pub fn verify<O: OneWire>(&self, bus: &mut O) -> OneWireResult<(), O::BusError> {
+        for (rom, _) in self.storage.readings() {
+            bus.address(Some(*rom))?; // address device
+            bus.write_byte(DS28EA00_READ_SCRATCH)?; // Read scratchpad
+            let mut buf = [0; 9];
+            read_bytes(bus, &mut buf)?;
+            // an absent device reads as all ones, and a shorted bus as all zeros, which has a valid CRC
+            if buf.iter().all(|b| *b == buf[0]) || !OneWireCrc::validate(&buf) {
+                return Err(OneWireError::InvalidCrc);
+            }
         }
+        Ok(())
+    }
+
+    /// Applies the configuration settings to all devices and detects their power mode.
+    fn configure<O: OneWire>(&mut self, bus: &mut O) -> OneWireResult<(), O::BusError> {
         if self.toggle_pio {
             // turn all PIO pins on
             bus.address(None)?;
-            bus.write_byte(DS28EA00_TOGGLE_PIO)?;
-            bus.write_byte(DS28EA00_TOGGLE_PIO_OFF)?;
-            bus.write_byte(DS28EA00_TOGGLE_PIO_ON)?;
+            write_bytes(bus, &PIO_ON)?;
         }
         // address all devices
         bus.address(None)?;
         // apply configuration
-        bus.write_byte(DS28EA00_WRITE_SCRATCH)?;
-        bus.write_byte(self.low as _)?;
-        bus.write_byte(self.high as _)?;
-        bus.write_byte(self.resolution as _)?;
+        write_bytes(
+            bus,
+            &[
+                DS28EA00_WRITE_SCRATCH,
+                self.low as _,
+                self.high as _,
+                self.resolution as _,
+            ],
+        )?;
         if self.toggle_pio {
             // turn all PIO pins off
             bus.address(None)?;
-            bus.write_byte(DS28EA00_TOGGLE_PIO)?;
-            bus.write_byte(DS28EA00_TOGGLE_PIO_ON)?;
-            bus.write_byte(DS28EA00_TOGGLE_PIO_OFF)?;
+            write_bytes(bus, &PIO_OFF)?;
         }
-        Ok(self.devices)
+        // parasite powered devices pull the bus low during a read slot
+        bus.address(None)?;
+        bus.write_byte(DS28EA00_READ_POWERMODE)?;
+        self.parasite = !bus.read_bit()?;
+        Ok(())
     }
 
     /// Enumerate the ROMs found
     pub fn roms(&self) -> impl Iterator<Item = u64> {
-        self.roms[..self.devices].iter().map(|(x, _)| *x)
+        self.storage.readings().iter().map(|(x, _)| *x)
+    }
+
+    /// Check if any device in the group is parasite powered.
+    ///
+    /// Parasite powered devices can not report the end of a conversion, so [`Self::conversion_done`]
+    /// is only meaningful when this returns `false`.
+    pub fn parasite_powered(&self) -> bool {
+        self.parasite
+    }
+
+    /// Worst case temperature conversion time for the configured resolution, in microseconds.
+    pub fn conversion_time_us(&self) -> u32 {
+        self.resolution.delay_us()
     }
 
     /// Check if overdrive mode is enabled.
@@ -161,23 +280,89 @@ impl<const N: usize> Ds28ea00Group<N> {
         bus: &mut O,
         delay: &mut D,
     ) -> OneWireResult<(), O::BusError> {
-        bus.address(None)?; // address all devices
-        bus.write_byte(DS28EA00_START_CONV)?; // start temperature conversion
+        self.start_temperature_conversion(bus)?;
+        delay.delay_us(self.conversion_time_us()); // wait till conversion is finished
+        Ok(())
+    }
+
+    /// Starts a temperature conversion on all DS28EA00 devices in the group, without waiting for it to complete.
+    ///
+    /// Wait at least [`Self::conversion_time_us`], or poll [`Self::conversion_done`], before reading the
+    /// temperatures. The bus must not be used for anything else until the conversion is done.
+    ///
+    /// # Arguments
+    /// * `bus` - A mutable reference to a type that implements the [`OneWire`] trait.
+    pub fn start_temperature_conversion<O: OneWire>(
+        &self,
+        bus: &mut O,
+    ) -> OneWireResult<(), O::BusError> {
         if self.toggle_pio {
+            // turn on PIO first, so that the read slots of `conversion_done` follow the conversion command
             bus.address(None)?; // address all devices
-            bus.write_byte(DS28EA00_TOGGLE_PIO)?;
-            bus.write_byte(DS28EA00_TOGGLE_PIO_OFF)?; // turn on PIO
-            bus.write_byte(DS28EA00_TOGGLE_PIO_ON)?; // turn on PIO
+            write_bytes(bus, &PIO_ON)?; // turn on PIO
         }
-        delay.delay_us(self.resolution.delay_us()); // wait till conversion is finished
+        bus.address(None)?; // address all devices
+        bus.write_byte(DS28EA00_START_CONV)?; // start temperature conversion
         Ok(())
     }
 
+    /// Checks if the conversion started by [`Self::start_temperature_conversion`] is done on every device.
+    ///
+    /// Issues a single read slot: devices that are still converting hold the bus low. Always returns `false`
+    /// if [`Self::parasite_powered`], in which case the caller should wait [`Self::conversion_time_us`] instead.
+    ///
+    /// # Arguments
+    /// * `bus` - A mutable reference to a type that implements the [`OneWire`] trait.
+    pub fn conversion_done<O: OneWire>(&self, bus: &mut O) -> OneWireResult<bool, O::BusError> {
+        if self.parasite {
+            return Ok(false);
+        }
+        bus.read_bit()
+    }
+
+    /// Waits for the conversion started by [`Self::start_temperature_conversion`] to complete.
+    ///
+    /// Polls [`Self::conversion_done`] every `poll_us` microseconds, and gives up after [`Self::conversion_time_us`].
+    ///
+    /// # Arguments
+    /// * `bus` - A mutable reference to a type that implements the [`OneWire`] trait.
+    /// * `delay` - A mutable reference to a type that implements the [`DelayNs`] trait.
+    /// * `poll_us` - Interval between polls, in microseconds.
+    ///
+    /// # Returns
+    /// A result containing the time waited in microseconds, or an error if the operation fails.
+    pub fn wait_temperature_conversion<O: OneWire, D: DelayNs>(
+        &self,
+        bus: &mut O,
+        delay: &mut D,
+        poll_us: u32,
+    ) -> OneWireResult<u32, O::BusError> {
+        let total = self.conversion_time_us();
+        if self.parasite {
+            delay.delay_us(total);
+            return Ok(total);
+        }
+        let poll_us = poll_us.max(1);
+        let mut waited = 0;
+        while waited < total {
+            if self.conversion_done(bus)? {
+                break;
+            }
+            let step = poll_us.min(total - waited);
+            delay.delay_us(step);
+            waited += step;
+        }
+        Ok(waited)
+    }
+
     /// Reads the temperatures from all DS28EA00 devices in the group.
     /// This method addresses each device, reads the temperature data, and validates the CRC if requested.
+    /// Without CRC validation, devices are still verified periodically if [`Self::with_crc_check`] is set.
     /// # Arguments
     /// * `bus` - A mutable reference to a type that implements the [`OneWire`] trait.
     /// * `crc` - A boolean indicating whether to validate the CRC of the read data.
+    /// * `ignore_errors` - A boolean indicating whether to read the remaining devices after an error. A device
+    ///   that failed reads as [`READ_ERROR_TEMPERATURE`].
     /// # Returns
     /// A result containing a slice of tuples, each containing the ROM address and the temperature reading,
     /// or an error if the operation fails.
@@ -187,17 +372,61 @@ impl<const N: usize> Ds28ea00Group<N> {
         crc: bool,
         ignore_errors: bool,
     ) -> OneWireResult<&[(u64, Temperature)], O::BusError> {
-        for (rom, temp) in self.roms[..self.devices].iter_mut() {
-            let res = Self::read_temperature_internal(bus, *rom, temp, crc, self.toggle_pio);
+        self.read_temperatures_with(bus, crc, ignore_errors, |_| {})
+    }
+
+    /// Reads the temperatures from all DS28EA00 devices in the group, as [`Self::read_temperatures`], and
+    /// calls `on_read` with the ROM address of each device once it has been read, e.g. to time the reads.
+    pub fn read_temperatures_with<O: OneWire, F: FnMut(u64)>(
+        &mut self,
+        bus: &mut O,
+        crc: bool,
+        ignore_errors: bool,
+        mut on_read: F,
+    ) -> OneWireResult<&[(u64, Temperature)], O::BusError> {
+        let hybrid = !crc && self.crc_every > 0;
+        let (readings, checks) = self.storage.readings_mut();
+        for ((rom, temp), check) in readings.iter_mut().zip(checks.iter_mut()) {
+            let full = crc || (hybrid && check.due(self.crc_every));
+            let mut res = Self::read_temperature_internal(bus, Some(*rom), temp, full);
+            if hybrid {
+                let mut full = full;
+                if res.is_ok() && check.suspicious(*temp, self.crc_max_jump) {
+                    check.suspect = CRC_SUSPECT_READS;
+                    if !full {
+                        // confirm the reading with a full scratchpad read, resuming instead of matching the ROM again
+                        res = Self::read_temperature_internal(bus, None, temp, true);
+                        full = true;
+                    }
+                }
+                match res {
+                    Ok(()) => check.update(*temp, full),
+                    Err(OneWireError::InvalidCrc) => {
+                        self.crc_errors = self.crc_errors.wrapping_add(1);
+                        check.suspect = CRC_SUSPECT_READS;
+                    }
+                    Err(_) => check.suspect = CRC_SUSPECT_READS,
+                }
+            }
             if let Err(e) = res {
                 if !ignore_errors {
                     return Err(e);
                 } else {
-                    *temp = Temperature::from_num(-85); // Set to -85 on error
+                    *temp = READ_ERROR_TEMPERATURE;
                 }
             }
+            on_read(*rom);
+        }
+        if self.toggle_pio && !readings.is_empty() {
+            // turn all PIO pins off at once, instead of addressing every device again
+            let res = bus.address(None).and_then(|_| write_bytes(bus, &PIO_OFF));
+            if let Err(e) = res
+                && !ignore_errors
+            {
+                return Err(e);
+            }
         }
-        Ok(&self.roms[..self.devices])
+        Ok(self.storage.readings())
     }
 
     /// Reads the temperature from a specific DS28EA00 device.
@@ -219,30 +448,33 @@ impl<const N: usize> Ds28ea00Group<N> {
     ) -> OneWireResult<Temperature, O::BusError> {
         let mut temp = Temperature::ZERO; // Initialize temperature
         self.trigger_temperature_conversion(bus, delay)?; // Trigger temperature conversion
-        Self::read_temperature_internal(bus, rom, &mut temp, crc, self.toggle_pio)?; // Read temperature
+        Self::read_temperature_internal(bus, Some(rom), &mut temp, crc)?; // Read temperature
+        if self.toggle_pio {
+            resume(bus)?; // address the device again
+            write_bytes(bus, &PIO_OFF)?;
+        }
         Ok(temp)
     }
 
+    /// Reads the scratchpad of the device with ROM `rom`, or of the device addressed last if `None`.
     fn read_temperature_internal<O: OneWire>(
         bus: &mut O,
-        rom: u64,
+        rom: Option<u64>,
         temp: &mut Temperature,
         crc: bool,
-        toggle_pio: bool,
     ) -> OneWireResult<(), O::BusError> {
-        bus.address(Some(rom))?; // address device
+        match rom {
+            Some(rom) => bus.address(Some(rom))?, // address device
+            None => resume(bus)?,
+        }
         bus.write_byte(DS28EA00_READ_SCRATCH)?; // Read scratchpad
         if !crc {
             let mut buf = [0; 2];
-            for b in buf.iter_mut() {
-                *b = bus.read_byte()?;
-            }
+            read_bytes(bus, &mut buf)?;
             *temp = I12F4::from_le_bytes([buf[0] & ReadoutResolution::default().bitmask(), buf[1]]);
         } else {
             let mut buf = [0; 9];
-            for b in buf.iter_mut() {
-                *b = bus.read_byte()?;
-            }
+            read_bytes(bus, &mut buf)?;
             if OneWireCrc::validate(&buf) {
                 *temp =
                     I12F4::from_le_bytes([buf[0] & ReadoutResolution::default().bitmask(), buf[1]]);
@@ -250,12 +482,6 @@ impl<const N: usize> Ds28ea00Group<N> {
                 return Err(OneWireError::InvalidCrc);
             }
         }
-        if toggle_pio {
-            bus.address(Some(rom))?; // address device
-            bus.write_byte(DS28EA00_TOGGLE_PIO)?;
-            bus.write_byte(DS28EA00_TOGGLE_PIO_ON)?;
-            bus.write_byte(DS28EA00_TOGGLE_PIO_OFF)?;
-        }
         Ok(())
     }
 
@@ -272,15 +498,7 @@ impl<const N: usize> Ds28ea00Group<N> {
         enable: bool,
     ) -> OneWireResult<(), O::BusError> {
         bus.address(Some(rom))?;
-        bus.write_byte(DS28EA00_TOGGLE_PIO)?;
-        if !enable {
-            bus.write_byte(DS28EA00_TOGGLE_PIO_ON)?;
-            bus.write_byte(DS28EA00_TOGGLE_PIO_OFF)?;
-        } else {
-            bus.write_byte(DS28EA00_TOGGLE_PIO_OFF)?;
-            bus.write_byte(DS28EA00_TOGGLE_PIO_ON)?;
-        }
-        Ok(())
+        write_bytes(bus, if enable { &PIO_ON } else { &PIO_OFF })
     }
 
     /// Turn the LED of all DS28EA00 devices in the group on or off.
@@ -294,15 +512,73 @@ impl<const N: usize> Ds28ea00Group<N> {
         enable: bool,
     ) -> OneWireResult<(), O::BusError> {
         bus.address(None)?;
-        bus.write_byte(DS28EA00_TOGGLE_PIO)?;
-        if !enable {
-            bus.write_byte(DS28EA00_TOGGLE_PIO_ON)?;
-            bus.write_byte(DS28EA00_TOGGLE_PIO_OFF)?;
+        write_bytes(bus, if enable { &PIO_ON } else { &PIO_OFF })
+    }
+}
+
+/// Writes `bytes` to the bus one byte at a time, e.g. a command and its arguments.
+///
+/// The [`OneWire`] trait has no block transfer, so this only shortens the callers: each byte is
+/// still one bus master command, and one I2C transaction on a DS2484.
+fn write_bytes<O: OneWire>(bus: &mut O, bytes: &[u8]) -> OneWireResult<(), O::BusError> {
+    for b in bytes {
+        bus.write_byte(*b)?;
+    }
+    Ok(())
+}
+
+/// Reads `buf.len()` bytes from the bus one byte at a time, with the same cost as [`write_bytes`].
+fn read_bytes<O: OneWire>(bus: &mut O, buf: &mut [u8]) -> OneWireResult<(), O::BusError> {
+    for b in buf.iter_mut() {
+        *b = bus.read_byte()?;
+    }
+    Ok(())
+}
+
+/// Addresses the device addressed last by a match ROM, with a single byte instead of its ROM.
+fn resume<O: OneWire>(bus: &mut O) -> OneWireResult<(), O::BusError> {
+    if !bus.reset()?.presence() {
+        return Err(OneWireError::NoDevicePresent);
+    }
+    bus.write_byte(DS28EA00_RESUME)
+}
+
+/// Number of consecutive good readings with CRC validation before a suspicious device is read fast again.
+pub const CRC_SUSPECT_READS: u8 = 8;
+
+/// Per-device state of the periodic CRC verification, kept by a [`DeviceStorage`].
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CrcCheck {
+    last: Option<Temperature>, // Last good reading
+    fast_reads: u16,           // Readings without CRC validation since the last full read
+    suspect: u8,               // Readings left to do with CRC validation
+}
+
+impl CrcCheck {
+    /// Whether the next reading needs a full scratchpad read.
+    fn due(&self, every: u16) -> bool {
+        self.suspect > 0 || self.last.is_none() || self.fast_reads.saturating_add(1) >= every
+    }
+
+    /// Whether a reading looks corrupted: the power-on value, or a jump from the last good reading.
+    fn suspicious(&self, temp: Temperature, max_jump: Temperature) -> bool {
+        if temp == Temperature::from_bits(85 << 4) {
+            return true;
+        }
+        self.last.is_some_and(|last| {
+            (temp.to_bits() as i32 - last.to_bits() as i32).unsigned_abs()
+                > max_jump.to_bits().unsigned_abs() as u32
+        })
+    }
+
+    fn update(&mut self, temp: Temperature, full: bool) {
+        if full {
+            self.fast_reads = 0;
+            self.suspect = self.suspect.saturating_sub(1);
         } else {
-            bus.write_byte(DS28EA00_TOGGLE_PIO_OFF)?;
-            bus.write_byte(DS28EA00_TOGGLE_PIO_ON)?;
+            self.fast_reads = self.fast_reads.saturating_add(1);
         }
-        Ok(())
+        self.last = Some(temp);
     }
 }
 
@@ -311,6 +587,11 @@ impl<const N: usize> Ds28ea00Group<N> {
 /// This type represents a temperature value with a fixed-point format of 12 bits for the integer part and 4 bits for the fractional part.
 pub type Temperature = I12F4;
 
+/// Reading of a device that could not be read, e.g. after a CRC error, when read with `ignore_errors`.
+///
+/// Outside of the -40 °C to 85 °C range of the device, so that it can not be a real reading.
+pub const READ_ERROR_TEMPERATURE: Temperature = Temperature::from_bits(-85 << 4);
+
 #[repr(u8)]
 #[derive(Debug, Copy, Clone)]
 /// Represents the readout resolution of the DS28EA00 devices.
@@ -376,10 +657,23 @@ const DS28EA00_WRITE_SCRATCH: u8 = 0x4e;
 #[allow(unused)]
 const DS28EA00_COPY_SCRATCH: u8 = 0x48;
 const DS28EA00_START_CONV: u8 = 0x44;
-#[allow(unused)]
 const DS28EA00_READ_POWERMODE: u8 = 0xb4;
 #[allow(unused)]
 const DS28EA00_RECALL_EEPROM: u8 = 0xb8;
 const DS28EA00_TOGGLE_PIO: u8 = 0xa5;
 const DS28EA00_TOGGLE_PIO_ON: u8 = 0b11111101;
 const DS28EA00_TOGGLE_PIO_OFF: u8 = !0b11111101;
+/// Resume ROM command: addresses the device selected by the last match ROM
+const DS28EA00_RESUME: u8 = 0xa5;
+/// PIO access write that turns the PIO pin on: the output byte, then its complement
+const PIO_ON: [u8; 3] = [
+    DS28EA00_TOGGLE_PIO,
+    DS28EA00_TOGGLE_PIO_OFF,
+    DS28EA00_TOGGLE_PIO_ON,
+];
+/// PIO access write that turns the PIO pin off
+const PIO_OFF: [u8; 3] = [
+    DS28EA00_TOGGLE_PIO,
+    DS28EA00_TOGGLE_PIO_ON,
+    DS28EA00_TOGGLE_PIO_OFF,
+];
@@ -0,0 +1,115 @@
+//! Storage of the devices of a [`Ds28ea00Devices`](crate::Ds28ea00Devices) group.
+#[cfg(feature = "alloc")]
+use alloc::vec::Vec;
+
+use crate::{CrcCheck, Temperature};
+
+/// Contiguous storage of the devices of a group: the ROM and last reading of each device, which
+/// [`Ds28ea00Devices::read_temperatures`](crate::Ds28ea00Devices::read_temperatures) returns as a
+/// slice, and the state of its periodic CRC verification.
+pub trait DeviceStorage: Default {
+    /// Number of devices stored.
+    fn len(&self) -> usize;
+    /// Whether no device is stored.
+    fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+    /// Whether no more devices fit.
+    fn is_full(&self) -> bool;
+    /// Remove every device.
+    fn clear(&mut self);
+    /// Append a device, with no reading yet. Does nothing if [`Self::is_full`].
+    fn push(&mut self, rom: u64);
+    /// ROMs and last readings of the devices.
+    fn readings(&self) -> &[(u64, Temperature)];
+    /// ROMs and last readings of the devices, and their CRC verification state.
+    fn readings_mut(&mut self) -> (&mut [(u64, Temperature)], &mut [CrcCheck]);
+}
+
+/// Storage for up to `N` devices, inline in the group.
+#[derive(Debug)]
+pub struct InlineStorage<const N: usize> {
+    len: usize,
+    readings: [(u64, Temperature); N],
+    checks: [CrcCheck; N],
+}
+
+impl<const N: usize> Default for InlineStorage<N> {
+    fn default() -> Self {
+        Self {
+            len: 0,
+            readings: [(0, Temperature::ZERO); N],
+            checks: [CrcCheck::default(); N],
+        }
+    }
+}
+
+impl<const N: usize> DeviceStorage for InlineStorage<N> {
+    fn len(&self) -> usize {
+        self.len
+    }
+
+    fn is_full(&self) -> bool {
+        self.len == N
+    }
+
+    fn clear(&mut self) {
+        self.len = 0;
+    }
+
+    fn push(&mut self, rom: u64) {
+        if self.len < N {
+            self.readings[self.len] = (rom, Temperature::ZERO);
+            self.checks[self.len] = CrcCheck::default();
+            self.len += 1;
+        }
+    }
+
+    fn readings(&self) -> &[(u64, Temperature)] {
+        &self.readings[..self.len]
+    }
+
+    fn readings_mut(&mut self) -> (&mut [(u64, Temperature)], &mut [CrcCheck]) {
+        (&mut self.readings[..self.len], &mut self.checks[..self.len])
+    }
+}
+
+/// Storage for any number of devices, on the heap.
+///
+/// The storage grows while the devices are enumerated or restored, and keeps its capacity when they
+/// are enumerated again, so that reconnecting a bus does not allocate.
+#[cfg(feature = "alloc")]
+#[derive(Debug, Default)]
+pub struct VecStorage {
+    readings: Vec<(u64, Temperature)>,
+    checks: Vec<CrcCheck>,
+}
+
+#[cfg(feature = "alloc")]
+impl DeviceStorage for VecStorage {
+    fn len(&self) -> usize {
+        self.readings.len()
+    }
+
+    fn is_full(&self) -> bool {
+        false
+    }
+
+    fn clear(&mut self) {
+        self.readings.clear();
+        self.checks.clear();
+    }
+
+    fn push(&mut self, rom: u64) {
+        self.readings.push((rom, Temperature::ZERO));
+        self.checks.push(CrcCheck::default());
+    }
+
+    fn readings(&self) -> &[(u64, Temperature)] {
+        &self.readings
+    }
+
+    fn readings_mut(&mut self) -> (&mut [(u64, Temperature)], &mut [CrcCheck]) {
+        (&mut self.readings, &mut self.checks)
+    }
+}
@@ -10,6 +10,18 @@ pub struct SlaveAddress {
     pub a0: bool,
     #[bits(1, default = false)]
     pub a1: bool,
-    #[bits(6, default = 0x44)]
+    #[bits(6, default = 0x44 >> 2)]
     reserved: u8,
 }
+
+#[cfg(test)]
+mod test {
+    #[test]
+    fn test_addr() {
+        let addr = super::SlaveAddress::default();
+        assert_eq!(addr.into_bits(), 0x44);
+        assert_eq!(addr.with_a0(true).into_bits(), 0x45);
+        assert_eq!(addr.with_a1(true).into_bits(), 0x46);
+        assert_eq!(addr.with_a0(true).with_a1(true).into_bits(), 0x47);
+    }
+}
@@ -0,0 +1,191 @@
+use core::time::Duration;
+
+use embedded_hal::{
+    delay::DelayNs,
+    i2c::{I2c, SevenBitAddress},
+};
+
+use crate::{Error, address::SlaveAddress, register::HDC3022_MANUFACTURER_ID};
+
+const HDC3022_CMD_EXIT_AUTO: [u8; 2] = [0x30, 0x93];
+const HDC3022_CMD_FETCH: [u8; 2] = [0xe0, 0x00];
+const HDC3022_CMD_MANUFACTURER_ID: [u8; 2] = [0x37, 0x81];
+/// NIST ID (serial number), most significant word first.
+const HDC3022_CMD_NIST_ID: [[u8; 2]; 3] = [[0x36, 0x83], [0x36, 0x84], [0x36, 0x85]];
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+/// Measurement rate of the HDC3022 auto-measurement mode, in the lowest noise power mode.
+pub enum MeasurementRate {
+    /// One measurement every 2 seconds.
+    HalfHz,
+    #[default]
+    /// One measurement every second.
+    OneHz,
+    /// Two measurements per second.
+    TwoHz,
+    /// Four measurements per second.
+    FourHz,
+    /// Ten measurements per second.
+    TenHz,
+}
+
+impl MeasurementRate {
+    /// The slowest rate that provides a new measurement at least once per `period`.
+    pub fn at_least(period: Duration) -> Self {
+        use MeasurementRate::*;
+        match period.as_millis() {
+            2000.. => HalfHz,
+            1000.. => OneHz,
+            500.. => TwoHz,
+            250.. => FourHz,
+            _ => TenHz,
+        }
+    }
+
+    /// Interval between two measurements.
+    pub fn period(self) -> Duration {
+        use MeasurementRate::*;
+        Duration::from_millis(match self {
+            HalfHz => 2000,
+            OneHz => 1000,
+            TwoHz => 500,
+            FourHz => 250,
+            TenHz => 100,
+        })
+    }
+
+    const fn command(self) -> [u8; 2] {
+        use MeasurementRate::*;
+        match self {
+            HalfHz => [0x20, 0x32],
+            OneHz => [0x21, 0x30],
+            TwoHz => [0x22, 0x36],
+            FourHz => [0x23, 0x34],
+            TenHz => [0x27, 0x37],
+        }
+    }
+}
+
+#[derive(Debug, Clone, Copy, Default)]
+/// A temperature and humidity measurement read from an HDC3022 in auto-measurement mode.
+pub struct AutoReading {
+    temperature: u16,
+    humidity: u16,
+}
+
+impl AutoReading {
+    /// Temperature in Celsius.
+    pub fn celsius(&self) -> f32 {
+        -45.0 + 175.0 * self.temperature as f32 / 65535.0
+    }
+
+    /// Relative humidity in percent (0-100).
+    pub fn percentage(&self) -> f32 {
+        100.0 * self.humidity as f32 / 65535.0
+    }
+}
+
+/// An HDC3022 sensor in auto-measurement mode.
+///
+/// The sensor measures temperature and humidity on its own at the configured rate, and [`Self::fetch`]
+/// reads the latest measurement back in a single transfer, without a trigger and a conversion wait.
+/// The I2C bus is not held, so that several sensors can share one bus.
+#[derive(Debug)]
+pub struct AutoMeasurement {
+    address: u8,
+    rate: MeasurementRate,
+    serial: u64,
+}
+
+impl AutoMeasurement {
+    /// Check that an HDC3022 answers at `address`, read its serial number, and start its auto-measurement
+    /// mode at `rate`.
+    ///
+    /// A sensor left in auto-measurement mode, e.g. by a previous run, is stopped first.
+    pub fn start<T: I2c<SevenBitAddress>, D: DelayNs>(
+        i2c: &mut T,
+        delay: &mut D,
+        address: SlaveAddress,
+        rate: MeasurementRate,
+    ) -> Result<Self, Error<T::Error>> {
+        let address = address.into_bits();
+        let _ = i2c.write(address, &HDC3022_CMD_EXIT_AUTO); // not in auto-measurement mode
+        delay.delay_ms(1);
+        let mut buffer = [0u8; 3];
+        i2c.write_read(address, &HDC3022_CMD_MANUFACTURER_ID, &mut buffer)?;
+        let id = word(&buffer)?;
+        if id != HDC3022_MANUFACTURER_ID {
+            return Err(Error::InvalidId);
+        }
+        // The NIST ID is only readable outside of auto-measurement mode
+        let mut serial = 0u64;
+        for cmd in HDC3022_CMD_NIST_ID.iter() {
+            i2c.write_read(address, cmd, &mut buffer)?;
+            serial = serial << 16 | word(&buffer)? as u64;
+        }
+        i2c.write(address, &rate.command())?;
+        Ok(Self {
+            address,
+            rate,
+            serial,
+        })
+    }
+
+    /// I2C address of the sensor.
+    pub fn get_address(&self) -> u8 {
+        self.address
+    }
+
+    /// 48-bit NIST ID (serial number) of the sensor, read by [`Self::start`].
+    pub fn get_serial(&self) -> u64 {
+        self.serial
+    }
+
+    /// Measurement rate of the sensor. The first measurement is available one period after [`Self::start`].
+    pub fn rate(&self) -> MeasurementRate {
+        self.rate
+    }
+
+    /// Read the latest temperature and humidity measurement.
+    pub fn fetch<T: I2c<SevenBitAddress>>(
+        &mut self,
+        i2c: &mut T,
+    ) -> Result<AutoReading, Error<T::Error>> {
+        let mut buffer = [0u8; 6];
+        i2c.write_read(self.address, &HDC3022_CMD_FETCH, &mut buffer)?;
+        Ok(AutoReading {
+            temperature: word(&buffer[..3])?,
+            humidity: word(&buffer[3..])?,
+        })
+    }
+
+    /// Stop the auto-measurement mode.
+    pub fn stop<T: I2c<SevenBitAddress>>(self, i2c: &mut T) -> Result<(), Error<T::Error>> {
+        i2c.write(self.address, &HDC3022_CMD_EXIT_AUTO)?;
+        Ok(())
+    }
+}
+
+/// A 16-bit word followed by its CRC.
+fn word<E>(buffer: &[u8]) -> Result<u16, Error<E>> {
+    if crc8(&buffer[..2]) != buffer[2] {
+        return Err(Error::InvalidCrc);
+    }
+    Ok(u16::from_be_bytes([buffer[0], buffer[1]]))
+}
+
+/// CRC-8 of the HDC3022 (polynomial 0x31, initial value 0xff).
+fn crc8(data: &[u8]) -> u8 {
+    let mut crc = 0xffu8;
+    for byte in data {
+        crc ^= byte;
+        for _ in 0..8 {
+            crc = if crc & 0x80 != 0 {
+                (crc << 1) ^ 0x31
+            } else {
+                crc << 1
+            };
+        }
+    }
+    crc
+}
@@ -13,6 +13,8 @@ pub enum Error<E> {
     Timeout,
     /// The sensor is not configured for the requested operation.
     InvalidOperation,
+    /// The CRC of the data read from the sensor does not match.
+    InvalidCrc,
 }
 
 impl<E> From<E> for Error<E> {
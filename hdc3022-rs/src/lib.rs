@@ -4,11 +4,13 @@
 //! This crate provides a driver for the HDC1010 sensor, allowing you to read humidity and temperature data.
 //! It supports various configurations such as acquisition mode and resolution settings.
 mod address;
+mod auto;
 mod core;
 mod error;
 mod register;
 
 pub use address::SlaveAddress;
+pub use auto::{AutoMeasurement, AutoReading, MeasurementRate};
 pub use core::{Hdc3022, Hdc3022Builder};
 pub use error::Error;
 pub use register::{
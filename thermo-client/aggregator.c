@@ -0,0 +1,252 @@
+/**
+ * @file aggregator.c
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data aggregator for PICTURE-D: Merges the data streams of many serial ports in a single event loop.
+ * @version 0.0.1
+ * @date 2025-06-10
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include "thermo_client.h"
+
+#define BATCH_SIZE 64         // Records drained from a port at a time
+#define MERGE_SIZE 4096       // Records held for reordering
+#define REORDER_WINDOW_MS 20  // Records younger than this are held back, so that late ports can be merged in order
+#define BACKOFF_MIN_MS 50     // First reconnect delay
+#define BACKOFF_MAX_MS 1000   // Reconnect delay cap, the retry interval of thermo-client
+#define EVENT_SIZE 32         // Events handled per epoll_wait
+
+volatile sig_atomic_t running = 1;
+
+void sighandler(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+typedef struct
+{
+    const char *path;        // Serial port path
+    thermo_client_s *client; // NULL while disconnected
+    int backoff_ms;          // Delay before the next reconnect attempt
+    int64_t retry_at_ms;     // Time of the next reconnect attempt
+} port_s;
+
+typedef struct
+{
+    int64_t time_us; // Receive time, taken right after the read that delivered the record
+    int port;        // Index of the port that delivered the record
+    uint64_t order;  // Arrival order, to keep the merge stable
+    thermal_data_s data;
+} record_s;
+
+static record_s merge[MERGE_SIZE];
+static int merge_count = 0;
+static uint64_t merge_order = 0;
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int record_cmp(const void *a, const void *b)
+{
+    const record_s *ra = a, *rb = b;
+    if (ra->time_us != rb->time_us)
+    {
+        return ra->time_us < rb->time_us ? -1 : 1;
+    }
+    return ra->order < rb->order ? -1 : (ra->order > rb->order);
+}
+
+/**
+ * @brief Print the records received before `cutoff_us` in time order, and keep the rest for the next flush.
+ *
+ */
+static void merge_flush(port_s *ports, int64_t cutoff_us)
+{
+    if (merge_count == 0)
+    {
+        return;
+    }
+    qsort(merge, merge_count, sizeof(record_s), record_cmp);
+    int i = 0;
+    for (; i < merge_count && merge[i].time_us <= cutoff_us; i++)
+    {
+        const record_s *r = &merge[i];
+        printf("%lld.%06lld %s: Type: %c, Source: 0x%08x, Value: %.2f %c\n",
+               (long long)(r->time_us / 1000000), (long long)(r->time_us % 1000000), ports[r->port].path,
+               r->data.type, r->data.source, r->data.value, r->data.type == 'T' ? 'C' : '%');
+    }
+    memmove(merge, merge + i, (merge_count - i) * sizeof(record_s));
+    merge_count -= i;
+    fflush(stdout);
+}
+
+static void port_disconnect(port_s *port, int epfd, int64_t now_ms)
+{
+    epoll_ctl(epfd, EPOLL_CTL_DEL, thermo_client_fd(port->client), NULL);
+    thermo_client_destroy(port->client);
+    port->client = NULL;
+    port->backoff_ms = BACKOFF_MIN_MS;
+    port->retry_at_ms = now_ms + port->backoff_ms;
+}
+
+static void port_connect(port_s *port, int idx, int epfd, int64_t now_ms)
+{
+    int fd = thermo_client_init(port->path);
+    thermo_client_s *client = fd < 0 ? NULL : thermo_client_create(fd);
+    if (client == NULL || thermo_client_set_nonblocking(client, 1) < 0)
+    {
+        goto retry;
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.u32 = idx};
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        goto retry;
+    }
+    fprintf(stderr, "%s: Connected\n", port->path);
+    port->client = client;
+    port->backoff_ms = BACKOFF_MIN_MS;
+    return;
+retry:
+    if (client != NULL)
+    {
+        thermo_client_destroy(client);
+    }
+    else if (fd >= 0)
+    {
+        close(fd);
+    }
+    port->retry_at_ms = now_ms + port->backoff_ms;
+    port->backoff_ms *= 2;
+    if (port->backoff_ms > BACKOFF_MAX_MS)
+    {
+        port->backoff_ms = BACKOFF_MAX_MS;
+    }
+}
+
+static void port_read(port_s *ports, int idx)
+{
+    thermal_data_ex_s data[BATCH_SIZE];
+    int count;
+    while ((count = thermo_client_drain_ex(ports[idx].client, data, BATCH_SIZE)) > 0)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            if (merge_count == MERGE_SIZE)
+            {
+                merge_flush(ports, INT64_MAX); // Out of room: give up on ordering against later arrivals
+            }
+            record_s *r = &merge[merge_count++];
+            r->time_us = data[i].rx_time_ns / 1000;
+            r->port = idx;
+            r->order = merge_order++;
+            r->data = data[i].data;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <serial_port> [<serial_port> ...]\n", argv[0]);
+        return 1;
+    }
+    signal(SIGINT, sighandler);
+    int nports = argc - 1;
+    port_s *ports = calloc(nports, sizeof(port_s));
+    if (ports == NULL)
+    {
+        perror("Error allocating ports");
+        return 1;
+    }
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+    {
+        perror("Error creating epoll instance");
+        free(ports);
+        return 1;
+    }
+    for (int i = 0; i < nports; i++)
+    {
+        ports[i].path = argv[i + 1];
+        ports[i].backoff_ms = BACKOFF_MIN_MS;
+    }
+    struct epoll_event events[EVENT_SIZE];
+    while (running)
+    {
+        int64_t now_ms = now_us() / 1000;
+        // Reconnect ports that are due, and find the next deadline
+        int timeout_ms = REORDER_WINDOW_MS;
+        for (int i = 0; i < nports; i++)
+        {
+            if (ports[i].client != NULL)
+            {
+                continue;
+            }
+            if (ports[i].retry_at_ms <= now_ms)
+            {
+                port_connect(&ports[i], i, epfd, now_ms);
+            }
+            if (ports[i].client == NULL && ports[i].retry_at_ms - now_ms < timeout_ms)
+            {
+                timeout_ms = (int)(ports[i].retry_at_ms - now_ms);
+            }
+        }
+        int nevents = epoll_wait(epfd, events, EVENT_SIZE, timeout_ms);
+        if (nevents < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("Error waiting for events");
+            break;
+        }
+        for (int i = 0; i < nevents; i++)
+        {
+            int idx = events[i].data.u32;
+            port_s *port = &ports[idx];
+            if (port->client == NULL)
+            {
+                continue;
+            }
+            ssize_t bytes_read = 0;
+            if (events[i].events & EPOLLIN)
+            {
+                bytes_read = thermo_client_feed(port->client);
+                if (bytes_read > 0)
+                {
+                    port_read(ports, idx);
+                }
+            }
+            if (bytes_read < 0 || (bytes_read == 0 && (events[i].events & (EPOLLERR | EPOLLHUP))))
+            {
+                fprintf(stderr, "%s: Disconnected: %s\n", port->path, bytes_read < 0 ? strerror(errno) : "hangup");
+                port_disconnect(port, epfd, now_us() / 1000);
+            }
+        }
+        merge_flush(ports, now_us() - REORDER_WINDOW_MS * 1000);
+    }
+    merge_flush(ports, INT64_MAX);
+    for (int i = 0; i < nports; i++)
+    {
+        thermo_client_destroy(ports[i].client);
+    }
+    close(epfd);
+    free(ports);
+    return 0;
+}
@@ -0,0 +1,409 @@
+/**
+ * @file bench.c
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data client benchmark for PICTURE-D: Decoder throughput, CPU cost, latency and loss on synthetic streams.
+ * @version 0.0.1
+ * @date 2025-06-24
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "thermo_client.h"
+#include "thermo_loadgen.h"
+#include "thermo_manifest.h"
+
+#define BATCH_SIZE 64   // Records read at a time, as in thermo-client
+#define IDLE_MS 200     // The stream is over once nothing arrived for this long after the generator is done
+
+volatile sig_atomic_t running = 1;
+
+void sighandler(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+typedef struct
+{
+    thermo_loadgen_s *gen;                // Stream generator, written from the writer thread
+    thermo_client_s *client;              // Decoder, read from the reader thread
+    thermo_dense_s *dense;                // Dense vector of the manifest, NULL to read records
+    pthread_t writer, reader;             // Threads of the port
+    volatile sig_atomic_t writing;        // Cleared once the generator is done
+    int error;                            // errno of a failed read or write, 0 otherwise
+    uint64_t received;                    // Records decoded
+    uint64_t foreign;                     // Records decoded with a source the generator does not use (with -m: rejected by the manifest)
+    int64_t start_ns, end_ns;             // Reader start, and receive time of the last record
+    int64_t cpu_ns;                       // CPU time of the reader thread
+} port_s;
+
+static int64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *port_write(void *arg)
+{
+    port_s *port = arg;
+    if (thermo_loadgen_run(port->gen, &running) < 0)
+    {
+        port->error = errno;
+    }
+    port->writing = 0;
+    return NULL;
+}
+
+static int source_known(const thermal_data_s *d, const thermo_loadgen_config_s *config)
+{
+    uint32_t base = d->type == 'T' ? THERMO_LOADGEN_TEMP_BASE : THERMO_LOADGEN_HUM_BASE;
+    int count = d->type == 'T' ? config->sensors : config->humidity;
+    return (d->type == 'T' || d->type == 'H') && d->source >= base && d->source < base + (uint32_t)count;
+}
+
+static const thermo_loadgen_config_s *bench_config;
+
+/**
+ * @brief Create the manifest of the generated sensors: temperature sensors, then humidity sensors.
+ *
+ */
+static thermo_manifest_s *bench_manifest(const thermo_loadgen_config_s *config)
+{
+    size_t count = config->sensors + config->humidity;
+    thermo_manifest_sensor_s *sensors = calloc(count, sizeof(thermo_manifest_sensor_s));
+    if (sensors == NULL)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        int temperature = i < (size_t)config->sensors;
+        sensors[i].type = temperature ? 'T' : 'H';
+        sensors[i].source = temperature ? THERMO_LOADGEN_TEMP_BASE + i : THERMO_LOADGEN_HUM_BASE + (i - config->sensors);
+    }
+    thermo_manifest_s *manifest = thermo_manifest_create(sensors, count);
+    free(sensors);
+    return manifest;
+}
+
+/**
+ * @brief Read the records of a port.
+ *
+ * @return int Number of records read, -1 on failure.
+ */
+static int port_read_records(port_s *port)
+{
+    thermal_data_ex_s data[BATCH_SIZE];
+    int result = thermo_client_read_many_ex(port->client, data, BATCH_SIZE, IDLE_MS / 4, &running);
+    for (int i = 0; i < result; i++)
+    {
+        port->foreign += !source_known(&data[i].data, bench_config);
+    }
+    if (result > 0)
+    {
+        port->end_ns = data[result - 1].rx_time_ns;
+    }
+    return result;
+}
+
+/**
+ * @brief Read the records of a port into its dense vector. Foreign sources are rejected by the decoder.
+ *
+ * @return int Number of records read, -1 on failure.
+ */
+static int port_read_dense(port_s *port)
+{
+    thermo_dense_s *dense = port->dense;
+    int result = thermo_client_read_dense(port->client, dense, IDLE_MS / 4, &running);
+    for (size_t i = 0; result > 0 && i < dense->count; i++)
+    {
+        if (dense->updated[i] && (int64_t)dense->rx_time_ns[i] > port->end_ns)
+        {
+            port->end_ns = dense->rx_time_ns[i];
+        }
+    }
+    return result;
+}
+
+static void *port_read(void *arg)
+{
+    port_s *port = arg;
+    int64_t cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    port->start_ns = clock_ns(CLOCK_MONOTONIC);
+    int64_t idle_since = 0;
+    while (running)
+    {
+        int writing = port->writing;
+        int result = port->dense != NULL ? port_read_dense(port) : port_read_records(port);
+        if (result < 0)
+        {
+            port->error = errno;
+            break;
+        }
+        port->received += result;
+        if (result > 0)
+        {
+            idle_since = 0;
+            continue;
+        }
+        if (writing)
+        {
+            continue;
+        }
+        int64_t now = clock_ns(CLOCK_MONOTONIC);
+        if (idle_since == 0)
+        {
+            idle_since = now;
+        }
+        else if (now - idle_since >= IDLE_MS * 1000000ll)
+        {
+            break; // The generator is done, and everything it wrote has been decoded
+        }
+    }
+    port->cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+    return NULL;
+}
+
+static void hist_merge(thermo_hist_s *into, const thermo_hist_s *hist)
+{
+    into->count += hist->count;
+    into->sum_us += hist->sum_us;
+    into->max_us = hist->max_us > into->max_us ? hist->max_us : into->max_us;
+    for (int i = 0; i < THERMO_HIST_BUCKETS; i++)
+    {
+        into->buckets[i] += hist->buckets[i];
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-p ports] [-v 1|2] [-s sensors] [-H sensors] [-b burst] [-f bytes] [-c probability] [-r rate] [-n batches] [-S seed] [-m]\n"
+                    "  -p  Ports read at the same time, one reader thread each (default 1)\n"
+                    "  -v  Wire format version (default 1)\n"
+                    "  -s  Temperature sensors per batch (default 16)\n"
+                    "  -H  Humidity sensors per batch (default 0)\n"
+                    "  -b  Batches per write (default 1)\n"
+                    "  -f  Split writes into random fragments of at most this many bytes (default 0, no split)\n"
+                    "  -c  Probability that a frame has a corrupted byte (default 0)\n"
+                    "  -r  Writes per second and port (default 0, as fast as the reader takes them)\n"
+                    "  -n  Batches per port (default 10000)\n"
+                    "  -S  Seed of the fragment sizes and corruption (default 1)\n"
+                    "  -m  Decode into a dense vector, with a manifest of the generated sensors\n",
+            name);
+}
+
+int main(int argc, char *argv[])
+{
+    thermo_loadgen_config_s config;
+    thermo_loadgen_defaults(&config);
+    config.batches = 10000;
+    int nports = 1;
+    int dense = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:v:s:H:b:f:c:r:n:S:m")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            nports = atoi(optarg);
+            break;
+        case 'v':
+            config.version = atoi(optarg);
+            break;
+        case 's':
+            config.sensors = atoi(optarg);
+            break;
+        case 'H':
+            config.humidity = atoi(optarg);
+            break;
+        case 'b':
+            config.burst = atoi(optarg);
+            break;
+        case 'f':
+            config.fragment = atoi(optarg);
+            break;
+        case 'c':
+            config.corrupt = strtod(optarg, NULL);
+            break;
+        case 'r':
+            config.rate_hz = strtod(optarg, NULL);
+            break;
+        case 'n':
+            config.batches = strtoull(optarg, NULL, 0);
+            break;
+        case 'S':
+            config.seed = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            dense = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc || nports <= 0 || config.batches == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    bench_config = &config;
+    thermo_manifest_s *manifest = NULL;
+    if (dense && (manifest = bench_manifest(&config)) == NULL)
+    {
+        perror("Error creating manifest");
+        return 1;
+    }
+    signal(SIGINT, sighandler);
+    port_s *ports = calloc(nports, sizeof(port_s));
+    if (ports == NULL)
+    {
+        perror("Error allocating ports");
+        return 1;
+    }
+    int ret = 0;
+    int started = 0;
+    for (; started < nports; started++)
+    {
+        port_s *port = &ports[started];
+        thermo_loadgen_config_s port_config = config;
+        port_config.seed = config.seed + started;
+        port->gen = thermo_loadgen_open(&port_config);
+        if (port->gen == NULL)
+        {
+            perror("Error creating load generator");
+            ret = 1;
+            break;
+        }
+        // Set the port up before anything is written: thermo_client_init flushes pending input
+        int fd = thermo_client_init(thermo_loadgen_path(port->gen));
+        port->client = fd < 0 ? NULL : thermo_client_create(fd);
+        if (port->client == NULL)
+        {
+            perror("Error opening pseudo-terminal");
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            thermo_loadgen_close(port->gen);
+            ret = 1;
+            break;
+        }
+        if (manifest != NULL)
+        {
+            thermo_client_set_manifest(port->client, manifest);
+            port->dense = thermo_dense_create(manifest);
+            if (port->dense == NULL)
+            {
+                perror("Error creating dense vector");
+                thermo_client_destroy(port->client);
+                thermo_loadgen_close(port->gen);
+                ret = 1;
+                break;
+            }
+        }
+        port->writing = 1;
+        if (pthread_create(&port->reader, NULL, port_read, port) != 0)
+        {
+            perror("Error creating reader thread");
+            thermo_dense_destroy(port->dense);
+            thermo_client_destroy(port->client);
+            thermo_loadgen_close(port->gen);
+            ret = 1;
+            break;
+        }
+        if (pthread_create(&port->writer, NULL, port_write, port) != 0)
+        {
+            perror("Error creating writer thread");
+            running = 0;
+            pthread_join(port->reader, NULL);
+            thermo_dense_destroy(port->dense);
+            thermo_client_destroy(port->client);
+            thermo_loadgen_close(port->gen);
+            ret = 1;
+            break;
+        }
+    }
+    if (ret != 0)
+    {
+        running = 0; // Stop the ports already started
+    }
+    printf("v%d, %d+%d sensors, %d batches/write, fragments <= %d bytes, corruption %g, %llu batches x %d ports%s\n",
+           config.version, config.sensors, config.humidity, config.burst, config.fragment, config.corrupt,
+           (unsigned long long)config.batches, nports, dense ? ", dense" : "");
+    thermo_hist_s total_latency;
+    memset(&total_latency, 0, sizeof(total_latency));
+    uint64_t total_received = 0, total_sent = 0, total_lost = 0;
+    int64_t total_cpu_ns = 0, start_ns = INT64_MAX, end_ns = 0;
+    double total_rate = 0;
+    for (int i = 0; i < started; i++)
+    {
+        port_s *port = &ports[i];
+        pthread_join(port->writer, NULL);
+        pthread_join(port->reader, NULL);
+        if (port->error != 0)
+        {
+            fprintf(stderr, "Port %d: %s\n", i, strerror(port->error));
+            ret = 1;
+        }
+        thermo_loadgen_stats_s sent;
+        thermo_loadgen_get_stats(port->gen, &sent);
+        thermo_client_stats_s stats;
+        thermo_client_get_stats(port->client, &stats);
+        thermo_hist_s latency[2];
+        thermo_client_get_latency(port->client, latency);
+        if (port->dense != NULL)
+        {
+            port->foreign = stats.unknown; // rejected by the decoder, not received
+        }
+        uint64_t valid = port->dense != NULL ? port->received : port->received - port->foreign;
+        uint64_t lost = sent.records > valid ? sent.records - valid : 0;
+        double elapsed = (port->end_ns > port->start_ns ? port->end_ns - port->start_ns : 1) / 1e9;
+        double rate = port->received / elapsed;
+        printf("Port %d: %llu records in %.3f s, %.0f records/s, %.0f ns CPU/record, decode p50 <= %llu us, p99 <= %llu us\n"
+               "        loss %.4f%% (%llu of %llu records, %llu in corrupted frames), %llu foreign, %llu frames lost, %llu CRC errors, %llu resyncs, %llu bytes skipped\n",
+               i, (unsigned long long)port->received, elapsed, rate,
+               port->received > 0 ? (double)port->cpu_ns / port->received : 0.0,
+               (unsigned long long)thermo_hist_quantile_us(&latency[0], 0.5),
+               (unsigned long long)thermo_hist_quantile_us(&latency[0], 0.99),
+               sent.records > 0 ? 100.0 * lost / sent.records : 0.0, (unsigned long long)lost,
+               (unsigned long long)sent.records, (unsigned long long)sent.records_corrupted,
+               (unsigned long long)port->foreign, (unsigned long long)stats.frames_lost,
+               (unsigned long long)stats.crc_errors, (unsigned long long)stats.resyncs,
+               (unsigned long long)stats.bytes_skipped);
+        hist_merge(&total_latency, &latency[0]);
+        total_received += port->received;
+        total_sent += sent.records;
+        total_lost += lost;
+        total_cpu_ns += port->cpu_ns;
+        total_rate += rate;
+        start_ns = port->start_ns < start_ns ? port->start_ns : start_ns;
+        end_ns = port->end_ns > end_ns ? port->end_ns : end_ns;
+        thermo_dense_destroy(port->dense);
+        thermo_client_destroy(port->client);
+        thermo_loadgen_close(port->gen);
+    }
+    if (started > 1)
+    {
+        double elapsed = (end_ns > start_ns ? end_ns - start_ns : 1) / 1e9;
+        printf("Total: %llu records, %.0f records/s, %.0f ns CPU/record, %.1f%% of a CPU, decode p50 <= %llu us, p99 <= %llu us, loss %.4f%%\n",
+               (unsigned long long)total_received, total_rate,
+               total_received > 0 ? (double)total_cpu_ns / total_received : 0.0,
+               100.0 * total_cpu_ns / 1e9 / elapsed,
+               (unsigned long long)thermo_hist_quantile_us(&total_latency, 0.5),
+               (unsigned long long)thermo_hist_quantile_us(&total_latency, 0.99),
+               total_sent > 0 ? 100.0 * total_lost / total_sent : 0.0);
+    }
+    free(ports);
+    thermo_manifest_destroy(manifest);
+    return ret;
+}
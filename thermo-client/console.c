@@ -9,13 +9,24 @@
  * 
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <signal.h>
 #include <ncurses.h>
 #include <pthread.h>
 #include <string.h>
 #include <errno.h>
+#include <stdatomic.h>
+#include <time.h>
 #include "thermo_client.h"
+#include "thermo_reconnect.h"
+#include "thermo_table.h"
+
+#define BATCH_SIZE 64        // Records read from the serial port at a time
+#define RING_SIZE 1024       // Samples buffered between the reader and the renderer, must be a power of 2
+#define MAX_SENSORS 128      // Sensors shown by the renderer
+#define RENDER_PERIOD_MS 100 // Redraw at 10 Hz
+#define INPUT_BUF_SIZE 256
 
 volatile sig_atomic_t running = 1;
 
@@ -25,111 +36,290 @@ void sighandler(int sig)
     running = 0;
 }
 
+typedef struct
+{
+    thermal_data_s data; // Received record, valid if err is 0
+    uint64_t time_ns;    // Receive time
+    int err;             // errno of a serial port error reported by the reader
+} sample_s;
+
+/**
+ * @brief Lock-free single-producer/single-consumer ring. The reader thread pushes, the renderer pops.
+ *
+ */
+typedef struct
+{
+    _Alignas(64) atomic_size_t head; // Next slot to write, owned by the producer
+    _Alignas(64) atomic_size_t tail; // Next slot to read, owned by the consumer
+    _Alignas(64) sample_s buf[RING_SIZE];
+} ring_s;
+
+static int ring_push(ring_s *ring, const sample_s *sample)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail == RING_SIZE)
+    {
+        return 0; // Full
+    }
+    ring->buf[head & (RING_SIZE - 1)] = *sample;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 1;
+}
+
+static int ring_pop(ring_s *ring, sample_s *sample)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail)
+    {
+        return 0; // Empty
+    }
+    *sample = ring->buf[tail & (RING_SIZE - 1)];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
 WINDOW *output_win, *input_win;
-int thermo_fd = -1;
-pthread_mutex_t win_lock = PTHREAD_MUTEX_INITIALIZER;
+atomic_int thermo_fd = -1;
+static ring_s ring;
+static atomic_ulong dropped = 0; // Samples dropped because the renderer fell behind
 
 void init_ui()
 {
     initscr();
     cbreak();
+    noecho();
 
     int height, width;
     getmaxyx(stdscr, height, width);
 
     output_win = newwin(height - 3, width, 0, 0);
-    scrollok(output_win, TRUE);
 
     input_win = newwin(3, width, height - 3, 0);
+    keypad(input_win, TRUE);
+    wtimeout(input_win, RENDER_PERIOD_MS);
     box(input_win, 0, 0);
     mvwprintw(input_win, 1, 1, ">> ");
     wrefresh(input_win);
 }
 
-void *read_input(void *arg)
+static uint64_t now_ns(void)
 {
-    (void) arg;
-#define INPUT_BUF_SIZE 256
-    char input_buf[INPUT_BUF_SIZE];
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
+/**
+ * @brief Serial reader thread: decodes frames and pushes them into the ring. Never calls ncurses.
+ *
+ */
+void *read_serial(void *arg)
+{
+    const char *port = arg;
+    thermal_data_s data[BATCH_SIZE];
+    thermo_client_s *client = NULL;
+    thermo_reconnect_s *reconnect = thermo_reconnect_create(port);
+    if (reconnect == NULL)
+    {
+        sample_s sample = {.err = errno};
+        ring_push(&ring, &sample);
+        return NULL;
+    }
     while (running)
     {
-        mvwgetnstr(input_win, 1, 4, input_buf, INPUT_BUF_SIZE - 1);
-
-        if (strcmp(input_buf, "/quit") == 0)
+        // Opens as soon as the port reappears, and keeps the decoder state across the reconnect
+        int fd = thermo_reconnect_open(reconnect, &running);
+        if (fd < 0)
         {
-            running = 0;
-            break;
+            break; // Stopped while waiting for the port
         }
-
-        if (thermo_fd && strlen(input_buf) > 0)
+        int res;
+        if (client == NULL)
+        {
+            client = thermo_client_create(fd);
+            res = client == NULL ? -1 : 0;
+        }
+        else
         {
-            int w = write(thermo_fd, input_buf, strlen(input_buf));
-            (void) w;
+            res = thermo_client_reattach(client, fd);
+        }
+        if (res < 0)
+        {
+            sample_s sample = {.err = errno};
+            close(fd);
+            if (!ring_push(&ring, &sample))
+            {
+                atomic_fetch_add(&dropped, 1);
+            }
+            continue; // Initialization failed, thermo_reconnect_open paces the next attempt
+        }
+        atomic_store(&thermo_fd, fd);
+        while (running)
+        {
+            int result = thermo_client_read_many(client, data, BATCH_SIZE, RENDER_PERIOD_MS, &running);
+            if (result < 0)
+            {
+                sample_s sample = {.err = errno};
+                if (!ring_push(&ring, &sample))
+                {
+                    atomic_fetch_add(&dropped, 1);
+                }
+                break;
+            }
+            uint64_t time_ns = now_ns();
+            for (int i = 0; i < result; i++)
+            {
+                sample_s sample = {.data = data[i], .time_ns = time_ns};
+                if (!ring_push(&ring, &sample))
+                {
+                    atomic_fetch_add(&dropped, 1);
+                }
+            }
         }
-        werase(input_win);
-        box(input_win, 0, 0);
-        mvwprintw(input_win, 1, 1, ">> ");
-        wrefresh(input_win);
+        atomic_store(&thermo_fd, -1);
     }
+    thermo_client_destroy(client);
+    thermo_reconnect_destroy(reconnect);
     return NULL;
 }
 
+/**
+ * @brief Draw the latest value of every sensor. Sensors are only reported when they change,
+ * so a sensor keeps its value until it has been silent for longer than `heartbeat_ns`.
+ *
+ */
+static void render(const thermo_table_s *table, const char *status, uint64_t heartbeat_ns)
+{
+    static thermo_sensor_s sensors[MAX_SENSORS];
+    int nsensors = thermo_table_snapshot(table, sensors, MAX_SENSORS);
+    uint64_t now = now_ns();
+    werase(output_win);
+    mvwprintw(output_win, 0, 0, "%-4s %-10s %10s %10s %8s", "Type", "Source", "Value", "Samples", "Age (s)");
+    int height = getmaxy(output_win);
+    for (int i = 0; i < nsensors && i + 2 < height; i++)
+    {
+        const thermo_sensor_s *sensor = &sensors[i];
+        double age = now > sensor->timestamp_ns ? (now - sensor->timestamp_ns) * 1e-9 : 0;
+        mvwprintw(output_win, i + 1, 0, "%-4c 0x%08x %8.2f %c %10llu %8.1f%s", sensor->type, sensor->source, sensor->value, sensor->type == 'T' ? 'C' : '%', (unsigned long long)sensor->count,
+                  age, thermo_sensor_stale(sensor, now, heartbeat_ns) ? " stale" : "");
+    }
+    mvwprintw(output_win, height - 1, 0, "%s (dropped: %lu)", status, atomic_load(&dropped));
+    wnoutrefresh(output_win);
+}
+
+static void reset_input(void)
+{
+    werase(input_win);
+    box(input_win, 0, 0);
+    mvwprintw(input_win, 1, 1, ">> ");
+    wnoutrefresh(input_win);
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    if (argc != 2 && argc != 3)
     {
-        fprintf(stderr, "Usage: %s <serial_port>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <serial_port> [heartbeat_ms]\n", argv[0]);
         return 1;
     }
-    int fd = 0;
-    thermal_data_s data;
+    uint64_t heartbeat_ns = (argc == 3 ? strtoull(argv[2], NULL, 0) : THERMO_CLIENT_HEARTBEAT_MS) * 1000000ull;
     signal(SIGINT, sighandler);
 
     init_ui();
 
-    pthread_t input_thread;
-    if (pthread_create(&input_thread, NULL, read_input, NULL) != 0)
+    pthread_t reader_thread;
+    if (pthread_create(&reader_thread, NULL, read_serial, argv[1]) != 0)
     {
-        perror("Failed to create input thread");
         endwin();
-        goto end;
+        perror("Failed to create reader thread");
+        return 1;
     }
 
+    thermo_table_s *table = thermo_table_create(MAX_SENSORS);
+    if (table == NULL)
+    {
+        endwin();
+        perror("Failed to create sensor table");
+        return 1;
+    }
+    char status[256] = "Waiting for data...";
+    char input_buf[INPUT_BUF_SIZE];
+    int input_len = 0;
+    int64_t next_frame = now_ms();
     while (running)
     {
-        char buf[1024] = {0}; // Clear the buffer
-        fd = thermo_client_init(argv[1]);
-        if (fd < 0)
-        {
-            snprintf(buf, sizeof(buf), "Error reading data: %s\n", strerror(errno));
-            wprintw(output_win, "%s", buf);
-            wrefresh(output_win);
-            sleep(1);
-            continue; // Initialization failed
-        }
-        thermo_fd = fd;
-        while (running)
+        // Input is handled by the renderer as well, so that ncurses is only called from this thread
+        int ch = wgetch(input_win);
+        if (ch == '\n' || ch == KEY_ENTER)
         {
-            int result = thermo_client_read(fd, &data, &running);
-            if (result < 0)
+            input_buf[input_len] = '\0';
+            if (strcmp(input_buf, "/quit") == 0)
             {
-                snprintf(buf, sizeof(buf), "Error reading data: %s\n", strerror(errno));
+                running = 0;
                 break;
             }
-            else if (result == 0)
+            int fd = atomic_load(&thermo_fd);
+            if (fd >= 0 && input_len > 0)
             {
-                continue; // No data available or malformed data, continue reading
+                int w = write(fd, input_buf, input_len);
+                (void)w;
             }
-            else
+            input_len = 0;
+            reset_input();
+        }
+        else if ((ch == KEY_BACKSPACE || ch == 127 || ch == '\b') && input_len > 0)
+        {
+            input_len--;
+            mvwaddch(input_win, 1, 4 + input_len, ' ');
+            wmove(input_win, 1, 4 + input_len);
+            wnoutrefresh(input_win);
+        }
+        else if (ch != ERR && ch >= 0x20 && ch < 0x7f && input_len < INPUT_BUF_SIZE - 1)
+        {
+            input_buf[input_len] = ch;
+            mvwaddch(input_win, 1, 4 + input_len, ch);
+            input_len++;
+            wnoutrefresh(input_win);
+        }
+        if (now_ms() < next_frame)
+        {
+            doupdate();
+            continue;
+        }
+        next_frame += RENDER_PERIOD_MS;
+        if (next_frame < now_ms())
+        {
+            next_frame = now_ms() + RENDER_PERIOD_MS; // Fell behind, do not try to catch up
+        }
+        // Keep the latest value per sensor
+        sample_s sample;
+        while (ring_pop(&ring, &sample))
+        {
+            if (sample.err)
             {
-                snprintf(buf, sizeof(buf), "Received: Type: %c, Source: 0x%08x, Value: %.2f %c\n", data.type, data.source, data.value, data.type == 'T' ? 'C' : '%');
+                snprintf(status, sizeof(status), "Error reading data: %s", strerror(sample.err));
+                continue;
             }
-            wprintw(output_win, "%s", buf);
-            wrefresh(output_win);
+            snprintf(status, sizeof(status), "Receiving data");
+            thermo_table_update(table, &sample.data, sample.time_ns); // sensors past MAX_SENSORS are not shown
         }
+        render(table, status, heartbeat_ns);
+        wmove(input_win, 1, 4 + input_len);
+        wnoutrefresh(input_win);
+        doupdate();
     }
-end:
-    close(fd);
+    running = 0;
+    pthread_join(reader_thread, NULL);
+    endwin();
+    thermo_table_destroy(table);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,122 @@
+/**
+ * @file loadgen.c
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data load generator for PICTURE-D: Emits synthetic server streams on a pseudo-terminal.
+ * @version 0.0.1
+ * @date 2025-06-24
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include "thermo_loadgen.h"
+
+volatile sig_atomic_t running = 1;
+
+void sighandler(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-v 1|2] [-s sensors] [-H sensors] [-b burst] [-f bytes] [-c probability] [-r rate] [-n batches] [-S seed]\n"
+                    "  -v  Wire format version (default 1)\n"
+                    "  -s  Temperature sensors per batch (default 16)\n"
+                    "  -H  Humidity sensors per batch (default 0)\n"
+                    "  -b  Batches per write (default 1)\n"
+                    "  -f  Split writes into random fragments of at most this many bytes (default 0, no split)\n"
+                    "  -c  Probability that a frame has a corrupted byte (default 0)\n"
+                    "  -r  Writes per second (default 1, 0 for as fast as possible)\n"
+                    "  -n  Batches to write (default 0, until interrupted)\n"
+                    "  -S  Seed of the fragment sizes and corruption (default 1)\n"
+                    "The pseudo-terminal path is printed on stdout. Open it like a serial port, e.g. with thermo-client.\n",
+            name);
+}
+
+int main(int argc, char *argv[])
+{
+    thermo_loadgen_config_s config;
+    thermo_loadgen_defaults(&config);
+    config.rate_hz = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "v:s:H:b:f:c:r:n:S:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'v':
+            config.version = atoi(optarg);
+            break;
+        case 's':
+            config.sensors = atoi(optarg);
+            break;
+        case 'H':
+            config.humidity = atoi(optarg);
+            break;
+        case 'b':
+            config.burst = atoi(optarg);
+            break;
+        case 'f':
+            config.fragment = atoi(optarg);
+            break;
+        case 'c':
+            config.corrupt = strtod(optarg, NULL);
+            break;
+        case 'r':
+            config.rate_hz = strtod(optarg, NULL);
+            break;
+        case 'n':
+            config.batches = strtoull(optarg, NULL, 0);
+            break;
+        case 'S':
+            config.seed = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    thermo_loadgen_s *gen = thermo_loadgen_open(&config);
+    if (gen == NULL)
+    {
+        perror("Error creating load generator");
+        return 1;
+    }
+    signal(SIGINT, sighandler);
+    printf("%s\n", thermo_loadgen_path(gen));
+    fflush(stdout);
+    int res = thermo_loadgen_wait_peer(gen, &running);
+    if (res > 0)
+    {
+        // Give the reader time to set the port up, its initial flush would discard the first frames
+        struct timespec settle = {.tv_sec = 0, .tv_nsec = 100000000};
+        nanosleep(&settle, NULL);
+        res = thermo_loadgen_run(gen, &running);
+        if (res < 0)
+        {
+            perror("Error writing stream");
+        }
+        else
+        {
+            sleep(1); // Let the reader drain the pseudo-terminal before the hangup
+        }
+    }
+    thermo_loadgen_stats_s stats;
+    thermo_loadgen_get_stats(gen, &stats);
+    fprintf(stderr, "Batches: %llu, records: %llu, frames: %llu (corrupted: %llu), bytes: %llu in %llu writes\n",
+            (unsigned long long)stats.batches, (unsigned long long)stats.records,
+            (unsigned long long)stats.frames, (unsigned long long)stats.corrupted,
+            (unsigned long long)stats.bytes, (unsigned long long)stats.writes);
+    thermo_loadgen_close(gen);
+    return res < 0;
+}
@@ -2,50 +2,240 @@
 #include <unistd.h>
 #include <signal.h>
 #include "thermo_client.h"
+#include "thermo_log.h"
+#include "thermo_manifest.h"
+#include "thermo_reconnect.h"
+
+#define BATCH_SIZE 64 // Enough for every sensor in a server batch
 
 volatile sig_atomic_t running = 1;
 
+static void print_hist(FILE *out, const char *prefix, const thermo_hist_s *hist)
+{
+    fprintf(out, "%s: %s on 0x%08x: %u samples, mean %llu us, p50 <= %llu us, p99 <= %llu us, max %u us\n",
+            prefix, thermo_stage_name(hist->stage), hist->source, hist->count,
+            (unsigned long long)(hist->count > 0 ? hist->sum_us / hist->count : 0),
+            (unsigned long long)thermo_hist_quantile_us(hist, 0.5),
+            (unsigned long long)thermo_hist_quantile_us(hist, 0.99), hist->max_us);
+}
+
 void sighandler(int sig)
 {
     (void) sig;
     running = 0;
 }
 
+/**
+ * @brief Print the sensors of the manifest, in slot order, as the header of the dense vectors.
+ *
+ */
+static void print_manifest(const thermo_manifest_s *manifest)
+{
+    printf("Slots:");
+    for (size_t i = 0; i < thermo_manifest_size(manifest); i++)
+    {
+        const thermo_manifest_sensor_s *sensor = thermo_manifest_sensor(manifest, i);
+        printf(" %c:0x%08x%s%s", sensor->type, sensor->source, sensor->label[0] ? ":" : "", sensor->label);
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Print the value of every slot of a dense vector, the slots updated by the last read marked with a '*'.
+ *
+ */
+static void print_dense(const thermo_dense_s *dense)
+{
+    printf("Values:");
+    for (size_t i = 0; i < dense->count; i++)
+    {
+        printf(" %7.2f%c", dense->values[i], dense->updated[i] ? '*' : ' ');
+    }
+    printf("\n");
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-m manifest] <serial_port> [record_file]\n"
+                    "  -m  Only accept the sensors of the manifest, and print the value of every sensor on each read\n",
+            name);
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    const char *manifest_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            manifest_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 1 && argc - optind != 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *port = argv[optind];
+    const char *record_file = argc - optind == 2 ? argv[optind + 1] : NULL;
+    thermo_client_s *client = NULL;
+    thermal_data_ex_s data[BATCH_SIZE];
+    thermo_log_s *log = NULL;
+    thermo_manifest_s *manifest = NULL;
+    thermo_dense_s *dense = NULL;
+    if (manifest_path != NULL) // Validate against the manifest, and print one fixed-width vector per read
+    {
+        int line;
+        manifest = thermo_manifest_load(manifest_path, &line);
+        if (manifest == NULL)
+        {
+            if (line > 0)
+            {
+                fprintf(stderr, "Error loading manifest: %s:%d: malformed line\n", manifest_path, line);
+            }
+            else
+            {
+                perror("Error loading manifest");
+            }
+            return 1;
+        }
+        dense = record_file == NULL ? thermo_dense_create(manifest) : NULL; // the recorder stores the records
+        if (dense == NULL && record_file == NULL)
+        {
+            perror("Error creating dense vector");
+            thermo_manifest_destroy(manifest);
+            return 1;
+        }
+        print_manifest(manifest);
+    }
+    if (record_file != NULL) // Recorder mode: append records to the log instead of printing them
     {
-        fprintf(stderr, "Usage: %s <serial_port>\n", argv[0]);
+        log = thermo_log_open(record_file, 1);
+        if (log == NULL)
+        {
+            perror("Error opening record file");
+            thermo_dense_destroy(dense);
+            thermo_manifest_destroy(manifest);
+            return 1;
+        }
+        printf("Recording to %s (%llu records)\n", record_file, (unsigned long long)thermo_log_count(log));
+    }
+    thermo_reconnect_s *reconnect = thermo_reconnect_create(port);
+    if (reconnect == NULL)
+    {
+        perror("Error creating reconnect manager");
+        thermo_log_close(log);
+        thermo_dense_destroy(dense);
+        thermo_manifest_destroy(manifest);
         return 1;
     }
-    int fd = 0;
-    thermal_data_s data;
     signal(SIGINT, sighandler);
+    uint64_t diag_frames = 0;
     while (running)
     {
-        fd = thermo_client_init(argv[1]);
+        // Opens as soon as the port reappears, and keeps the decoder state across the reconnect
+        int fd = thermo_reconnect_open(reconnect, &running);
         if (fd < 0)
         {
-            sleep(1);
-            continue; // Initialization failed
+            break; // Stopped while waiting for the port
+        }
+        if (client == NULL)
+        {
+            client = thermo_client_create(fd);
+            if (client == NULL)
+            {
+                perror("Error creating client");
+                close(fd);
+                break;
+            }
+            if (manifest != NULL)
+            {
+                thermo_client_set_manifest(client, manifest);
+            }
+            printf("Preparing to read data...\n");
+        }
+        else if (thermo_client_reattach(client, fd) < 0)
+        {
+            perror("Error reattaching client");
+            close(fd);
+            break;
+        }
+        else
+        {
+            thermo_reconnect_stats_s reconnect_stats;
+            thermo_reconnect_get_stats(reconnect, &reconnect_stats);
+            fprintf(stderr, "Reconnected in %.1f ms\n", reconnect_stats.last_wait_ns / 1e6);
         }
-        printf("Preparing to read data...\n");
         while (running)
         {
-            int result = thermo_client_read(fd, &data, &running);
+            int result = dense != NULL ? thermo_client_read_dense(client, dense, -1, &running)
+                                       : thermo_client_read_many_ex(client, data, BATCH_SIZE, -1, &running);
             if (result < 0)
             {
                 perror("Error reading data");
                 break;
             }
-            else if (result == 0)
+            if (dense != NULL)
             {
-                continue; // No data available or malformed data, continue reading
+                print_dense(dense);
             }
-
-            printf("Received: Type: %c, Source: 0x%08x, Value: %.2f %c\n", data.type, data.source, data.value, data.type == 'T' ? 'C' : '%');
+            else if (log != NULL)
+            {
+                if (thermo_log_append(log, data, result) < 0)
+                {
+                    perror("Error recording data");
+                    running = 0;
+                }
+                continue;
+            }
+            else
+            {
+                for (int i = 0; i < result; i++)
+                {
+                    const thermal_data_s *d = &data[i].data;
+                    printf("Received: Type: %c, Source: 0x%08x, Value: %.2f %c\n", d->type, d->source, d->value, d->type == 'T' ? 'C' : '%');
+                }
+            }
+            thermo_client_stats_s stats;
+            thermo_client_get_stats(client, &stats);
+            if (stats.diag_frames != diag_frames) // new server histograms
+            {
+                thermo_hist_s hists[THERMO_CLIENT_DIAG_MAX];
+                int nhists = thermo_client_get_diag(client, hists, THERMO_CLIENT_DIAG_MAX);
+                for (int i = 0; i < nhists; i++)
+                {
+                    print_hist(stdout, "Server", &hists[i]);
+                }
+                diag_frames = stats.diag_frames;
+            }
+            fflush(stdout);
         }
+        thermo_client_stats_s stats;
+        thermo_client_get_stats(client, &stats);
+        fprintf(stderr, "Frames: %llu, lost: %llu (CRC errors: %llu), sequence gaps: %llu, resyncs: %llu, bytes skipped: %llu, unknown sensors: %llu\n",
+                (unsigned long long)stats.frames, (unsigned long long)stats.frames_lost,
+                (unsigned long long)stats.crc_errors, (unsigned long long)stats.seq_gaps,
+                (unsigned long long)stats.resyncs, (unsigned long long)stats.bytes_skipped,
+                (unsigned long long)stats.unknown);
+        thermo_hist_s latency[2];
+        thermo_client_get_latency(client, latency);
+        print_hist(stderr, "Client", &latency[0]);
+        print_hist(stderr, "Client", &latency[1]);
+    }
+    thermo_client_destroy(client);
+    thermo_reconnect_destroy(reconnect);
+    if (log != NULL)
+    {
+        printf("Recorded %llu records\n", (unsigned long long)thermo_log_count(log));
+        thermo_log_close(log);
     }
-    close(fd);
+    thermo_dense_destroy(dense);
+    thermo_manifest_destroy(manifest);
     return 0;
 }
\ No newline at end of file
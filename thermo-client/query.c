@@ -0,0 +1,184 @@
+/**
+ * @file query.c
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data query tool for PICTURE-D: Per-sensor statistics over recorded logs.
+ * @version 0.0.1
+ * @date 2025-06-18
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include "thermo_log.h"
+#include "thermo_query.h"
+#include "thermo_table.h"
+
+#define MAX_SENSORS 256 // Sensors reported per query
+
+typedef struct
+{
+    uint32_t source;
+    thermo_query_acc_s acc;
+} sensor_s;
+
+static sensor_s sensors[MAX_SENSORS];
+static int nsensors = 0;
+
+static sensor_s *sensor_get(uint32_t source)
+{
+    for (int i = 0; i < nsensors; i++)
+    {
+        if (sensors[i].source == source)
+        {
+            return &sensors[i];
+        }
+    }
+    if (nsensors == MAX_SENSORS)
+    {
+        return NULL;
+    }
+    sensors[nsensors].source = source;
+    return &sensors[nsensors++];
+}
+
+static int sensor_cmp(const void *a, const void *b)
+{
+    const sensor_s *sa = a, *sb = b;
+    return sa->source < sb->source ? -1 : (sa->source > sb->source);
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-t T|H] [-f from] [-u until] [-s source ...] <record_file>\n"
+                    "  -t  Record type, T (default) or H\n"
+                    "  -f  Start of the time window, seconds since the epoch\n"
+                    "  -u  End of the time window, seconds since the epoch\n"
+                    "  -s  Report only this source sensor ID, may be repeated\n",
+            name);
+}
+
+int main(int argc, char *argv[])
+{
+    char type = 'T';
+    int64_t start_ns = INT64_MIN, end_ns = INT64_MAX;
+    int filtered = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:f:u:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            type = optarg[0];
+            break;
+        case 'f':
+            start_ns = (int64_t)(strtod(optarg, NULL) * 1e9);
+            break;
+        case 'u':
+            end_ns = (int64_t)(strtod(optarg, NULL) * 1e9);
+            break;
+        case 's':
+            if (sensor_get((uint32_t)strtoul(optarg, NULL, 0)) == NULL)
+            {
+                fprintf(stderr, "Too many sensors, at most %d\n", MAX_SENSORS);
+                return 1;
+            }
+            filtered = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1 || (type != 'T' && type != 'H'))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    thermo_log_s *log = thermo_log_open(argv[optind], 0);
+    if (log == NULL)
+    {
+        perror("Error opening record file");
+        return 1;
+    }
+    thermo_columns_s columns;
+    if (thermo_columns_init(&columns, THERMO_LOG_SEGMENT_RECORDS) < 0)
+    {
+        perror("Error allocating columns");
+        thermo_log_close(log);
+        return 1;
+    }
+    thermo_table_s *found = filtered ? NULL : thermo_table_create(MAX_SENSORS);
+    if (!filtered && found == NULL)
+    {
+        perror("Error creating sensor table");
+        thermo_columns_free(&columns);
+        thermo_log_close(log);
+        return 1;
+    }
+    int64_t start = now_ns();
+    uint64_t rows = 0;
+    int ret = 0;
+    for (uint32_t seg = thermo_log_find_segment(log, start_ns); seg < thermo_log_segments(log); seg++)
+    {
+        if (thermo_log_segment_start(log, seg) >= end_ns)
+        {
+            break;
+        }
+        if (thermo_columns_load(&columns, log, seg, type, start_ns, end_ns) < 0)
+        {
+            if (errno == ERANGE) // past the last committed record
+            {
+                break;
+            }
+            perror("Error reading record file");
+            ret = 1;
+            break;
+        }
+        rows += columns.count;
+        if (!filtered) // Discover the sensors in this segment
+        {
+            for (size_t i = 0; i < columns.count; i++)
+            {
+                thermal_data_s data = {.type = type, .source = columns.source[i], .value = columns.value[i]};
+                thermo_table_update(found, &data, (uint64_t)columns.time_ns[i]); // ENOSPC: report the first MAX_SENSORS
+            }
+            thermo_sensor_s snapshot[MAX_SENSORS];
+            size_t count = thermo_table_snapshot(found, snapshot, MAX_SENSORS);
+            for (size_t i = 0; i < count; i++)
+            {
+                sensor_get(snapshot[i].source);
+            }
+        }
+        for (int i = 0; i < nsensors; i++)
+        {
+            thermo_query_reduce(&columns, sensors[i].source, &sensors[i].acc);
+        }
+    }
+    double elapsed = (now_ns() - start) * 1e-9;
+    qsort(sensors, nsensors, sizeof(sensor_s), sensor_cmp);
+    printf("%-10s %10s %10s %10s %10s %10s\n", "Source", "Count", "Min", "Max", "Mean", "Stddev");
+    for (int i = 0; i < nsensors; i++)
+    {
+        thermo_query_stats_s stats;
+        thermo_query_stats(&sensors[i].acc, &stats);
+        printf("0x%08x %10llu %10.3f %10.3f %10.3f %10.3f\n", sensors[i].source, (unsigned long long)stats.count,
+               stats.min, stats.max, stats.mean, stats.stddev);
+    }
+    fprintf(stderr, "%llu records of type %c in %.3f s\n", (unsigned long long)rows, type, elapsed);
+    thermo_table_destroy(found);
+    thermo_columns_free(&columns);
+    thermo_log_close(log);
+    return ret;
+}
@@ -18,11 +18,47 @@
 #include <termios.h>
 #include <signal.h>
 #include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 #include "thermo_client.h"
+#include "thermo_manifest.h"
+
+int thermo_client_init_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
 
 int thermo_client_init(const char *port)
 {
+    struct stat st;
+    if (stat(port, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        return thermo_client_init_socket(port); // the server socket carries the same stream as the serial port
+    }
     int fd = open(port, O_RDWR);
     if (fd == -1)
     {
@@ -35,25 +71,7 @@ int thermo_client_init(const char *port)
         close(fd);
         return -1;
     }
-    cfsetospeed(&options, B115200); // Set output baud rate
-    cfsetispeed(&options, B115200); // Set input baud rate
-
-    options.c_cflag &= ~PARENB; // No parity
-    options.c_cflag &= ~CSTOPB; // One stop bit
-    options.c_cflag &= ~CSIZE;
-    options.c_cflag |= CS8;            // 8 data bits
-    options.c_cflag |= CREAD | CLOCAL; // Enable receiver, ignore modem control lines
-
-    options.c_lflag &= ~ICANON; // Set raw mode
-    options.c_lflag &= ~(ECHO | ECHOE | ISIG);
-
-    options.c_iflag &= ~(IXON | IXOFF | IXANY); // Disable flow control
-    options.c_iflag &= ~(ICRNL | INLCR | IGNCR);
-
-    options.c_oflag &= ~OPOST; // Disable output processing
-
-    options.c_cc[VMIN] = 0;
-    options.c_cc[VTIME] = 1; // Set timeout to 100 milliseconds (1 deciseconds)
+    thermo_client_termios(&options);
     tcflush(fd, TCIFLUSH);
     if (tcsetattr(fd, TCSANOW, &options) < 0)
     {
@@ -64,85 +82,907 @@ int thermo_client_init(const char *port)
     return fd;
 }
 
-int thermo_client_read(int fd, thermal_data_s *data, volatile sig_atomic_t *running)
+void thermo_client_termios(struct termios *options)
+{
+    cfsetospeed(options, B115200); // Set output baud rate
+    cfsetispeed(options, B115200); // Set input baud rate
+
+    options->c_cflag &= ~PARENB; // No parity
+    options->c_cflag &= ~CSTOPB; // One stop bit
+    options->c_cflag &= ~CSIZE;
+    options->c_cflag |= CS8;            // 8 data bits
+    options->c_cflag |= CREAD | CLOCAL; // Enable receiver, ignore modem control lines
+
+    options->c_lflag &= ~ICANON; // Set raw mode
+    options->c_lflag &= ~(ECHO | ECHOE | ISIG);
+
+    options->c_iflag &= ~(IXON | IXOFF | IXANY); // Disable flow control
+    options->c_iflag &= ~(ICRNL | INLCR | IGNCR);
+
+    options->c_oflag &= ~OPOST; // Disable output processing
+
+    options->c_cc[VMIN] = 0;
+    options->c_cc[VTIME] = 1; // Set timeout to 100 milliseconds (1 deciseconds)
+}
+
+// A v1 frame is of the format: CHRIS,[T|H],uint32_t float (5 + 1 + 1 + 1 + 4 + 4 = 16 bytes)
+// A v2 frame is of the format: CHRIS 0x02 [T|H] uint8_t count, uint16_t seq, uint32_t timestamp, count x (uint32_t float), uint32_t crc
+// A v2 diagnostics frame has the type D, and count x (uint32_t source, uint8_t stage, uint8_t nbuckets, uint16_t reserved,
+// uint32_t count, uint32_t max, uint64_t sum, 24 x uint32_t buckets) instead of the records
+#define THERMO_FRAME_MAGIC "CHRIS"
+#define THERMO_FRAME_MAGIC_LEN (sizeof(THERMO_FRAME_MAGIC) - 1) // Exclude null terminator
+#define THERMO_FRAME_LEN (THERMO_FRAME_MAGIC_LEN + 1 + 1 + 1 + sizeof(uint32_t) + sizeof(float))
+#define THERMO_V2_VERSION 2
+#define THERMO_V2_HEADER_LEN (THERMO_FRAME_MAGIC_LEN + 1 + 1 + 1 + sizeof(uint16_t) + sizeof(uint32_t))
+#define THERMO_V2_RECORD_LEN (sizeof(uint32_t) + sizeof(float))
+#define THERMO_V2_CRC_LEN sizeof(uint32_t)
+#define THERMO_V2_DIAG_TYPE 'D'
+#define THERMO_V2_DIAG_RECORD_LEN (24 + THERMO_HIST_BUCKETS * sizeof(uint32_t))
+#define THERMO_RX_MARKS 32 // Reads whose receive time is remembered
+
+typedef struct
+{
+    size_t end;       // Index one past the last byte delivered by the read
+    uint64_t time_ns; // CLOCK_MONOTONIC time right after the read
+} thermo_rx_mark_s;
+
+typedef enum
+{
+    THERMO_DECODE_MAGIC = 0,  // Matching the "CHRIS" magic
+    THERMO_DECODE_VERSION,    // Expecting ',' for a v1 frame, or the version byte of a v2 frame
+    THERMO_DECODE_TYPE,       // Expecting the type byte of a v1 frame
+    THERMO_DECODE_SEPARATOR,  // Expecting the comma after the type byte of a v1 frame
+    THERMO_DECODE_PAYLOAD,    // Waiting for the source and value bytes of a v1 frame
+    THERMO_DECODE_V2_HEADER,  // Waiting for the rest of the v2 header
+    THERMO_DECODE_V2_BODY,    // Waiting for the records and CRC of a v2 frame
+    THERMO_DECODE_V2_RECORDS, // Handing out the records of a validated v2 frame
+} thermo_decode_state_e;
+
+struct _thermo_client_s
+{
+    int fd;                      // Serial port file descriptor
+    int nonblocking;             // Set if the file descriptor is in non-blocking mode
+    thermo_decode_state_e state; // Decoder state, kept across reads
+    int synced;                  // Set once a frame has been decoded, cleared when bytes have to be skipped
+    size_t head;                 // Index of the first unconsumed byte (start of the candidate frame) in the buffer
+    size_t matched;              // Number of bytes of the candidate frame that have been validated
+    size_t tail;                 // Index one past the last valid byte in the buffer
+    size_t seam;                 // Index of the first byte read from a reattached port, while older bytes are pending. 0 otherwise
+    size_t frame_len;            // Length of the current v2 frame
+    unsigned record;             // Next record to hand out from the current v2 frame
+    int have_seq;                // Set once a v2 frame has been received
+    uint16_t seq;                // Sequence number of the last v2 frame
+    int pinned;                  // Set while views handed out by the iterator are outstanding
+    uint64_t frame_rx_ns;        // Receive time of the current v2 frame
+    size_t nmarks;               // Number of valid receive time marks
+    thermo_rx_mark_s marks[THERMO_RX_MARKS]; // Receive time of the buffered bytes, oldest first
+    thermo_client_stats_s stats; // Decoder counters
+    const thermo_manifest_s *manifest; // Sensors accepted, NULL to accept every sensor
+    size_t hint;                 // Slot expected for the next record: the one after the previous record
+    uint64_t last_rx_ns;         // Receive time of the previous frame
+    thermo_hist_s latency[2];    // Client histograms: decode latency, inter-frame gap
+    int ndiag;                   // Number of valid server histograms
+    thermo_hist_s diag[THERMO_CLIENT_DIAG_MAX]; // Latest server histograms
+    uint8_t buf[THERMO_CLIENT_BUFFER_SIZE];
+};
+
+thermo_client_s *thermo_client_create(int fd)
+{
+    if (fd < 0)
+    {
+        errno = EBADF;
+        return NULL;
+    }
+    thermo_client_s *client = calloc(1, sizeof(thermo_client_s));
+    if (client == NULL)
+    {
+        return NULL;
+    }
+    client->fd = fd;
+    client->latency[0].stage = THERMO_STAGE_DECODE;
+    client->latency[1].stage = THERMO_STAGE_FRAME_GAP;
+    int flags = fcntl(fd, F_GETFL);
+    client->nonblocking = flags >= 0 && (flags & O_NONBLOCK);
+    return client;
+}
+
+void thermo_client_destroy(thermo_client_s *client)
+{
+    if (client == NULL)
+    {
+        return;
+    }
+    if (client->fd >= 0)
+    {
+        close(client->fd);
+    }
+    free(client);
+}
+
+int thermo_client_fd(const thermo_client_s *client)
 {
-    if (fd < 0 || data == NULL)
+    return client->fd;
+}
+
+int thermo_client_reattach(thermo_client_s *client, int fd)
+{
+    if (fd < 0)
     {
-        fprintf(stderr, "Invalid file descriptor or data pointer\n");
+        errno = EBADF;
         return -1;
     }
-    static char pattern[] = "CHRIS,";
-    static int pattern_length = sizeof(pattern) / sizeof(pattern[0]) - 1; // Exclude null terminator
-    char check;
-    // We are looking for a data of the format: CHRIS,[T|H],uint32_t float (6 + 1 + 1 + 4 + 4 = 16 bytes)
-    ssize_t bytes_read = 0;
-    int index = 0;
-    struct pollfd pfd;
-    pfd.fd = fd;
-    pfd.events = POLLIN | POLLERR | POLLHUP; // Monitor for input, errors, and hangups
-    volatile sig_atomic_t run = 1;
-    if (!running) // take care of the null case
+    if (client->nonblocking)
     {
-        running = &run;
+        int flags = fcntl(fd, F_GETFL);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        {
+            return -1;
+        }
     }
-    while (running)
+    if (client->fd >= 0 && client->fd != fd)
     {
-        // Use poll to wait for data or timeout
-        int poll_result = poll(&pfd, 1, 100); // Wait for 100 milliseconds
-        if (poll_result < 0)
+        close(client->fd);
+    }
+    client->fd = fd;
+    client->seam = client->tail > client->head ? client->tail : 0;
+    return 0;
+}
+
+void thermo_client_get_stats(const thermo_client_s *client, thermo_client_stats_s *stats)
+{
+    *stats = client->stats;
+}
+
+const char *thermo_stage_name(uint8_t stage)
+{
+    switch (stage)
+    {
+    case THERMO_STAGE_BUS_RESET:
+        return "bus reset";
+    case THERMO_STAGE_CONVERSION_WAIT:
+        return "conversion wait";
+    case THERMO_STAGE_SCRATCHPAD_READ:
+        return "scratchpad read";
+    case THERMO_STAGE_QUEUE_DELAY:
+        return "queue delay";
+    case THERMO_STAGE_SERIAL_WRITE:
+        return "serial write";
+    case THERMO_STAGE_SERIAL_FLUSH:
+        return "serial flush";
+    case THERMO_STAGE_HUMIDITY_READ:
+        return "humidity read";
+    case THERMO_STAGE_DECODE:
+        return "decode";
+    case THERMO_STAGE_FRAME_GAP:
+        return "frame gap";
+    default:
+        return "unknown";
+    }
+}
+
+int thermo_client_get_diag(const thermo_client_s *client, thermo_hist_s *hists, int count)
+{
+    int n = count < client->ndiag ? count : client->ndiag;
+    if (n > 0)
+    {
+        memcpy(hists, client->diag, n * sizeof(thermo_hist_s));
+    }
+    return n;
+}
+
+void thermo_client_get_latency(const thermo_client_s *client, thermo_hist_s *hists)
+{
+    memcpy(hists, client->latency, sizeof(client->latency));
+}
+
+/**
+ * @brief Add a sample, in ns, to a client histogram.
+ *
+ */
+static void thermo_hist_record(thermo_hist_s *hist, uint64_t ns)
+{
+    uint64_t us = ns / 1000;
+    uint32_t sample = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+    int bucket = 0;
+    while ((sample >> (bucket + 1)) != 0 && bucket < THERMO_HIST_BUCKETS - 1)
+    {
+        bucket++;
+    }
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->sum_us += sample;
+    if (sample > hist->max_us)
+    {
+        hist->max_us = sample;
+    }
+}
+
+/**
+ * @brief Record the receive time of a complete frame in the inter-frame gap histogram.
+ *
+ */
+static void thermo_client_frame_received(thermo_client_s *client, uint64_t rx_ns)
+{
+    if (client->last_rx_ns != 0 && rx_ns >= client->last_rx_ns)
+    {
+        thermo_hist_record(&client->latency[1], rx_ns - client->last_rx_ns);
+    }
+    client->last_rx_ns = rx_ns;
+}
+
+/**
+ * @brief Get the CLOCK_MONOTONIC time, in ns.
+ *
+ */
+static uint64_t thermo_client_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief Record the decode latency of a record handed out at `now_ns`: from the read() that completed it.
+ *
+ */
+static void thermo_client_record_handed(thermo_client_s *client, uint64_t rx_ns, uint64_t now_ns)
+{
+    thermo_hist_record(&client->latency[0], now_ns > rx_ns ? now_ns - rx_ns : 0);
+}
+
+/**
+ * @brief Read as many bytes as are available from the serial port into the receive buffer.
+ *
+ * Unconsumed bytes are moved to the start of the buffer first, so that a frame is always contiguous.
+ *
+ * @return ssize_t Number of bytes read, 0 if the buffer is full, -1 on error.
+ */
+static ssize_t thermo_client_fill(thermo_client_s *client)
+{
+    if (client->head > 0 && !client->pinned) // Views handed out by the iterator point into the buffer
+    {
+        memmove(client->buf, client->buf + client->head, client->tail - client->head);
+        size_t kept = 0;
+        for (size_t i = 0; i < client->nmarks; i++)
         {
-            return -1; // Error occurred during polling
+            if (client->marks[i].end > client->head) // still covers unconsumed bytes
+            {
+                client->marks[kept].end = client->marks[i].end - client->head;
+                client->marks[kept++].time_ns = client->marks[i].time_ns;
+            }
         }
-        else if (poll_result == 0)
+        client->nmarks = kept;
+        client->seam = client->seam > client->head ? client->seam - client->head : 0;
+        client->tail -= client->head;
+        client->head = 0;
+    }
+    if (client->tail == sizeof(client->buf))
+    {
+        return 0; // Decoded records have to be drained first
+    }
+    ssize_t bytes_read = read(client->fd, client->buf + client->tail, sizeof(client->buf) - client->tail);
+    if (bytes_read > 0)
+    {
+        // Take the receive time right after the read, before any decoding
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        client->tail += bytes_read;
+        client->stats.bytes += bytes_read;
+        if (client->nmarks == THERMO_RX_MARKS) // the oldest bytes are attributed to the next read
         {
-            // Timeout occurred, continue to check for data
-            continue;
+            memmove(client->marks, client->marks + 1, (THERMO_RX_MARKS - 1) * sizeof(thermo_rx_mark_s));
+            client->nmarks--;
         }
-        if (pfd.revents & (POLLERR | POLLHUP))
+        client->marks[client->nmarks].end = client->tail;
+        client->marks[client->nmarks++].time_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    }
+    return bytes_read;
+}
+
+/**
+ * @brief Get the receive time of the read that delivered the byte before index `end` of the buffer.
+ *
+ */
+static uint64_t thermo_client_rx_time(const thermo_client_s *client, size_t end)
+{
+    for (size_t i = 0; i < client->nmarks; i++)
+    {
+        if (client->marks[i].end >= end)
         {
-            // An error or hangup occurred, return -1
-            return -1;
+            return client->marks[i].time_ns;
         }
-        bytes_read = read(fd, &check, sizeof(check));
-        if (bytes_read < 0)
+    }
+    return client->nmarks > 0 ? client->marks[client->nmarks - 1].time_ns : 0;
+}
+
+/**
+ * @brief Drop the first byte of the candidate frame, and skip ahead to the next possible magic.
+ *
+ * Bytes of the candidate frame after the first one are examined again, since a frame may start inside a malformed one.
+ */
+static void thermo_client_resync(thermo_client_s *client)
+{
+    if (client->synced)
+    {
+        client->synced = 0;
+        client->stats.resyncs++;
+    }
+    client->state = THERMO_DECODE_MAGIC;
+    client->matched = 0;
+    client->head++;
+    uint8_t *start = client->buf + client->head;
+    uint8_t *magic = memchr(start, THERMO_FRAME_MAGIC[0], client->tail - client->head);
+    size_t skip = magic == NULL ? client->tail - client->head : (size_t)(magic - start);
+    client->head += skip;
+    client->stats.bytes_skipped += skip + 1;
+}
+
+/**
+ * @brief CRC32 (IEEE 802.3, as computed by crc32fast on the server), using a nibble table.
+ *
+ */
+uint32_t thermo_crc32(const uint8_t *data, size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Check if the candidate frame of `len` bytes was completed with bytes from a reattached port.
+ *
+ * Such a frame is made of the start of a frame cut off by the lost port, and of unrelated bytes.
+ */
+static int thermo_client_straddles(thermo_client_s *client, size_t len)
+{
+    if (client->seam <= client->head)
+    {
+        client->seam = 0;
+        return 0;
+    }
+    return client->seam < client->head + len;
+}
+
+/**
+ * @brief Find the slot of the sensor of a record in the manifest.
+ *
+ * @return int 1 if the sensor is listed, or if there is no manifest, 0 otherwise.
+ */
+static int thermo_client_slot(thermo_client_s *client, thermo_record_view_s *view)
+{
+    view->slot = -1;
+    if (client->manifest == NULL)
+    {
+        return 1;
+    }
+    view->slot = thermo_manifest_find(client->manifest, view->type, thermo_record_source(view), client->hint);
+    if (view->slot < 0)
+    {
+        client->stats.unknown++;
+        return 0;
+    }
+    client->hint = view->slot + 1;
+    return 1;
+}
+
+/**
+ * @brief Hand out the next record of a validated v2 frame, straight from the receive buffer.
+ *
+ * Records of sensors that are not in the manifest are skipped.
+ *
+ * @return int 1 if a record was handed out, 0 if the frame had no more records.
+ */
+static int thermo_client_v2_record(thermo_client_s *client, thermo_record_view_s *view)
+{
+    const uint8_t *frame = client->buf + client->head;
+    int found = 0;
+    while (!found && client->state == THERMO_DECODE_V2_RECORDS)
+    {
+        view->type = frame[THERMO_FRAME_MAGIC_LEN + 1];
+        view->record = frame + THERMO_V2_HEADER_LEN + client->record * THERMO_V2_RECORD_LEN;
+        found = thermo_client_slot(client, view);
+        if (++client->record == frame[THERMO_FRAME_MAGIC_LEN + 2]) // all records handed out
         {
-            return bytes_read; // Error reading from the file descriptor
+            client->head += client->frame_len;
+            client->matched = 0;
+            client->state = THERMO_DECODE_MAGIC;
         }
-        else if (bytes_read == 0)
+    }
+    if (!found)
+    {
+        return 0;
+    }
+    view->version = THERMO_V2_VERSION;
+    view->seq = client->seq;
+    memcpy(&(view->tx_time_ms), frame + THERMO_FRAME_MAGIC_LEN + 5, sizeof(view->tx_time_ms));
+    view->rx_time_ns = client->frame_rx_ns;
+    client->stats.frames++;
+    return 1;
+}
+
+/**
+ * @brief Validate a complete v2 frame, and track its sequence number.
+ *
+ * @return int 1 if the frame is valid, 0 otherwise.
+ */
+static int thermo_client_v2_validate(thermo_client_s *client)
+{
+    const uint8_t *frame = client->buf + client->head;
+    uint32_t crc;
+    memcpy(&crc, frame + client->frame_len - THERMO_V2_CRC_LEN, sizeof(crc));
+    if (thermo_crc32(frame, client->frame_len - THERMO_V2_CRC_LEN) != crc)
+    {
+        client->stats.crc_errors++;
+        return 0;
+    }
+    uint16_t seq;
+    memcpy(&seq, frame + THERMO_FRAME_MAGIC_LEN + 3, sizeof(seq));
+    if (client->have_seq && seq != (uint16_t)(client->seq + 1))
+    {
+        client->stats.seq_gaps += (uint16_t)(seq - client->seq - 1);
+    }
+    client->have_seq = 1;
+    client->seq = seq;
+    client->frame_rx_ns = thermo_client_rx_time(client, client->head + client->frame_len);
+    thermo_client_frame_received(client, client->frame_rx_ns);
+    client->stats.batches++;
+    return 1;
+}
+
+/**
+ * @brief Store the histograms of a validated v2 diagnostics frame, replacing the previous ones of the same stage and source.
+ *
+ */
+static void thermo_client_v2_diag(thermo_client_s *client)
+{
+    const uint8_t *frame = client->buf + client->head;
+    uint32_t tx_time_ms;
+    memcpy(&tx_time_ms, frame + THERMO_FRAME_MAGIC_LEN + 5, sizeof(tx_time_ms));
+    for (unsigned i = 0; i < frame[THERMO_FRAME_MAGIC_LEN + 2]; i++)
+    {
+        const uint8_t *rec = frame + THERMO_V2_HEADER_LEN + i * THERMO_V2_DIAG_RECORD_LEN;
+        thermo_hist_s hist;
+        memset(&hist, 0, sizeof(hist));
+        memcpy(&hist.source, rec, sizeof(hist.source));
+        hist.stage = rec[4];
+        memcpy(&hist.count, rec + 8, sizeof(hist.count));
+        memcpy(&hist.max_us, rec + 12, sizeof(hist.max_us));
+        memcpy(&hist.sum_us, rec + 16, sizeof(hist.sum_us));
+        unsigned nbuckets = rec[5] < THERMO_HIST_BUCKETS ? rec[5] : THERMO_HIST_BUCKETS;
+        memcpy(hist.buckets, rec + 24, nbuckets * sizeof(uint32_t));
+        hist.tx_time_ms = tx_time_ms;
+        int slot = 0;
+        while (slot < client->ndiag && (client->diag[slot].source != hist.source || client->diag[slot].stage != hist.stage))
         {
-            continue;
+            slot++;
         }
-        // printf("Received: %c", check);
-        if (check == pattern[index]) // is it the start of a valid message?
+        if (slot == THERMO_CLIENT_DIAG_MAX)
         {
-            index++;
+            continue; // no room for a new histogram
         }
-        else
+        if (slot == client->ndiag)
         {
-            index = 0; // Reset index if the character does not match
+            client->ndiag++;
         }
-        if (index == pattern_length) // If we have matched the entire pattern
+        client->diag[slot] = hist;
+    }
+    client->stats.diag_frames++;
+}
+
+/**
+ * @brief Find the next complete record in the receive buffer.
+ *
+ * The decoder is an incremental state machine: the position within a partially received frame is kept
+ * in the client context, so the bytes of that frame are not examined again when the rest arrives.
+ * On a malformed frame, the decoder resynchronizes on the next magic. Both v1 frames (one record each)
+ * and v2 frames (a batch of records with a CRC) are decoded. The record is not copied: the view points
+ * into the receive buffer, and stays valid until the buffer is compacted by the next read.
+ *
+ * @return int 1 if a record was found, 0 if more data is needed.
+ */
+static int thermo_client_scan(thermo_client_s *client, thermo_record_view_s *view)
+{
+    if (client->state == THERMO_DECODE_V2_RECORDS && thermo_client_v2_record(client, view))
+    {
+        return 1;
+    }
+    while (client->head + client->matched < client->tail)
+    {
+        uint8_t byte = client->buf[client->head + client->matched];
+        switch (client->state)
         {
-            // Read the next 11 bytes for type, source, and value
-            uint8_t buffer[sizeof(data->type) + 1 + sizeof(data->source) + sizeof(data->value)]; // 1 byte for type, 1 byte for comma, 4 bytes for source, 4 bytes for value
+        case THERMO_DECODE_MAGIC:
+            if (byte != THERMO_FRAME_MAGIC[client->matched])
+            {
+                thermo_client_resync(client);
+                break;
+            }
+            if (++client->matched == THERMO_FRAME_MAGIC_LEN)
+            {
+                client->state = THERMO_DECODE_VERSION;
+            }
+            break;
+        case THERMO_DECODE_VERSION:
+            if (byte != ',' && byte != THERMO_V2_VERSION)
+            {
+                thermo_client_resync(client);
+                break;
+            }
+            client->matched++;
+            client->state = byte == ',' ? THERMO_DECODE_TYPE : THERMO_DECODE_V2_HEADER;
+            break;
+        case THERMO_DECODE_TYPE:
+            if (byte != 'T' && byte != 'H')
+            {
+                client->stats.frames_lost++;
+                thermo_client_resync(client);
+                break;
+            }
+            client->matched++;
+            client->state = THERMO_DECODE_SEPARATOR;
+            break;
+        case THERMO_DECODE_SEPARATOR:
+            if (byte != ',')
+            {
+                client->stats.frames_lost++;
+                thermo_client_resync(client);
+                break;
+            }
+            client->matched++;
+            client->state = THERMO_DECODE_PAYLOAD;
+            break;
+        case THERMO_DECODE_PAYLOAD:
+            if (client->tail - client->head < THERMO_FRAME_LEN)
+            {
+                client->matched = client->tail - client->head;
+                return 0; // wait for the rest of the frame
+            }
+            // Now we have a complete message
+            uint8_t *payload = client->buf + client->head + THERMO_FRAME_MAGIC_LEN + 1;
+            view->type = payload[0];    // First byte is type
+            view->record = payload + 2; // Next byte is comma, then 4 bytes for source and 4 bytes for value
+            if (thermo_client_straddles(client, THERMO_FRAME_LEN))
+            {
+                client->stats.frames_lost++;
+                thermo_client_resync(client);
+                break;
+            }
+            if (!thermo_client_slot(client, view))
+            {
+                client->stats.frames_lost++; // most likely a corrupted source ID
+                thermo_client_resync(client);
+                break;
+            }
+            view->version = 1;
+            view->seq = 0;
+            view->tx_time_ms = 0;
+            view->rx_time_ns = thermo_client_rx_time(client, client->head + THERMO_FRAME_LEN);
+            thermo_client_frame_received(client, view->rx_time_ns);
+            client->head += THERMO_FRAME_LEN;
+            client->matched = 0;
+            client->state = THERMO_DECODE_MAGIC;
+            client->synced = 1;
+            client->stats.frames++;
+            return 1;
+        case THERMO_DECODE_V2_HEADER:
+            if (client->tail - client->head < THERMO_V2_HEADER_LEN)
+            {
+                client->matched = client->tail - client->head;
+                return 0; // wait for the rest of the header
+            }
+            {
+                const uint8_t *header = client->buf + client->head + THERMO_FRAME_MAGIC_LEN + 1;
+                size_t record_len = header[0] == THERMO_V2_DIAG_TYPE ? THERMO_V2_DIAG_RECORD_LEN : THERMO_V2_RECORD_LEN;
+                client->frame_len = THERMO_V2_HEADER_LEN + header[1] * record_len + THERMO_V2_CRC_LEN;
+                if ((header[0] != 'T' && header[0] != 'H' && header[0] != THERMO_V2_DIAG_TYPE) || header[1] == 0 || client->frame_len > sizeof(client->buf) ||
+                    (client->manifest != NULL && header[0] != THERMO_V2_DIAG_TYPE && header[1] > thermo_manifest_count(client->manifest, header[0])))
+                {
+                    client->stats.frames_lost++;
+                    thermo_client_resync(client);
+                    break;
+                }
+            }
+            client->matched = THERMO_V2_HEADER_LEN;
+            client->state = THERMO_DECODE_V2_BODY;
+            break;
+        case THERMO_DECODE_V2_BODY:
+            if (client->tail - client->head < client->frame_len)
+            {
+                client->matched = client->tail - client->head;
+                return 0; // wait for the rest of the frame
+            }
+            if (thermo_client_straddles(client, client->frame_len) || !thermo_client_v2_validate(client))
+            {
+                client->stats.frames_lost++;
+                thermo_client_resync(client);
+                break;
+            }
+            client->synced = 1;
+            if (client->buf[client->head + THERMO_FRAME_MAGIC_LEN + 1] == THERMO_V2_DIAG_TYPE)
+            {
+                thermo_client_v2_diag(client); // no records to hand out
+                client->head += client->frame_len;
+                client->matched = 0;
+                client->state = THERMO_DECODE_MAGIC;
+                break;
+            }
+            client->matched = client->frame_len;
+            client->record = 0;
+            client->state = THERMO_DECODE_V2_RECORDS;
+            if (thermo_client_v2_record(client, view))
+            {
+                return 1;
+            }
+            break;
+        case THERMO_DECODE_V2_RECORDS: // handled above
+            break;
+        }
+    }
+    return 0;
+}
 
-            bytes_read = read(fd, buffer, sizeof(buffer));
-            if (bytes_read < 0)
+int thermo_client_set_nonblocking(thermo_client_s *client, int enable)
+{
+    int flags = fcntl(client->fd, F_GETFL);
+    if (flags < 0)
+    {
+        return -1;
+    }
+    flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    if (fcntl(client->fd, F_SETFL, flags) < 0)
+    {
+        return -1;
+    }
+    client->nonblocking = enable ? 1 : 0;
+    return 0;
+}
+
+ssize_t thermo_client_feed(thermo_client_s *client)
+{
+    ssize_t total = 0;
+    while (1)
+    {
+        ssize_t bytes_read = thermo_client_fill(client);
+        if (bytes_read < 0)
+        {
+            if (errno == EINTR)
             {
-                return -1; // Error or no data
+                continue;
             }
-            else if (bytes_read < (ssize_t)sizeof(buffer) || buffer[1] != ',') // Check if we have enough data and the second byte is a comma
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
             {
-                return 0; // Incomplete data
+                break; // Nothing more to read
             }
-            // Now we have a complete message, parse it
-            data->type = buffer[0];                                    // First byte is type
-            memcpy(&(data->source), buffer + 2, sizeof(data->source)); // Next byte is comma, then 4 bytes for source
-            memcpy(&(data->value), buffer + 6, sizeof(data->value));   // Last 4 bytes for value
+            // Hand over what was read, the error will be reported on the next call
+            return total > 0 ? total : -1;
+        }
+        total += bytes_read;
+        if (bytes_read == 0 || !client->nonblocking)
+        {
+            break; // Buffer full, no data, or a single read in blocking mode
+        }
+    }
+    return total;
+}
 
-            break; // Exit the loop after reading a complete message
+int thermo_client_drain(thermo_client_s *client, thermal_data_s *data, int count)
+{
+    int found = 0;
+    uint64_t now_ns = 0;
+    thermo_record_view_s view;
+    while (found < count && thermo_client_scan(client, &view))
+    {
+        if (found == 0) // one clock read per drain
+        {
+            now_ns = thermo_client_now_ns();
         }
+        thermo_client_record_handed(client, view.rx_time_ns, now_ns);
+        data[found].type = view.type;
+        data[found].source = thermo_record_source(&view);
+        data[found].value = thermo_record_value(&view);
+        found++;
     }
+    return found;
+}
 
-    return 1; // Success
-}
\ No newline at end of file
+int thermo_client_drain_ex(thermo_client_s *client, thermal_data_ex_s *data, int count)
+{
+    int found = 0;
+    uint64_t now_ns = 0;
+    thermo_record_view_s view;
+    while (found < count && thermo_client_scan(client, &view))
+    {
+        if (found == 0) // one clock read per drain
+        {
+            now_ns = thermo_client_now_ns();
+        }
+        thermo_client_record_handed(client, view.rx_time_ns, now_ns);
+        thermal_data_ex_s *rec = &data[found++];
+        rec->data.type = view.type;
+        rec->data.source = thermo_record_source(&view);
+        rec->data.value = thermo_record_value(&view);
+        rec->rx_time_ns = view.rx_time_ns;
+        rec->tx_time_ms = view.tx_time_ms;
+        rec->seq = view.seq;
+        rec->version = view.version;
+    }
+    return found;
+}
+
+void thermo_client_set_manifest(thermo_client_s *client, const thermo_manifest_s *manifest)
+{
+    client->manifest = manifest;
+    client->hint = 0;
+}
+
+int thermo_client_drain_dense(thermo_client_s *client, thermo_dense_s *dense)
+{
+    if (client->manifest == NULL || dense->count != thermo_manifest_size(client->manifest))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(dense->updated, 0, dense->count);
+    dense->nupdated = 0;
+    int found = 0;
+    uint64_t now_ns = 0;
+    thermo_record_view_s view;
+    while (thermo_client_scan(client, &view))
+    {
+        if (found == 0) // one clock read per drain
+        {
+            now_ns = thermo_client_now_ns();
+        }
+        thermo_client_record_handed(client, view.rx_time_ns, now_ns);
+        dense->values[view.slot] = thermo_record_value(&view);
+        dense->rx_time_ns[view.slot] = view.rx_time_ns;
+        dense->nupdated += !dense->updated[view.slot];
+        dense->updated[view.slot] = 1;
+        found++;
+    }
+    return found;
+}
+
+int thermo_client_iter_next(thermo_client_s *client, thermo_record_view_s *view)
+{
+    if (!thermo_client_scan(client, view))
+    {
+        return 0;
+    }
+    thermo_client_record_handed(client, view->rx_time_ns, thermo_client_now_ns());
+    client->pinned = 1;
+    return 1;
+}
+
+void thermo_client_iter_release(thermo_client_s *client)
+{
+    client->pinned = 0;
+}
+
+static int64_t thermo_client_elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+typedef enum
+{
+    THERMO_READ_RECORDS = 0, // Into an array of thermal_data_s
+    THERMO_READ_RECORDS_EX,  // Into an array of thermal_data_ex_s
+    THERMO_READ_DENSE,       // Into a thermo_dense_s
+} thermo_read_mode_e;
+
+/**
+ * @brief Wait for data, and drain complete records into `data`, as selected by `mode`.
+ *
+ */
+static int thermo_client_read_internal(thermo_client_s *client, void *data, int count, int timeout_ms, volatile sig_atomic_t *running, thermo_read_mode_e mode)
+{
+    if (client == NULL || client->fd < 0 || data == NULL || count <= 0)
+    {
+        fprintf(stderr, "Invalid client context, data pointer or count\n");
+        errno = EINVAL;
+        return -1;
+    }
+    struct pollfd pfd;
+    pfd.fd = client->fd;
+    pfd.events = POLLIN | POLLERR | POLLHUP; // Monitor for input, errors, and hangups
+    volatile sig_atomic_t run = 1;
+    if (!running) // take care of the null case
+    {
+        running = &run;
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int found = 0;
+    int expired = 0;
+    while (*running)
+    {
+        // Serve frames that are already buffered before touching the port
+        switch (mode)
+        {
+        case THERMO_READ_RECORDS:
+            found = thermo_client_drain(client, data, count);
+            break;
+        case THERMO_READ_RECORDS_EX:
+            found = thermo_client_drain_ex(client, data, count);
+            break;
+        case THERMO_READ_DENSE:
+            found = thermo_client_drain_dense(client, data);
+            break;
+        }
+        if (found != 0 || expired)
+        {
+            break;
+        }
+        int wait_ms = 100; // Wake up every 100 milliseconds to check if we should keep running
+        if (timeout_ms >= 0)
+        {
+            int64_t remaining = timeout_ms - thermo_client_elapsed_ms(&start);
+            if (remaining <= wait_ms)
+            {
+                wait_ms = remaining > 0 ? (int)remaining : 0;
+                expired = 1; // scan once more after this poll, then give up
+            }
+        }
+        // Use poll to wait for data or timeout
+        int poll_result = poll(&pfd, 1, wait_ms);
+        if (poll_result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue; // Interrupted by a signal, check if we should keep running
+            }
+            return -1; // Error occurred during polling
+        }
+        else if (poll_result == 0)
+        {
+            // Timeout occurred, continue to check for data
+            continue;
+        }
+        ssize_t bytes_read = 0;
+        if (pfd.revents & POLLIN)
+        {
+            bytes_read = thermo_client_feed(client);
+            if (bytes_read < 0)
+            {
+                return -1; // Error reading from the file descriptor
+            }
+        }
+        if (bytes_read == 0 && (pfd.revents & (POLLERR | POLLHUP)))
+        {
+            // An error or hangup occurred, and nothing is left to read, return -1
+            return -1;
+        }
+    }
+    return found;
+}
+
+int thermo_client_read_many(thermo_client_s *client, thermal_data_s *data, int count, int timeout_ms, volatile sig_atomic_t *running)
+{
+    return thermo_client_read_internal(client, data, count, timeout_ms, running, THERMO_READ_RECORDS);
+}
+
+int thermo_client_read_many_ex(thermo_client_s *client, thermal_data_ex_s *data, int count, int timeout_ms, volatile sig_atomic_t *running)
+{
+    return thermo_client_read_internal(client, data, count, timeout_ms, running, THERMO_READ_RECORDS_EX);
+}
+
+int thermo_client_read_dense(thermo_client_s *client, thermo_dense_s *dense, int timeout_ms, volatile sig_atomic_t *running)
+{
+    return thermo_client_read_internal(client, dense, (int)dense->count, timeout_ms, running, THERMO_READ_DENSE);
+}
+
+int thermo_client_read(thermo_client_s *client, thermal_data_s *data, volatile sig_atomic_t *running)
+{
+    return thermo_client_read_many(client, data, 1, -1, running);
+}
@@ -16,6 +16,9 @@
 extern "C" {
 #endif
 #include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/types.h>
 
 #ifndef _Nonnull
 /**
@@ -25,6 +28,119 @@ extern "C" {
 #define _Nonnull
 #endif
 
+#ifndef THERMO_CLIENT_BUFFER_SIZE
+/**
+ * @brief Size of the receive buffer owned by a client context, in bytes.
+ *
+ */
+#define THERMO_CLIENT_BUFFER_SIZE 4096
+#endif
+
+#ifndef THERMO_CLIENT_HEARTBEAT_MS
+/**
+ * @brief Longest silence of a sensor, in milliseconds, when the server only reports changes
+ * (`--temp-deadband`, `--humidity-deadband`).
+ *
+ * A sensor missing from a batch has not changed, and keeps its last value (see `thermo_table_s`).
+ * A sensor silent for longer than this is stale. Defaults to the server `--heartbeat-ms` plus one
+ * sampling period.
+ */
+#define THERMO_CLIENT_HEARTBEAT_MS 11000
+#endif
+
+#ifndef THERMO_CLIENT_DIAG_MAX
+/**
+ * @brief Number of server latency histograms kept by a client context (see `thermo_client_get_diag`).
+ *
+ */
+#define THERMO_CLIENT_DIAG_MAX 64
+#endif
+
+/**
+ * @brief Number of buckets of a latency histogram. Bucket `i` counts the samples in [2^i, 2^(i+1)) us,
+ * bucket 0 also counts the samples under 1 us, and the last bucket counts every longer sample.
+ *
+ */
+#define THERMO_HIST_BUCKETS 24
+
+/**
+ * @brief Source of the server histograms that are not tied to a sensor bus.
+ *
+ */
+#define THERMO_HIST_SOURCE_SERIAL 0xffffffffu
+
+/**
+ * @brief Instrumented stages, as sent by the server in diagnostics frames, and measured by the client.
+ *
+ */
+typedef enum
+{
+    THERMO_STAGE_BUS_RESET = 0,       // Server: 1-Wire reset and convert command
+    THERMO_STAGE_CONVERSION_WAIT = 1, // Server: start of a conversion until done
+    THERMO_STAGE_SCRATCHPAD_READ = 2, // Server: scratchpad read of one DS28EA00
+    THERMO_STAGE_QUEUE_DELAY = 3,     // Server: time in the queue to the serial thread
+    THERMO_STAGE_SERIAL_WRITE = 4,    // Server: serial write of a batch
+    THERMO_STAGE_SERIAL_FLUSH = 5,    // Server: serial flush of a batch
+    THERMO_STAGE_HUMIDITY_READ = 6,   // Server: readout of one humidity sensor
+    THERMO_STAGE_DECODE = 128,        // Client: read() of a record until it is handed out
+    THERMO_STAGE_FRAME_GAP = 129,     // Client: receive time between two frames
+} thermo_stage_e;
+
+/**
+ * @brief Latency histogram of a stage, over one reporting interval for the server histograms, and
+ * since the context was created for the client histograms.
+ *
+ */
+typedef struct _thermo_hist_s
+{
+    uint32_t source;     // Server: I2C bus number, or THERMO_HIST_SOURCE_SERIAL. Client: 0
+    uint8_t stage;       // One of thermo_stage_e
+    uint32_t count;      // Samples in the histogram
+    uint32_t max_us;     // Longest sample, in us
+    uint64_t sum_us;     // Sum of the samples, in us
+    uint32_t tx_time_ms; // Server only: end of the interval, in ms since the server started
+    uint32_t buckets[THERMO_HIST_BUCKETS];
+} thermo_hist_s;
+
+/**
+ * @brief Get the upper bound, in us, of the bucket holding the quantile `q` (0 to 1) of a histogram.
+ *
+ */
+static inline uint64_t thermo_hist_quantile_us(const thermo_hist_s *_Nonnull hist, double q)
+{
+    uint64_t target = (uint64_t)(hist->count * q + 0.999999);
+    uint64_t seen = 0;
+    if (target == 0)
+    {
+        target = 1;
+    }
+    for (int i = 0; i < THERMO_HIST_BUCKETS; i++)
+    {
+        seen += hist->buckets[i];
+        if (seen >= target)
+        {
+            uint64_t bound = 2ull << i;
+            return bound < hist->max_us ? bound : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
+
+/**
+ * @brief Get a printable name of a stage.
+ *
+ */
+const char *thermo_stage_name(uint8_t stage);
+
+/**
+ * @brief Compute the CRC32 (IEEE 802.3) that ends every v2 frame.
+ *
+ * @param data The bytes to checksum.
+ * @param len Number of bytes.
+ * @return uint32_t The CRC32 of the bytes.
+ */
+uint32_t thermo_crc32(const uint8_t *_Nonnull data, size_t len);
+
 typedef struct _thermal_data_s
 {
     char type;       // 'T' for temperature, 'H' for humidity
@@ -32,27 +148,341 @@ typedef struct _thermal_data_s
     float value;     // Temperature in Celsius or Humidity in percentage
 } thermal_data_s;
 
+/**
+ * @brief Record with receive time and wire metadata.
+ *
+ */
+typedef struct _thermal_data_ex_s
+{
+    thermal_data_s data;
+    uint64_t rx_time_ns; // CLOCK_MONOTONIC time (ns) right after the read() that completed the frame
+    uint32_t tx_time_ms; // v2 only: acquisition time on the server, in ms since the server started. 0 for v1
+    uint16_t seq;        // v2 only: sequence number of the batch. 0 for v1
+    uint8_t version;     // Wire format version of the frame (1 or 2)
+} thermal_data_ex_s;
+
+/**
+ * @brief View of a record in the receive buffer of a client context, handed out by `thermo_client_iter_next`.
+ *
+ */
+typedef struct _thermo_record_view_s
+{
+    char type;             // 'T' for temperature, 'H' for humidity
+    const uint8_t *record; // 8 bytes in the receive buffer: uint32_t source, float value (little endian)
+    uint64_t rx_time_ns;   // CLOCK_MONOTONIC time (ns) right after the read() that completed the frame
+    uint32_t tx_time_ms;   // v2 only: acquisition time on the server, in ms since the server started. 0 for v1
+    uint16_t seq;          // v2 only: sequence number of the batch. 0 for v1
+    uint8_t version;       // Wire format version of the frame (1 or 2)
+    int slot;              // Slot of the sensor in the manifest (see `thermo_client_set_manifest`), -1 without a manifest
+} thermo_record_view_s;
+
+/**
+ * @brief Get the source sensor ID of a record view.
+ *
+ */
+static inline uint32_t thermo_record_source(const thermo_record_view_s *_Nonnull view)
+{
+    uint32_t source;
+    memcpy(&source, view->record, sizeof(source));
+    return source;
+}
+
+/**
+ * @brief Get the value of a record view.
+ *
+ */
+static inline float thermo_record_value(const thermo_record_view_s *_Nonnull view)
+{
+    float value;
+    memcpy(&value, view->record + sizeof(uint32_t), sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Decoder counters of a client context.
+ *
+ */
+typedef struct _thermo_client_stats_s
+{
+    uint64_t bytes;         // Bytes received from the serial port
+    uint64_t frames;        // Records decoded (one per v1 frame, `count` per v2 frame)
+    uint64_t batches;       // v2 frames decoded
+    uint64_t frames_lost;   // Frames whose magic was received, but were malformed and dropped
+    uint64_t crc_errors;    // v2 frames dropped because of a CRC mismatch (included in frames_lost)
+    uint64_t seq_gaps;      // v2 frames missing from the sequence
+    uint64_t resyncs;       // Times the decoder lost frame sync and had to search for the next magic
+    uint64_t bytes_skipped; // Bytes discarded while searching for the next magic
+    uint64_t diag_frames;   // v2 diagnostics frames decoded (see `thermo_client_get_diag`)
+    uint64_t unknown;       // Records dropped because their sensor is not in the manifest (see `thermo_client_set_manifest`)
+} thermo_client_stats_s;
+
+/**
+ * @brief Opaque client context. Owns the serial port file descriptor and the receive buffer.
+ *
+ */
+typedef struct _thermo_client_s thermo_client_s;
+
+/**
+ * @brief Opaque sensor manifest: the fixed list of sensors of a port (see thermo_manifest.h).
+ *
+ */
+typedef struct _thermo_manifest_s thermo_manifest_s;
+
+/**
+ * @brief Dense vector of the latest value of every sensor of a manifest (see thermo_manifest.h).
+ *
+ */
+typedef struct _thermo_dense_s thermo_dense_s;
+
 /**
  * @brief Open a serial port with the given port name, and apply necessary settings.
  *
- * @param port The name of the serial port to open (e.g., "/dev/ttyACM0").
+ * A Unix socket of the server (`--socket`) is connected to with `thermo_client_init_socket` instead.
+ *
+ * @param port The name of the serial port to open (e.g., "/dev/ttyACM0"), or the path of the server socket.
  * @return int Positive file descriptor on success, -1 value on failure. `errno` will be set to indicate the error.
  */
 int thermo_client_init(const char *_Nonnull port);
 
+struct termios;
+
+/**
+ * @brief Apply the serial port settings of `thermo_client_init` (115200 baud, 8N1, raw) to a termios structure.
+ *
+ * The settings are cached by `thermo_reconnect_s`, and applied again as is when the port reappears.
+ *
+ * @param options The termios structure, as read from the port with `tcgetattr`.
+ */
+void thermo_client_termios(struct termios *_Nonnull options);
+
+/**
+ * @brief Connect to the Unix socket of a server running with `--socket`.
+ *
+ * The socket carries the same stream as the serial port, from the batch after the connection, and
+ * the file descriptor is used with `thermo_client_create` the same way.
+ *
+ * @param path The path of the server socket (e.g., "/run/thermo/thermo.sock").
+ * @return int Positive file descriptor on success, -1 value on failure. `errno` will be set to indicate the error.
+ */
+int thermo_client_init_socket(const char *_Nonnull path);
+
+/**
+ * @brief Create a client context for a serial port opened with `thermo_client_init`.
+ *
+ * The context takes ownership of the file descriptor, and closes it in `thermo_client_destroy`.
+ *
+ * @param fd The file descriptor of the opened serial port.
+ * @return thermo_client_s* Client context on success, NULL on failure. `errno` will be set to indicate the error.
+ */
+thermo_client_s *thermo_client_create(int fd);
+
+/**
+ * @brief Close the serial port and free the client context.
+ *
+ * @param client The client context. May be NULL.
+ */
+void thermo_client_destroy(thermo_client_s *client);
+
+/**
+ * @brief Get the file descriptor of the serial port owned by the client context.
+ *
+ * @param client The client context.
+ * @return int The file descriptor.
+ */
+int thermo_client_fd(const thermo_client_s *_Nonnull client);
+
+/**
+ * @brief Replace the serial port of the client context, after the previous one was lost.
+ *
+ * The decoder state is kept: records still in the receive buffer are handed out, and the sequence numbers of
+ * v2 frames are tracked across the reconnect, so `seq_gaps` counts what was lost in between. A frame left
+ * incomplete by the old port is dropped by the usual validation. The previous file descriptor is closed, and
+ * the context takes ownership of the new one, in non-blocking mode if the context is.
+ *
+ * @param client The client context.
+ * @param fd The file descriptor of the reopened serial port.
+ * @return int 0 on success, -1 on failure (the context keeps its previous file descriptor). `errno` will be set to indicate the error.
+ */
+int thermo_client_reattach(thermo_client_s *_Nonnull client, int fd);
+
+/**
+ * @brief Get the decoder counters of the client context.
+ *
+ * @param client The client context.
+ * @param stats Pointer to a thermo_client_stats_s structure to store the counters.
+ */
+void thermo_client_get_stats(const thermo_client_s *_Nonnull client, thermo_client_stats_s *_Nonnull stats);
+
+/**
+ * @brief Get the latest server latency histograms, received in v2 diagnostics frames.
+ *
+ * Diagnostics frames ("CHRIS" 0x02 'D', sent with `--diag-interval-ms`) are decoded along with the records,
+ * and are not returned by the read functions. Every histogram replaces the previous one of the same stage
+ * and source. `diag_frames` in `thermo_client_stats_s` counts the frames, to tell when new histograms arrived.
+ *
+ * @param client The client context.
+ * @param hists Array of at least `count` thermo_hist_s structures to store the histograms.
+ * @param count Maximum number of histograms to store in `hists`.
+ * @return int Number of histograms stored in `hists`.
+ */
+int thermo_client_get_diag(const thermo_client_s *_Nonnull client, thermo_hist_s *_Nonnull hists, int count);
+
+/**
+ * @brief Get the latency histograms measured by the client context: THERMO_STAGE_DECODE, then THERMO_STAGE_FRAME_GAP.
+ *
+ * @param client The client context.
+ * @param hists Array of 2 thermo_hist_s structures to store the histograms.
+ */
+void thermo_client_get_latency(const thermo_client_s *_Nonnull client, thermo_hist_s *_Nonnull hists);
+
 /**
  * @brief Read temperature or humidity data from the serial port.
  *
  * This function reads data in the format: "CHRIS,[T|H],uint32_t float". (space indicates no bytes in between)
+ * Batches in the v2 format are decoded as well: "CHRIS" 0x02 [T|H] uint8_t count, uint16_t seq, uint32_t timestamp,
+ * count x (uint32_t float), uint32_t crc32.
+ * The serial port is read in bulk into the receive buffer of the client context, and frames are
+ * decoded from the buffer. Bytes of a frame that has not arrived completely are kept for the next call.
  * It will block until it receives a complete data packet.
  *
- * @param fd The file descriptor of the opened serial port.
+ * @param client The client context.
  * @param data Pointer to a thermal_data_s structure to store the read data.
- * @param stop Pointer to a volatile sig_atomic_t variable to indicate if the reading should continue. If this variable is set to 0, the function will stop reading and return.
+ * @param running Pointer to a volatile sig_atomic_t variable to indicate if the reading should continue. If this variable is set to 0, the function will stop reading and return.
  * @return int 1 on success, 0 on incomplete data, -1 value on failure. `errno` will be set to indicate the error.
  */
+int thermo_client_read(thermo_client_s *_Nonnull client, thermal_data_s *_Nonnull data, volatile sig_atomic_t *_Nonnull running);
+
+/**
+ * @brief Read all complete temperature or humidity data frames that are available from the serial port.
+ *
+ * Frames already in the receive buffer are returned without waiting. Otherwise, this function
+ * waits for up to `timeout_ms` milliseconds for data to arrive, and then returns every complete
+ * frame delivered (up to `count`). Frames that do not fit in `data` are kept for the next call.
+ *
+ * @param client The client context.
+ * @param data Array of at least `count` thermal_data_s structures to store the read data.
+ * @param count Maximum number of frames to store in `data`.
+ * @param timeout_ms Maximum time to wait for data in milliseconds. 0 to return immediately, negative to wait until data arrives or `running` is cleared.
+ * @param running Pointer to a volatile sig_atomic_t variable to indicate if the reading should continue. If this variable is set to 0, the function will stop reading and return.
+ * @return int Number of frames stored in `data` (0 on timeout), -1 on failure. `errno` will be set to indicate the error.
+ */
+int thermo_client_read_many(thermo_client_s *_Nonnull client, thermal_data_s *_Nonnull data, int count, int timeout_ms, volatile sig_atomic_t *_Nonnull running);
 
-int thermo_client_read(int fd, thermal_data_s *_Nonnull data, volatile sig_atomic_t *_Nonnull running);
+/**
+ * @brief Same as `thermo_client_read_many`, but stores each record with its receive time and wire metadata.
+ *
+ * @param client The client context.
+ * @param data Array of at least `count` thermal_data_ex_s structures to store the read data.
+ * @param count Maximum number of frames to store in `data`.
+ * @param timeout_ms Maximum time to wait for data in milliseconds. 0 to return immediately, negative to wait until data arrives or `running` is cleared.
+ * @param running Pointer to a volatile sig_atomic_t variable to indicate if the reading should continue. If this variable is set to 0, the function will stop reading and return.
+ * @return int Number of frames stored in `data` (0 on timeout), -1 on failure. `errno` will be set to indicate the error.
+ */
+int thermo_client_read_many_ex(thermo_client_s *_Nonnull client, thermal_data_ex_s *_Nonnull data, int count, int timeout_ms, volatile sig_atomic_t *_Nonnull running);
+
+/**
+ * @brief Switch the serial port of the client context to non-blocking mode, for use in an event loop.
+ *
+ * In non-blocking mode, register the file descriptor from `thermo_client_fd` with poll/epoll,
+ * call `thermo_client_feed` when it is readable, and then `thermo_client_drain` to collect the
+ * decoded records.
+ *
+ * @param client The client context.
+ * @param enable 1 to enable non-blocking mode, 0 to disable it.
+ * @return int 0 on success, -1 on failure. `errno` will be set to indicate the error.
+ */
+int thermo_client_set_nonblocking(thermo_client_s *_Nonnull client, int enable);
+
+/**
+ * @brief Read the bytes available on the serial port into the receive buffer, without decoding them.
+ *
+ * In non-blocking mode, this reads until the port is drained or the receive buffer is full. In blocking
+ * mode, this performs a single read. Call `thermo_client_drain` after every feed so that the receive
+ * buffer does not fill up.
+ *
+ * Hangups are not reported by this function: check the events reported by poll/epoll for POLLHUP/POLLERR.
+ *
+ * @param client The client context.
+ * @return ssize_t Number of bytes read (0 if none were available), -1 on failure. `errno` will be set to indicate the error.
+ */
+ssize_t thermo_client_feed(thermo_client_s *_Nonnull client);
+
+/**
+ * @brief Decode the complete frames in the receive buffer, without reading from the serial port.
+ *
+ * @param client The client context.
+ * @param data Array of at least `count` thermal_data_s structures to store the decoded data.
+ * @param count Maximum number of frames to store in `data`.
+ * @return int Number of frames stored in `data`. Frames that do not fit are kept for the next call.
+ */
+int thermo_client_drain(thermo_client_s *_Nonnull client, thermal_data_s *_Nonnull data, int count);
+
+/**
+ * @brief Same as `thermo_client_drain`, but stores each record with its receive time and wire metadata.
+ *
+ * @param client The client context.
+ * @param data Array of at least `count` thermal_data_ex_s structures to store the decoded data.
+ * @param count Maximum number of frames to store in `data`.
+ * @return int Number of frames stored in `data`. Frames that do not fit are kept for the next call.
+ */
+int thermo_client_drain_ex(thermo_client_s *_Nonnull client, thermal_data_ex_s *_Nonnull data, int count);
+
+/**
+ * @brief Validate the records against a fixed list of sensors, and address them by slot.
+ *
+ * With a manifest, a v1 frame of a sensor that is not listed is dropped as malformed (counted in `frames_lost`
+ * and `unknown`), and the decoder resynchronizes on the next magic: v1 frames have no CRC, and a corrupted
+ * source ID is caught this way. A v2 frame with more records of a type than the manifest lists is dropped
+ * from its header (counted in `frames_lost`), before the rest of the frame is received and checked. Records
+ * of valid v2 frames from sensors that are not listed are dropped (counted in `unknown`).
+ *
+ * @param client The client context.
+ * @param manifest The manifest, which must outlive the client context, or NULL to accept every sensor again.
+ */
+void thermo_client_set_manifest(thermo_client_s *_Nonnull client, const thermo_manifest_s *manifest);
+
+/**
+ * @brief Decode every complete frame in the receive buffer into a dense vector, without reading from the serial port.
+ *
+ * The value of each record is stored in the slot of its sensor, and the slots updated by this call are flagged.
+ *
+ * @param client The client context, with a manifest set by `thermo_client_set_manifest`.
+ * @param dense Dense vector created for the same manifest with `thermo_dense_create`.
+ * @return int Number of records stored, -1 if the client context has no manifest or the vector does not match it
+ * (`errno` is set to `EINVAL`).
+ */
+int thermo_client_drain_dense(thermo_client_s *_Nonnull client, thermo_dense_s *_Nonnull dense);
+
+/**
+ * @brief Same as `thermo_client_read_many`, but decodes into a dense vector as in `thermo_client_drain_dense`.
+ *
+ * @param client The client context, with a manifest set by `thermo_client_set_manifest`.
+ * @param dense Dense vector created for the same manifest with `thermo_dense_create`.
+ * @param timeout_ms Maximum time to wait for data in milliseconds. 0 to return immediately, negative to wait until data arrives or `running` is cleared.
+ * @param running Pointer to a volatile sig_atomic_t variable to indicate if the reading should continue. If this variable is set to 0, the function will stop reading and return.
+ * @return int Number of records stored (0 on timeout), -1 on failure. `errno` will be set to indicate the error.
+ */
+int thermo_client_read_dense(thermo_client_s *_Nonnull client, thermo_dense_s *_Nonnull dense, int timeout_ms, volatile sig_atomic_t *_Nonnull running);
+
+/**
+ * @brief Get a view of the next complete record in the receive buffer, without copying it.
+ *
+ * Records are validated exactly as in `thermo_client_drain`, but the view points into the receive buffer.
+ * Views stay valid, and the buffer is not compacted, until `thermo_client_iter_release` is called. Release
+ * views promptly: the receive buffer can not take in new data past its end while views are outstanding.
+ *
+ * @param client The client context.
+ * @param view Pointer to a thermo_record_view_s structure to store the view.
+ * @return int 1 if a view was stored, 0 if no complete record is available.
+ */
+int thermo_client_iter_next(thermo_client_s *_Nonnull client, thermo_record_view_s *_Nonnull view);
+
+/**
+ * @brief Release every view handed out by `thermo_client_iter_next` since the last release.
+ *
+ * @param client The client context.
+ */
+void thermo_client_iter_release(thermo_client_s *_Nonnull client);
 
 #ifdef __cplusplus
 }
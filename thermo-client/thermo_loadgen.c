@@ -0,0 +1,328 @@
+/**
+ * @file thermo_loadgen.c
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data client for PICTURE-D: Implementations for generating server streams on a pseudo-terminal.
+ * @version 0.0.1
+ * @date 2025-06-24
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#define _GNU_SOURCE // posix_openpt, ptsname_r
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "thermo_loadgen.h"
+
+// Same layouts as the server: see Measurement::write_le_bytes and Measurement::write_v2_bytes
+#define LOADGEN_V1_FRAME_LEN 16
+#define LOADGEN_V2_HEADER_LEN 14
+#define LOADGEN_V2_RECORD_LEN 8
+#define LOADGEN_V2_CRC_LEN 4
+#define LOADGEN_MAX_SENSORS 255 // Records in a v2 frame
+
+struct _thermo_loadgen_s
+{
+    thermo_loadgen_config_s config;
+    int fd;                       // Master side of the pseudo-terminal
+    char path[64];                // Slave side of the pseudo-terminal
+    unsigned seed;                // State of rand_r
+    uint16_t seq;                 // Sequence number of the next v2 frame
+    uint32_t time_ms;             // Timestamp of the next v2 frame
+    uint8_t *buf;                 // Encoded burst
+    size_t cap;                   // Size of buf
+    pthread_mutex_t lock;         // Protects stats
+    thermo_loadgen_stats_s stats; // Counters
+};
+
+void thermo_loadgen_defaults(thermo_loadgen_config_s *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->version = 1;
+    config->sensors = 16;
+    config->burst = 1;
+    config->seed = 1;
+}
+
+/**
+ * @brief Largest encoding of a batch.
+ *
+ */
+static size_t loadgen_batch_len(const thermo_loadgen_config_s *config)
+{
+    size_t records = config->sensors + config->humidity;
+    if (config->version == 1)
+    {
+        return records * LOADGEN_V1_FRAME_LEN;
+    }
+    return 2 * (LOADGEN_V2_HEADER_LEN + LOADGEN_V2_CRC_LEN) + records * LOADGEN_V2_RECORD_LEN;
+}
+
+thermo_loadgen_s *thermo_loadgen_open(const thermo_loadgen_config_s *config)
+{
+    if ((config->version != 1 && config->version != 2) || config->sensors < 0 || config->humidity < 0 ||
+        config->sensors > LOADGEN_MAX_SENSORS || config->humidity > LOADGEN_MAX_SENSORS ||
+        config->sensors + config->humidity == 0 || config->burst <= 0 || config->fragment < 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    thermo_loadgen_s *gen = calloc(1, sizeof(thermo_loadgen_s));
+    if (gen == NULL)
+    {
+        return NULL;
+    }
+    gen->config = *config;
+    gen->seed = config->seed;
+    gen->cap = loadgen_batch_len(config) * config->burst;
+    gen->buf = malloc(gen->cap);
+    gen->fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (gen->buf == NULL || gen->fd < 0 || grantpt(gen->fd) < 0 || unlockpt(gen->fd) < 0 ||
+        ptsname_r(gen->fd, gen->path, sizeof(gen->path)) != 0)
+    {
+        goto error;
+    }
+    // Raw mode until the reader sets the port up, so that nothing is echoed or translated
+    int slave = open(gen->path, O_RDWR | O_NOCTTY);
+    if (slave < 0)
+    {
+        goto error;
+    }
+    struct termios options;
+    if (tcgetattr(slave, &options) == 0)
+    {
+        cfmakeraw(&options);
+        tcsetattr(slave, TCSANOW, &options);
+    }
+    close(slave);
+    pthread_mutex_init(&gen->lock, NULL);
+    return gen;
+error:
+    if (gen->fd >= 0)
+    {
+        close(gen->fd);
+    }
+    free(gen->buf);
+    free(gen);
+    return NULL;
+}
+
+const char *thermo_loadgen_path(const thermo_loadgen_s *gen)
+{
+    return gen->path;
+}
+
+int thermo_loadgen_wait_peer(thermo_loadgen_s *gen, volatile sig_atomic_t *running)
+{
+    struct pollfd pfd = {.fd = gen->fd, .events = POLLOUT};
+    while (*running)
+    {
+        // The master side reports a hangup until the slave side is opened
+        int res = poll(&pfd, 1, 10);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if (res > 0 && !(pfd.revents & POLLHUP))
+        {
+            return 1;
+        }
+        struct timespec wait = {.tv_sec = 0, .tv_nsec = 10000000};
+        nanosleep(&wait, NULL);
+    }
+    return 0;
+}
+
+/**
+ * @brief Flip one byte of a frame, with the configured probability.
+ *
+ * @return int 1 if the frame was corrupted, 0 otherwise.
+ */
+static int loadgen_corrupt(thermo_loadgen_s *gen, uint8_t *frame, size_t len)
+{
+    if (gen->config.corrupt <= 0 || (double)rand_r(&gen->seed) / RAND_MAX >= gen->config.corrupt)
+    {
+        return 0;
+    }
+    frame[rand_r(&gen->seed) % len] ^= 1 + rand_r(&gen->seed) % 255;
+    return 1;
+}
+
+/**
+ * @brief Encode the readings of one type (`T` or `H`) of a batch.
+ *
+ * Values move a little from batch to batch, like real sensors.
+ *
+ * @return size_t Number of bytes appended to `out`.
+ */
+static size_t loadgen_encode(thermo_loadgen_s *gen, uint8_t *out, char type, int count, uint64_t batch, thermo_loadgen_stats_s *stats)
+{
+    uint32_t base = type == 'T' ? THERMO_LOADGEN_TEMP_BASE : THERMO_LOADGEN_HUM_BASE;
+    float offset = type == 'T' ? 20.0f : 40.0f;
+    uint8_t *start = out;
+    if (count == 0)
+    {
+        return 0;
+    }
+    if (gen->config.version == 2)
+    {
+        memcpy(out, "CHRIS", 5);
+        out[5] = 2;
+        out[6] = type;
+        out[7] = (uint8_t)count;
+        memcpy(out + 8, &gen->seq, sizeof(gen->seq));
+        memcpy(out + 10, &gen->time_ms, sizeof(gen->time_ms));
+        out += LOADGEN_V2_HEADER_LEN;
+        gen->seq++;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t source = base + i;
+        float value = offset + i * 0.25f + (float)(batch % 64) / 64.0f;
+        uint8_t *frame = out;
+        if (gen->config.version == 1)
+        {
+            memcpy(out, "CHRIS,", 6);
+            out[6] = type;
+            out[7] = ',';
+            out += 8;
+        }
+        memcpy(out, &source, sizeof(source));
+        memcpy(out + 4, &value, sizeof(value));
+        out += LOADGEN_V2_RECORD_LEN;
+        if (gen->config.version == 1)
+        {
+            stats->frames++;
+            if (loadgen_corrupt(gen, frame, LOADGEN_V1_FRAME_LEN))
+            {
+                stats->corrupted++;
+                stats->records_corrupted++;
+            }
+        }
+    }
+    if (gen->config.version == 2)
+    {
+        uint32_t crc = thermo_crc32(start, out - start);
+        memcpy(out, &crc, sizeof(crc));
+        out += LOADGEN_V2_CRC_LEN;
+        stats->frames++;
+        if (loadgen_corrupt(gen, start, out - start))
+        {
+            stats->corrupted++;
+            stats->records_corrupted += count;
+        }
+    }
+    stats->records += count;
+    return out - start;
+}
+
+/**
+ * @brief Write a burst, split into writes of random size up to the configured fragment size.
+ *
+ * @return int 0 on success, -1 on failure.
+ */
+static int loadgen_write(thermo_loadgen_s *gen, size_t len, volatile sig_atomic_t *running, thermo_loadgen_stats_s *stats)
+{
+    size_t done = 0;
+    while (done < len && *running)
+    {
+        size_t chunk = len - done;
+        if (gen->config.fragment > 0)
+        {
+            size_t max = 1 + rand_r(&gen->seed) % gen->config.fragment;
+            chunk = chunk < max ? chunk : max;
+        }
+        ssize_t res = write(gen->fd, gen->buf + done, chunk);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        done += res;
+        stats->bytes += res;
+        stats->writes++;
+    }
+    return 0;
+}
+
+int thermo_loadgen_run(thermo_loadgen_s *gen, volatile sig_atomic_t *running)
+{
+    const thermo_loadgen_config_s *config = &gen->config;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    uint64_t period_ns = config->rate_hz > 0 ? (uint64_t)(1e9 / config->rate_hz) : 0;
+    uint64_t batch = 0;
+    while (*running && (config->batches == 0 || batch < config->batches))
+    {
+        thermo_loadgen_stats_s delta;
+        memset(&delta, 0, sizeof(delta));
+        size_t len = 0;
+        for (int i = 0; i < config->burst && (config->batches == 0 || batch < config->batches); i++, batch++)
+        {
+            len += loadgen_encode(gen, gen->buf + len, 'T', config->sensors, batch, &delta);
+            len += loadgen_encode(gen, gen->buf + len, 'H', config->humidity, batch, &delta);
+            delta.batches++;
+            gen->time_ms += 1000; // one server sampling period per batch
+        }
+        int res = loadgen_write(gen, len, running, &delta);
+        pthread_mutex_lock(&gen->lock);
+        gen->stats.batches += delta.batches;
+        gen->stats.records += delta.records;
+        gen->stats.frames += delta.frames;
+        gen->stats.corrupted += delta.corrupted;
+        gen->stats.records_corrupted += delta.records_corrupted;
+        gen->stats.bytes += delta.bytes;
+        gen->stats.writes += delta.writes;
+        pthread_mutex_unlock(&gen->lock);
+        if (res < 0)
+        {
+            return -1;
+        }
+        if (period_ns > 0)
+        {
+            next.tv_nsec += period_ns % 1000000000;
+            next.tv_sec += period_ns / 1000000000 + next.tv_nsec / 1000000000;
+            next.tv_nsec %= 1000000000;
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR && *running)
+            {
+            }
+        }
+    }
+    return 0;
+}
+
+void thermo_loadgen_get_stats(const thermo_loadgen_s *gen, thermo_loadgen_stats_s *stats)
+{
+    pthread_mutex_t *lock = (pthread_mutex_t *)&gen->lock;
+    pthread_mutex_lock(lock);
+    *stats = gen->stats;
+    pthread_mutex_unlock(lock);
+}
+
+void thermo_loadgen_close(thermo_loadgen_s *gen)
+{
+    if (gen == NULL)
+    {
+        return;
+    }
+    close(gen->fd);
+    pthread_mutex_destroy(&gen->lock);
+    free(gen->buf);
+    free(gen);
+}
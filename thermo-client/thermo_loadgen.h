@@ -0,0 +1,135 @@
+/**
+ * @file thermo_loadgen.h
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data client for PICTURE-D: Synthetic server streams on a pseudo-terminal, for benchmarks.
+ * @version 0.0.1
+ * @date 2025-06-24
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef THERMO_LOADGEN_H
+#define THERMO_LOADGEN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <stdint.h>
+#include <signal.h>
+#include "thermo_client.h"
+
+/**
+ * @brief Source ID of the first generated temperature sensor. Sensor `i` has the ID `THERMO_LOADGEN_TEMP_BASE + i`.
+ *
+ */
+#define THERMO_LOADGEN_TEMP_BASE 0x10000000u
+/**
+ * @brief Source ID of the first generated humidity sensor. Sensor `i` has the ID `THERMO_LOADGEN_HUM_BASE + i`.
+ *
+ */
+#define THERMO_LOADGEN_HUM_BASE 0x20000000u
+
+/**
+ * @brief Shape of a generated stream.
+ *
+ */
+typedef struct _thermo_loadgen_config_s
+{
+    int version;      // Wire format, 1 or 2, as sent by the server without and with `--wire-v2`
+    int sensors;      // Temperature sensors per batch (at most 255)
+    int humidity;     // Humidity sensors per batch (at most 255)
+    int burst;        // Batches per write, as collected by the server within its batch window
+    int fragment;     // Largest write, in bytes: bursts are split into writes of 1 to `fragment` bytes. 0 to not split
+    double corrupt;   // Probability that a frame has one corrupted byte
+    double rate_hz;   // Bursts per second. 0 to write as fast as the reader takes them
+    uint64_t batches; // Batches to write. 0 to write until stopped
+    unsigned seed;    // Seed of the fragment sizes and of the corruption
+} thermo_loadgen_config_s;
+
+/**
+ * @brief Counters of a generated stream.
+ *
+ */
+typedef struct _thermo_loadgen_stats_s
+{
+    uint64_t batches;           // Batches written
+    uint64_t records;           // Records written, including the ones in corrupted frames
+    uint64_t frames;            // Frames written (one per record in v1, one per batch and type in v2)
+    uint64_t corrupted;         // Frames with a corrupted byte
+    uint64_t records_corrupted; // Records in the corrupted frames
+    uint64_t bytes;             // Bytes written
+    uint64_t writes;            // write() calls
+} thermo_loadgen_stats_s;
+
+/**
+ * @brief Opaque load generator. Owns the master side of a pseudo-terminal.
+ *
+ */
+typedef struct _thermo_loadgen_s thermo_loadgen_s;
+
+/**
+ * @brief Fill a configuration with the defaults: v1, 16 temperature sensors, no humidity sensors, one
+ * batch per write, no fragmentation or corruption, as fast as possible, until stopped.
+ *
+ * @param config The configuration to fill.
+ */
+void thermo_loadgen_defaults(thermo_loadgen_config_s *_Nonnull config);
+
+/**
+ * @brief Create a pseudo-terminal for a generated stream. Its slave side (see `thermo_loadgen_path`) is
+ * opened like a serial port, e.g. with `thermo_client_init`.
+ *
+ * @param config The shape of the stream. Copied.
+ * @return thermo_loadgen_s* Load generator on success, NULL on failure. `errno` will be set to indicate the error.
+ */
+thermo_loadgen_s *thermo_loadgen_open(const thermo_loadgen_config_s *_Nonnull config);
+
+/**
+ * @brief Get the path of the slave side of the pseudo-terminal (e.g. "/dev/pts/3").
+ *
+ * @param gen The load generator.
+ * @return const char* The path.
+ */
+const char *thermo_loadgen_path(const thermo_loadgen_s *_Nonnull gen);
+
+/**
+ * @brief Wait until a reader has opened the slave side of the pseudo-terminal.
+ *
+ * @param gen The load generator.
+ * @param running Pointer to a volatile sig_atomic_t variable, the wait stops when it is cleared.
+ * @return int 1 once a reader is connected, 0 if stopped. -1 on failure, `errno` will be set to indicate the error.
+ */
+int thermo_loadgen_wait_peer(thermo_loadgen_s *_Nonnull gen, volatile sig_atomic_t *_Nonnull running);
+
+/**
+ * @brief Write the stream, until the configured number of batches is written or `running` is cleared.
+ *
+ * Writes block while the reader lags behind, so data is only lost to the configured corruption.
+ *
+ * @param gen The load generator.
+ * @param running Pointer to a volatile sig_atomic_t variable, writing stops when it is cleared.
+ * @return int 0 on success, -1 on failure. `errno` will be set to indicate the error.
+ */
+int thermo_loadgen_run(thermo_loadgen_s *_Nonnull gen, volatile sig_atomic_t *_Nonnull running);
+
+/**
+ * @brief Get the counters of the load generator. Safe to call while `thermo_loadgen_run` is running in another thread.
+ *
+ * @param gen The load generator.
+ * @param stats Pointer to a thermo_loadgen_stats_s structure to store the counters.
+ */
+void thermo_loadgen_get_stats(const thermo_loadgen_s *_Nonnull gen, thermo_loadgen_stats_s *_Nonnull stats);
+
+/**
+ * @brief Close the pseudo-terminal and free the load generator. Readers see a hangup.
+ *
+ * @param gen The load generator. May be NULL.
+ */
+void thermo_loadgen_close(thermo_loadgen_s *gen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THERMO_LOADGEN_H
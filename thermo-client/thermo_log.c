@@ -0,0 +1,283 @@
+/**
+ * @file thermo_log.c
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data client for PICTURE-D: Implementation of the memory-mapped log.
+ * @version 0.0.1
+ * @date 2025-06-16
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#define _FILE_OFFSET_BITS 64 // Logs grow past 2 GiB on 32-bit hosts
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "thermo_log.h"
+
+#define THERMO_LOG_MAGIC "THRMLOG"
+#define THERMO_LOG_VERSION 1
+#define THERMO_LOG_SEGMENT_SIZE ((off_t)(THERMO_LOG_SEGMENT_RECORDS * sizeof(thermo_log_record_s)))
+#define THERMO_LOG_NO_SEGMENT UINT32_MAX
+
+typedef struct
+{
+    char magic[8];                          // THERMO_LOG_MAGIC
+    uint32_t version;                       // THERMO_LOG_VERSION
+    uint32_t record_size;                   // sizeof(thermo_log_record_s)
+    uint32_t segment_records;               // THERMO_LOG_SEGMENT_RECORDS
+    uint32_t nsegments;                     // Segments allocated in the file
+    uint64_t count;                         // Committed records
+    int64_t index[THERMO_LOG_MAX_SEGMENTS]; // Time of the first record of each segment
+} thermo_log_header_s;
+
+_Static_assert(sizeof(thermo_log_header_s) <= THERMO_LOG_HEADER_SIZE, "Log header does not fit");
+_Static_assert(sizeof(thermo_log_record_s) == 24, "Log record layout changed");
+
+struct _thermo_log_s
+{
+    int fd;
+    int writable;
+    thermo_log_header_s *header; // Shared mapping of the file header
+    thermo_log_record_s *map;    // Mapping of the current segment
+    uint32_t segment;            // Index of the mapped segment, THERMO_LOG_NO_SEGMENT if none
+    int64_t realtime_offset_ns;  // CLOCK_REALTIME - CLOCK_MONOTONIC when the log was opened
+};
+
+static int64_t thermo_log_clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+thermo_log_s *thermo_log_open(const char *path, int writable)
+{
+    thermo_log_s *log = calloc(1, sizeof(thermo_log_s));
+    if (log == NULL)
+    {
+        return NULL;
+    }
+    log->writable = writable;
+    log->segment = THERMO_LOG_NO_SEGMENT;
+    log->fd = open(path, writable ? (O_RDWR | O_CREAT | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC), 0644);
+    if (log->fd < 0)
+    {
+        goto err;
+    }
+    if (writable && flock(log->fd, LOCK_EX | LOCK_NB) < 0) // a single writer per log
+    {
+        goto err;
+    }
+    struct stat st;
+    if (fstat(log->fd, &st) < 0)
+    {
+        goto err;
+    }
+    int created = 0;
+    if (st.st_size == 0 && writable)
+    {
+        if (ftruncate(log->fd, THERMO_LOG_HEADER_SIZE) < 0)
+        {
+            goto err;
+        }
+        created = 1;
+    }
+    else if (st.st_size < THERMO_LOG_HEADER_SIZE)
+    {
+        errno = EINVAL;
+        goto err;
+    }
+    void *header = mmap(NULL, THERMO_LOG_HEADER_SIZE, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, log->fd, 0);
+    if (header == MAP_FAILED)
+    {
+        goto err;
+    }
+    log->header = header;
+    if (created)
+    {
+        memcpy(log->header->magic, THERMO_LOG_MAGIC, sizeof(THERMO_LOG_MAGIC));
+        log->header->version = THERMO_LOG_VERSION;
+        log->header->record_size = sizeof(thermo_log_record_s);
+        log->header->segment_records = THERMO_LOG_SEGMENT_RECORDS;
+    }
+    else if (memcmp(log->header->magic, THERMO_LOG_MAGIC, sizeof(THERMO_LOG_MAGIC)) != 0 ||
+             log->header->version != THERMO_LOG_VERSION ||
+             log->header->record_size != sizeof(thermo_log_record_s) ||
+             log->header->segment_records != THERMO_LOG_SEGMENT_RECORDS ||
+             log->header->nsegments > THERMO_LOG_MAX_SEGMENTS ||
+             st.st_size < THERMO_LOG_HEADER_SIZE + log->header->nsegments * THERMO_LOG_SEGMENT_SIZE)
+    {
+        errno = EINVAL;
+        goto err;
+    }
+    if (writable && log->header->count > (uint64_t)log->header->nsegments * THERMO_LOG_SEGMENT_RECORDS)
+    {
+        log->header->count = (uint64_t)log->header->nsegments * THERMO_LOG_SEGMENT_RECORDS; // header was torn by a crash
+    }
+    log->realtime_offset_ns = thermo_log_clock_ns(CLOCK_REALTIME) - thermo_log_clock_ns(CLOCK_MONOTONIC);
+    return log;
+err:
+    thermo_log_close(log);
+    return NULL;
+}
+
+void thermo_log_close(thermo_log_s *log)
+{
+    if (log == NULL)
+    {
+        return;
+    }
+    int err = errno; // keep the error of a failed open
+    if (log->map != NULL)
+    {
+        munmap(log->map, THERMO_LOG_SEGMENT_SIZE);
+    }
+    if (log->header != NULL)
+    {
+        munmap(log->header, THERMO_LOG_HEADER_SIZE);
+    }
+    if (log->fd >= 0)
+    {
+        close(log->fd);
+    }
+    free(log);
+    errno = err;
+}
+
+/**
+ * @brief Map segment `segment`, replacing the current mapping.
+ *
+ */
+static int thermo_log_map(thermo_log_s *log, uint32_t segment)
+{
+    if (log->segment == segment)
+    {
+        return 0;
+    }
+    if (log->map != NULL)
+    {
+        munmap(log->map, THERMO_LOG_SEGMENT_SIZE);
+        log->map = NULL;
+        log->segment = THERMO_LOG_NO_SEGMENT;
+    }
+    void *map = mmap(NULL, THERMO_LOG_SEGMENT_SIZE, PROT_READ | (log->writable ? PROT_WRITE : 0), MAP_SHARED, log->fd,
+                     THERMO_LOG_HEADER_SIZE + (off_t)segment * THERMO_LOG_SEGMENT_SIZE);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+    log->map = map;
+    log->segment = segment;
+    return 0;
+}
+
+int thermo_log_append(thermo_log_s *log, const thermal_data_ex_s *data, int count)
+{
+    if (!log->writable)
+    {
+        errno = EBADF;
+        return -1;
+    }
+    thermo_log_header_s *header = log->header;
+    for (int i = 0; i < count; i++)
+    {
+        int64_t time_ns = (int64_t)data[i].rx_time_ns + log->realtime_offset_ns;
+        uint32_t segment = header->count / THERMO_LOG_SEGMENT_RECORDS;
+        if (segment >= header->nsegments) // grow the file by a segment
+        {
+            if (segment >= THERMO_LOG_MAX_SEGMENTS)
+            {
+                errno = ENOSPC;
+                return -1;
+            }
+            if (ftruncate(log->fd, THERMO_LOG_HEADER_SIZE + (off_t)(segment + 1) * THERMO_LOG_SEGMENT_SIZE) < 0)
+            {
+                return -1;
+            }
+            header->index[segment] = time_ns;
+            header->nsegments = segment + 1;
+        }
+        if (thermo_log_map(log, segment) < 0)
+        {
+            return -1;
+        }
+        thermo_log_record_s *record = &log->map[header->count % THERMO_LOG_SEGMENT_RECORDS];
+        record->time_ns = time_ns;
+        record->source = data[i].data.source;
+        record->value = data[i].data.value;
+        record->tx_time_ms = data[i].tx_time_ms;
+        record->seq = data[i].seq;
+        record->type = data[i].data.type;
+        record->version = data[i].version;
+        atomic_thread_fence(memory_order_release); // commit the record before it is counted
+        header->count++;
+    }
+    return 0;
+}
+
+uint64_t thermo_log_count(const thermo_log_s *log)
+{
+    return log->header->count;
+}
+
+uint32_t thermo_log_segments(const thermo_log_s *log)
+{
+    return log->header->nsegments;
+}
+
+int64_t thermo_log_segment_start(const thermo_log_s *log, uint32_t segment)
+{
+    return log->header->index[segment];
+}
+
+const thermo_log_record_s *thermo_log_segment(thermo_log_s *log, uint32_t segment, uint64_t *count)
+{
+    uint64_t total = log->header->count;
+    uint64_t first = (uint64_t)segment * THERMO_LOG_SEGMENT_RECORDS;
+    if (segment >= log->header->nsegments || first >= total)
+    {
+        errno = ERANGE;
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire); // records counted by the writer are complete
+    if (thermo_log_map(log, segment) < 0)
+    {
+        return NULL;
+    }
+    *count = total - first < THERMO_LOG_SEGMENT_RECORDS ? total - first : THERMO_LOG_SEGMENT_RECORDS;
+    return log->map;
+}
+
+uint32_t thermo_log_find_segment(const thermo_log_s *log, int64_t time_ns)
+{
+    uint32_t nsegments = log->header->nsegments;
+    if (nsegments == 0)
+    {
+        return 0;
+    }
+    // Last segment starting at or before time_ns
+    uint32_t lo = 0, hi = nsegments;
+    while (hi - lo > 1)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (log->header->index[mid] <= time_ns)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file thermo_log.h
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data client for PICTURE-D: Memory-mapped, append-only log of records.
+ * @version 0.0.1
+ * @date 2025-06-16
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef THERMO_LOG_H
+#define THERMO_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <stddef.h>
+#include <stdint.h>
+#include "thermo_client.h"
+
+/**
+ * @brief Size of the file header, including the time index. A multiple of every supported page size.
+ *
+ */
+#define THERMO_LOG_HEADER_SIZE 65536
+/**
+ * @brief Number of records in a segment. The log file grows one segment (24 MiB) at a time.
+ *
+ */
+#define THERMO_LOG_SEGMENT_RECORDS (1u << 20)
+/**
+ * @brief Maximum number of segments in a log file.
+ *
+ */
+#define THERMO_LOG_MAX_SEGMENTS 4096
+
+/**
+ * @brief Fixed size record stored in the log file.
+ *
+ */
+typedef struct _thermo_log_record_s
+{
+    int64_t time_ns;     // Receive time, CLOCK_REALTIME in nanoseconds
+    uint32_t source;     // Source sensor ID
+    float value;         // Temperature in Celsius or Humidity in percentage
+    uint32_t tx_time_ms; // v2 only: acquisition time on the server, in ms since the server started
+    uint16_t seq;        // v2 only: sequence number of the batch
+    char type;           // 'T' for temperature, 'H' for humidity
+    uint8_t version;     // Wire format version of the frame
+} thermo_log_record_s;
+
+/**
+ * @brief Opaque log file handle.
+ *
+ * The writer maps the segment it appends to; readers map one segment at a time with
+ * `thermo_log_segment`. Records are never copied out of the file mapping.
+ */
+typedef struct _thermo_log_s thermo_log_s;
+
+/**
+ * @brief Open a log file.
+ *
+ * A writable log is created if it does not exist, and appended to otherwise. Records that were written
+ * but not committed to the header when the writer crashed are overwritten.
+ *
+ * @param path Path of the log file.
+ * @param writable 1 to open the log for appending, 0 to open it read-only.
+ * @return thermo_log_s* Log handle on success, NULL on failure. `errno` will be set to indicate the error.
+ */
+thermo_log_s *thermo_log_open(const char *_Nonnull path, int writable);
+
+/**
+ * @brief Unmap and close a log file.
+ *
+ * @param log The log handle. May be NULL.
+ */
+void thermo_log_close(thermo_log_s *log);
+
+/**
+ * @brief Append records to a writable log.
+ *
+ * The monotonic receive time of each record is converted to CLOCK_REALTIME, so that logs stay comparable across reboots.
+ *
+ * @param log The log handle.
+ * @param data Array of `count` records.
+ * @param count Number of records.
+ * @return int 0 on success, -1 on failure (`ENOSPC` when the log is full). `errno` will be set to indicate the error.
+ */
+int thermo_log_append(thermo_log_s *_Nonnull log, const thermal_data_ex_s *_Nonnull data, int count);
+
+/**
+ * @brief Get the number of committed records in the log.
+ *
+ * @param log The log handle.
+ * @return uint64_t Number of records.
+ */
+uint64_t thermo_log_count(const thermo_log_s *_Nonnull log);
+
+/**
+ * @brief Map a segment of the log for reading.
+ *
+ * The returned pointer stays valid until the next call to this function, or until the log is closed.
+ *
+ * @param log The log handle.
+ * @param segment Index of the segment.
+ * @param count Set to the number of committed records in the segment.
+ * @return const thermo_log_record_s* Records of the segment, NULL on failure. `errno` will be set to indicate the error.
+ */
+const thermo_log_record_s *thermo_log_segment(thermo_log_s *_Nonnull log, uint32_t segment, uint64_t *_Nonnull count);
+
+/**
+ * @brief Find the first segment that may hold records received at or after `time_ns`, using the time index in the header.
+ *
+ * @param log The log handle.
+ * @param time_ns CLOCK_REALTIME in nanoseconds.
+ * @return uint32_t Index of the segment. Equal to the number of segments if the log is empty.
+ */
+uint32_t thermo_log_find_segment(const thermo_log_s *_Nonnull log, int64_t time_ns);
+
+/**
+ * @brief Get the time of the first record of a segment, from the time index in the header.
+ *
+ * @param log The log handle.
+ * @param segment Index of the segment, less than the number of segments.
+ * @return int64_t CLOCK_REALTIME in nanoseconds.
+ */
+int64_t thermo_log_segment_start(const thermo_log_s *_Nonnull log, uint32_t segment);
+
+/**
+ * @brief Get the number of segments in the log.
+ *
+ * @param log The log handle.
+ * @return uint32_t Number of segments.
+ */
+uint32_t thermo_log_segments(const thermo_log_s *_Nonnull log);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THERMO_LOG_H
@@ -0,0 +1,306 @@
+/**
+ * @file thermo_manifest.c
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data client for PICTURE-D: Implementation of the sensor manifest and dense vectors.
+ * @version 0.0.1
+ * @date 2025-06-26
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#define _GNU_SOURCE // getline
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+
+#include "thermo_manifest.h"
+
+typedef struct
+{
+    uint64_t key; // Type and source, see thermo_manifest_key
+    size_t slot;  // Slot of the sensor
+} thermo_manifest_index_s;
+
+struct _thermo_manifest_s
+{
+    size_t count;                      // Number of sensors
+    size_t temperature;                // Number of temperature sensors
+    thermo_manifest_sensor_s *sensors; // Sensors, in slot order
+    thermo_manifest_index_s *index;    // Sensors, sorted by key
+};
+
+static inline uint64_t thermo_manifest_key(char type, uint32_t source)
+{
+    return (uint64_t)(uint8_t)type << 32 | source;
+}
+
+static int thermo_manifest_index_cmp(const void *a, const void *b)
+{
+    uint64_t ka = ((const thermo_manifest_index_s *)a)->key;
+    uint64_t kb = ((const thermo_manifest_index_s *)b)->key;
+    return ka < kb ? -1 : ka > kb;
+}
+
+thermo_manifest_s *thermo_manifest_create(const thermo_manifest_sensor_s *sensors, size_t count)
+{
+    if (count == 0 || count > INT32_MAX)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    thermo_manifest_s *manifest = calloc(1, sizeof(thermo_manifest_s));
+    if (manifest == NULL)
+    {
+        return NULL;
+    }
+    manifest->sensors = malloc(count * sizeof(thermo_manifest_sensor_s));
+    manifest->index = malloc(count * sizeof(thermo_manifest_index_s));
+    if (manifest->sensors == NULL || manifest->index == NULL)
+    {
+        thermo_manifest_destroy(manifest);
+        return NULL;
+    }
+    memcpy(manifest->sensors, sensors, count * sizeof(thermo_manifest_sensor_s));
+    manifest->count = count;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (sensors[i].type != 'T' && sensors[i].type != 'H')
+        {
+            thermo_manifest_destroy(manifest);
+            errno = EINVAL;
+            return NULL;
+        }
+        manifest->sensors[i].label[THERMO_MANIFEST_LABEL_MAX - 1] = '\0';
+        manifest->temperature += sensors[i].type == 'T';
+        manifest->index[i].key = thermo_manifest_key(sensors[i].type, sensors[i].source);
+        manifest->index[i].slot = i;
+    }
+    qsort(manifest->index, count, sizeof(thermo_manifest_index_s), thermo_manifest_index_cmp);
+    for (size_t i = 1; i < count; i++)
+    {
+        if (manifest->index[i].key == manifest->index[i - 1].key) // listed twice
+        {
+            thermo_manifest_destroy(manifest);
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+    return manifest;
+}
+
+/**
+ * @brief Parse a line of a manifest file.
+ *
+ * @return int 1 if a sensor was stored, 0 for a blank line, -1 for a malformed line.
+ */
+static int thermo_manifest_parse(char *line, thermo_manifest_sensor_s *sensor)
+{
+    char *comment = strchr(line, '#');
+    if (comment != NULL)
+    {
+        *comment = '\0';
+    }
+    char *p = line;
+    while (isspace((unsigned char)*p))
+    {
+        p++;
+    }
+    if (*p == '\0')
+    {
+        return 0;
+    }
+    memset(sensor, 0, sizeof(*sensor));
+    sensor->type = 'T';
+    char *end;
+    if (*p == '[') // thermo-ident: [Sensor N] 0x<ROM> 0x<ID>
+    {
+        p = strchr(p, ']');
+        if (p == NULL)
+        {
+            return -1;
+        }
+        p++;
+        strtoull(p, &end, 16); // the ROM is not sent by the server
+        if (end == p)
+        {
+            return -1;
+        }
+        p = end;
+    }
+    else if ((*p == 'T' || *p == 'H') && isspace((unsigned char)p[1]))
+    {
+        sensor->type = *p++;
+    }
+    errno = 0;
+    unsigned long long source = strtoull(p, &end, 16);
+    if (end == p || errno != 0 || source > UINT32_MAX || (*end != '\0' && !isspace((unsigned char)*end)))
+    {
+        return -1;
+    }
+    sensor->source = (uint32_t)source;
+    p = end;
+    while (isspace((unsigned char)*p))
+    {
+        p++;
+    }
+    size_t len = strlen(p);
+    while (len > 0 && isspace((unsigned char)p[len - 1]))
+    {
+        len--;
+    }
+    if (len >= THERMO_MANIFEST_LABEL_MAX)
+    {
+        len = THERMO_MANIFEST_LABEL_MAX - 1;
+    }
+    memcpy(sensor->label, p, len);
+    return 1;
+}
+
+thermo_manifest_s *thermo_manifest_load(const char *path, int *line)
+{
+    if (line != NULL)
+    {
+        *line = 0;
+    }
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+    thermo_manifest_sensor_s *sensors = NULL;
+    size_t count = 0, cap = 0;
+    char *buf = NULL;
+    size_t buf_len = 0;
+    int lineno = 0;
+    int err = 0;
+    while (getline(&buf, &buf_len, fp) >= 0)
+    {
+        lineno++;
+        if (count == cap)
+        {
+            cap = cap == 0 ? 64 : 2 * cap;
+            thermo_manifest_sensor_s *grown = realloc(sensors, cap * sizeof(thermo_manifest_sensor_s));
+            if (grown == NULL)
+            {
+                err = errno;
+                break;
+            }
+            sensors = grown;
+        }
+        int res = thermo_manifest_parse(buf, &sensors[count]);
+        if (res < 0)
+        {
+            if (line != NULL)
+            {
+                *line = lineno;
+            }
+            err = EINVAL;
+            break;
+        }
+        count += res;
+    }
+    if (err == 0 && ferror(fp))
+    {
+        err = EIO;
+    }
+    free(buf);
+    fclose(fp);
+    thermo_manifest_s *manifest = NULL;
+    if (err == 0)
+    {
+        manifest = thermo_manifest_create(sensors, count);
+        err = manifest == NULL ? errno : 0;
+    }
+    free(sensors);
+    errno = err;
+    return manifest;
+}
+
+void thermo_manifest_destroy(thermo_manifest_s *manifest)
+{
+    if (manifest == NULL)
+    {
+        return;
+    }
+    free(manifest->sensors);
+    free(manifest->index);
+    free(manifest);
+}
+
+size_t thermo_manifest_size(const thermo_manifest_s *manifest)
+{
+    return manifest->count;
+}
+
+size_t thermo_manifest_count(const thermo_manifest_s *manifest, char type)
+{
+    switch (type)
+    {
+    case 'T':
+        return manifest->temperature;
+    case 'H':
+        return manifest->count - manifest->temperature;
+    default:
+        return 0;
+    }
+}
+
+const thermo_manifest_sensor_s *thermo_manifest_sensor(const thermo_manifest_s *manifest, size_t slot)
+{
+    return &manifest->sensors[slot];
+}
+
+int thermo_manifest_find(const thermo_manifest_s *manifest, char type, uint32_t source, size_t hint)
+{
+    if (hint < manifest->count && manifest->sensors[hint].source == source && manifest->sensors[hint].type == type)
+    {
+        return (int)hint;
+    }
+    uint64_t key = thermo_manifest_key(type, source);
+    size_t lo = 0, hi = manifest->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (manifest->index[mid].key < key)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo < manifest->count && manifest->index[lo].key == key ? (int)manifest->index[lo].slot : -1;
+}
+
+thermo_dense_s *thermo_dense_create(const thermo_manifest_s *manifest)
+{
+    size_t count = manifest->count;
+    // One allocation: the vector, then the values, receive times and update flags
+    thermo_dense_s *dense = malloc(sizeof(thermo_dense_s) + count * (sizeof(float) + sizeof(uint64_t) + sizeof(uint8_t)));
+    if (dense == NULL)
+    {
+        return NULL;
+    }
+    dense->count = count;
+    dense->rx_time_ns = (uint64_t *)(dense + 1);
+    dense->values = (float *)(dense->rx_time_ns + count);
+    dense->updated = (uint8_t *)(dense->values + count);
+    for (size_t i = 0; i < count; i++)
+    {
+        dense->values[i] = NAN;
+    }
+    memset(dense->rx_time_ns, 0, count * sizeof(uint64_t));
+    memset(dense->updated, 0, count);
+    dense->nupdated = 0;
+    return dense;
+}
+
+void thermo_dense_destroy(thermo_dense_s *dense)
+{
+    free(dense);
+}
@@ -0,0 +1,148 @@
+/**
+ * @file thermo_manifest.h
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data client for PICTURE-D: Fixed sensor layouts, and dense decoding into index-addressed vectors.
+ * @version 0.0.1
+ * @date 2025-06-26
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef THERMO_MANIFEST_H
+#define THERMO_MANIFEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <stddef.h>
+#include <stdint.h>
+#include "thermo_client.h"
+
+#ifndef THERMO_MANIFEST_LABEL_MAX
+/**
+ * @brief Size of the label of a manifest sensor, including the terminating null byte.
+ *
+ */
+#define THERMO_MANIFEST_LABEL_MAX 32
+#endif
+
+/**
+ * @brief Sensor of a manifest.
+ *
+ */
+typedef struct _thermo_manifest_sensor_s
+{
+    char type;                              // 'T' for temperature, 'H' for humidity
+    uint32_t source;                        // Source sensor ID
+    char label[THERMO_MANIFEST_LABEL_MAX];  // Label from the manifest file, empty if none
+} thermo_manifest_sensor_s;
+
+/**
+ * @brief Dense vector of the latest value of every sensor of a manifest: sensor `i` of the manifest is in slot `i`.
+ *
+ * Filled by `thermo_client_drain_dense` and `thermo_client_read_dense`. Slots of the sensors that
+ * did not report keep their previous value, as in `thermo_table_s`.
+ */
+struct _thermo_dense_s
+{
+    size_t count;         // Number of slots, `thermo_manifest_size` of the manifest
+    float *values;        // Latest value of each slot, NAN until the sensor reported
+    uint64_t *rx_time_ns; // Receive time of the latest value of each slot, 0 until the sensor reported
+    uint8_t *updated;     // 1 for the slots updated by the last drain, 0 otherwise
+    size_t nupdated;      // Number of slots updated by the last drain
+};
+
+/**
+ * @brief Load a manifest file.
+ *
+ * Each line lists one sensor, in slot order: the type (`T` or `H`, `T` if omitted), the source sensor ID
+ * in hexadecimal, and an optional label, e.g. `T 0x132e9691 cold plate`. Sensor lines of `thermo-ident`
+ * (`[Sensor 1] 0x<ROM> 0x<ID>`) are read as temperature sensors with the last ID. Blank lines and
+ * everything after a `#` are ignored.
+ *
+ * @param path Path of the manifest file.
+ * @param line If not NULL, set to the number of the offending line when the file is malformed, 0 otherwise.
+ * @return thermo_manifest_s* Manifest on success, NULL on failure. `errno` will be set to indicate the error
+ * (`EINVAL` for a malformed line or a sensor listed twice).
+ */
+thermo_manifest_s *thermo_manifest_load(const char *_Nonnull path, int *line);
+
+/**
+ * @brief Create a manifest from a list of sensors.
+ *
+ * @param sensors Array of `count` sensors, in slot order.
+ * @param count Number of sensors.
+ * @return thermo_manifest_s* Manifest on success, NULL on failure. `errno` will be set to indicate the error
+ * (`EINVAL` for an invalid type or a sensor listed twice).
+ */
+thermo_manifest_s *thermo_manifest_create(const thermo_manifest_sensor_s *_Nonnull sensors, size_t count);
+
+/**
+ * @brief Free a manifest.
+ *
+ * @param manifest The manifest. May be NULL.
+ */
+void thermo_manifest_destroy(thermo_manifest_s *manifest);
+
+/**
+ * @brief Get the number of sensors of a manifest.
+ *
+ * @param manifest The manifest.
+ * @return size_t Number of sensors.
+ */
+size_t thermo_manifest_size(const thermo_manifest_s *_Nonnull manifest);
+
+/**
+ * @brief Get the number of sensors of a type in a manifest.
+ *
+ * @param manifest The manifest.
+ * @param type Sensor type.
+ * @return size_t Number of sensors of the type.
+ */
+size_t thermo_manifest_count(const thermo_manifest_s *_Nonnull manifest, char type);
+
+/**
+ * @brief Get a sensor of a manifest.
+ *
+ * @param manifest The manifest.
+ * @param slot Slot of the sensor, less than `thermo_manifest_size`.
+ * @return const thermo_manifest_sensor_s* The sensor.
+ */
+const thermo_manifest_sensor_s *thermo_manifest_sensor(const thermo_manifest_s *_Nonnull manifest, size_t slot);
+
+/**
+ * @brief Find the slot of a sensor.
+ *
+ * The server sends the sensors of a bus in the same order on every tick, so `hint` is checked first:
+ * pass the slot after the previous record, and the lookup is a single comparison. Otherwise the sensor
+ * is searched for in a sorted index, without hashing.
+ *
+ * @param manifest The manifest.
+ * @param type Sensor type.
+ * @param source Source sensor ID.
+ * @param hint Slot expected to hold the sensor.
+ * @return int Slot of the sensor, -1 if it is not in the manifest.
+ */
+int thermo_manifest_find(const thermo_manifest_s *_Nonnull manifest, char type, uint32_t source, size_t hint);
+
+/**
+ * @brief Create a dense vector for the sensors of a manifest.
+ *
+ * @param manifest The manifest.
+ * @return thermo_dense_s* Dense vector on success, NULL on failure. `errno` will be set to indicate the error.
+ */
+thermo_dense_s *thermo_dense_create(const thermo_manifest_s *_Nonnull manifest);
+
+/**
+ * @brief Free a dense vector.
+ *
+ * @param dense The dense vector. May be NULL.
+ */
+void thermo_dense_destroy(thermo_dense_s *dense);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THERMO_MANIFEST_H
@@ -0,0 +1,221 @@
+/**
+ * @file thermo_query.c
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data client for PICTURE-D: Implementation of the columnar queries.
+ * @version 0.0.1
+ * @date 2025-06-18
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "thermo_query.h"
+
+#define THERMO_COLUMN_ALIGN 64  // Cache line
+#define THERMO_QUERY_BLOCK 4096 // Rows summed in single precision before the sums are widened to double
+
+static void *thermo_column_alloc(size_t capacity, size_t size)
+{
+    size_t bytes = (capacity * size + THERMO_COLUMN_ALIGN - 1) & ~(size_t)(THERMO_COLUMN_ALIGN - 1);
+    return aligned_alloc(THERMO_COLUMN_ALIGN, bytes);
+}
+
+int thermo_columns_init(thermo_columns_s *columns, size_t capacity)
+{
+    memset(columns, 0, sizeof(thermo_columns_s));
+    if (capacity == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    columns->time_ns = thermo_column_alloc(capacity, sizeof(int64_t));
+    columns->source = thermo_column_alloc(capacity, sizeof(uint32_t));
+    columns->value = thermo_column_alloc(capacity, sizeof(float));
+    if (columns->time_ns == NULL || columns->source == NULL || columns->value == NULL)
+    {
+        thermo_columns_free(columns);
+        errno = ENOMEM;
+        return -1;
+    }
+    columns->capacity = capacity;
+    return 0;
+}
+
+void thermo_columns_free(thermo_columns_s *columns)
+{
+    free(columns->time_ns);
+    free(columns->source);
+    free(columns->value);
+    memset(columns, 0, sizeof(thermo_columns_s));
+}
+
+int thermo_columns_load(thermo_columns_s *columns, thermo_log_s *log, uint32_t segment, char type, int64_t start_ns, int64_t end_ns)
+{
+    columns->count = 0;
+    if (columns->capacity < THERMO_LOG_SEGMENT_RECORDS)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    uint64_t count;
+    const thermo_log_record_s *records = thermo_log_segment(log, segment, &count);
+    if (records == NULL)
+    {
+        return -1;
+    }
+    size_t rows = 0;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        const thermo_log_record_s *r = &records[i];
+        if (r->type != type || r->time_ns < start_ns || r->time_ns >= end_ns)
+        {
+            continue;
+        }
+        columns->time_ns[rows] = r->time_ns;
+        columns->source[rows] = r->source;
+        columns->value[rows] = r->value;
+        rows++;
+    }
+    columns->count = rows;
+    return 0;
+}
+
+/**
+ * @brief Reduce up to `THERMO_QUERY_BLOCK` rows into `acc`.
+ *
+ * Rows of other sensors are masked out: they add 0 to the sums and the count,
+ * and +/-infinity to the extrema.
+ */
+static void thermo_query_block(const uint32_t *source, const float *value, size_t n, uint32_t key, thermo_query_acc_s *acc)
+{
+    uint32_t count = 0;
+    float min = INFINITY, max = -INFINITY, sum = 0, sumsq = 0;
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i vkey = _mm_set1_epi32((int)key);
+    const __m128 vref = _mm_set1_ps(acc->ref);
+    const __m128 vinf = _mm_set1_ps(INFINITY), vninf = _mm_set1_ps(-INFINITY);
+    __m128 vmin = vinf, vmax = vninf, vsum = _mm_setzero_ps(), vsumsq = _mm_setzero_ps();
+    __m128i vcount = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 mask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(source + i)), vkey));
+        __m128 v = _mm_loadu_ps(value + i);
+        __m128 hit = _mm_and_ps(mask, v);
+        vmin = _mm_min_ps(vmin, _mm_or_ps(hit, _mm_andnot_ps(mask, vinf)));
+        vmax = _mm_max_ps(vmax, _mm_or_ps(hit, _mm_andnot_ps(mask, vninf)));
+        __m128 d = _mm_and_ps(mask, _mm_sub_ps(v, vref));
+        vsum = _mm_add_ps(vsum, d);
+        vsumsq = _mm_add_ps(vsumsq, _mm_mul_ps(d, d));
+        vcount = _mm_sub_epi32(vcount, _mm_castps_si128(mask)); // mask lanes are -1
+    }
+    float lmin[4], lmax[4], lsum[4], lsumsq[4];
+    uint32_t lcount[4];
+    _mm_storeu_ps(lmin, vmin);
+    _mm_storeu_ps(lmax, vmax);
+    _mm_storeu_ps(lsum, vsum);
+    _mm_storeu_ps(lsumsq, vsumsq);
+    _mm_storeu_si128((__m128i *)lcount, vcount);
+#elif defined(__ARM_NEON)
+    const uint32x4_t vkey = vdupq_n_u32(key);
+    const float32x4_t vref = vdupq_n_f32(acc->ref);
+    const float32x4_t vinf = vdupq_n_f32(INFINITY), vninf = vdupq_n_f32(-INFINITY);
+    float32x4_t vmin = vinf, vmax = vninf, vsum = vdupq_n_f32(0), vsumsq = vdupq_n_f32(0);
+    uint32x4_t vcount = vdupq_n_u32(0);
+    for (; i + 4 <= n; i += 4)
+    {
+        uint32x4_t mask = vceqq_u32(vld1q_u32(source + i), vkey);
+        float32x4_t v = vld1q_f32(value + i);
+        vmin = vminq_f32(vmin, vbslq_f32(mask, v, vinf));
+        vmax = vmaxq_f32(vmax, vbslq_f32(mask, v, vninf));
+        float32x4_t d = vreinterpretq_f32_u32(vandq_u32(mask, vreinterpretq_u32_f32(vsubq_f32(v, vref))));
+        vsum = vaddq_f32(vsum, d);
+        vsumsq = vmlaq_f32(vsumsq, d, d);
+        vcount = vsubq_u32(vcount, mask); // mask lanes are all ones
+    }
+    float lmin[4], lmax[4], lsum[4], lsumsq[4];
+    uint32_t lcount[4];
+    vst1q_f32(lmin, vmin);
+    vst1q_f32(lmax, vmax);
+    vst1q_f32(lsum, vsum);
+    vst1q_f32(lsumsq, vsumsq);
+    vst1q_u32(lcount, vcount);
+#endif
+#if defined(__SSE2__) || defined(__ARM_NEON)
+    for (int lane = 0; lane < 4; lane++)
+    {
+        min = lmin[lane] < min ? lmin[lane] : min;
+        max = lmax[lane] > max ? lmax[lane] : max;
+        sum += lsum[lane];
+        sumsq += lsumsq[lane];
+        count += lcount[lane];
+    }
+#endif
+    for (; i < n; i++) // remainder, and every row without SIMD
+    {
+        if (source[i] != key)
+        {
+            continue;
+        }
+        float v = value[i], d = v - acc->ref;
+        min = v < min ? v : min;
+        max = v > max ? v : max;
+        sum += d;
+        sumsq += d * d;
+        count++;
+    }
+    acc->min = min < acc->min ? min : acc->min;
+    acc->max = max > acc->max ? max : acc->max;
+    acc->sum += sum;
+    acc->sumsq += sumsq;
+    acc->count += count;
+}
+
+void thermo_query_reduce(const thermo_columns_s *columns, uint32_t source, thermo_query_acc_s *acc)
+{
+    size_t start = 0;
+    if (acc->count == 0) // pick the reference value
+    {
+        while (start < columns->count && columns->source[start] != source)
+        {
+            start++;
+        }
+        if (start == columns->count)
+        {
+            return;
+        }
+        acc->ref = acc->min = acc->max = columns->value[start];
+    }
+    for (size_t i = start; i < columns->count; i += THERMO_QUERY_BLOCK)
+    {
+        size_t n = columns->count - i < THERMO_QUERY_BLOCK ? columns->count - i : THERMO_QUERY_BLOCK;
+        thermo_query_block(columns->source + i, columns->value + i, n, source, acc);
+    }
+}
+
+void thermo_query_stats(const thermo_query_acc_s *acc, thermo_query_stats_s *stats)
+{
+    memset(stats, 0, sizeof(thermo_query_stats_s));
+    if (acc->count == 0)
+    {
+        return;
+    }
+    double mean = acc->sum / acc->count;
+    double var = acc->sumsq / acc->count - mean * mean;
+    stats->count = acc->count;
+    stats->min = acc->min;
+    stats->max = acc->max;
+    stats->mean = acc->ref + mean;
+    stats->stddev = var > 0 ? sqrt(var) : 0;
+}
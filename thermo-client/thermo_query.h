@@ -0,0 +1,121 @@
+/**
+ * @file thermo_query.h
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data client for PICTURE-D: Columnar queries over recorded logs.
+ * @version 0.0.1
+ * @date 2025-06-18
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef THERMO_QUERY_H
+#define THERMO_QUERY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <stddef.h>
+#include <stdint.h>
+#include "thermo_log.h"
+
+/**
+ * @brief Structure-of-arrays copy of log records. Every column is contiguous and 64-byte aligned.
+ *
+ * The log keeps whole records together, so that appending stays a single store per record.
+ * Queries transpose one segment at a time into columns, so that the reduction kernels read
+ * nothing but the `source` and `value` columns.
+ */
+typedef struct _thermo_columns_s
+{
+    size_t count;     // Number of rows
+    size_t capacity;  // Number of rows allocated
+    int64_t *time_ns; // Receive time, CLOCK_REALTIME in nanoseconds
+    uint32_t *source; // Source sensor ID
+    float *value;     // Temperature in Celsius or Humidity in percentage
+} thermo_columns_s;
+
+/**
+ * @brief Running reduction over the values of one sensor. Zero-initialize before the first use.
+ *
+ * Sums are taken relative to `ref`, the first value seen, so that the variance of readings
+ * with a large mean and a small spread does not cancel out.
+ */
+typedef struct _thermo_query_acc_s
+{
+    uint64_t count; // Number of values
+    float min;      // Smallest value
+    float max;      // Largest value
+    float ref;      // First value seen
+    double sum;     // Sum of (value - ref)
+    double sumsq;   // Sum of (value - ref)^2
+} thermo_query_acc_s;
+
+/**
+ * @brief Statistics of the values of one sensor.
+ *
+ */
+typedef struct _thermo_query_stats_s
+{
+    uint64_t count; // Number of values
+    float min;      // Smallest value
+    float max;      // Largest value
+    double mean;    // Mean value
+    double stddev;  // Population standard deviation
+} thermo_query_stats_s;
+
+/**
+ * @brief Allocate columns of `capacity` rows.
+ *
+ * @param columns Columns to initialize.
+ * @param capacity Number of rows.
+ * @return int 0 on success, -1 on failure. `errno` will be set to indicate the error.
+ */
+int thermo_columns_init(thermo_columns_s *_Nonnull columns, size_t capacity);
+
+/**
+ * @brief Free columns allocated by `thermo_columns_init`.
+ *
+ * @param columns The columns.
+ */
+void thermo_columns_free(thermo_columns_s *_Nonnull columns);
+
+/**
+ * @brief Transpose the records of type `type` received in [start_ns, end_ns) from a segment of the log into columns.
+ *
+ * The columns are cleared first, and must hold at least `THERMO_LOG_SEGMENT_RECORDS` rows.
+ *
+ * @param columns The columns.
+ * @param log The log handle.
+ * @param segment Index of the segment.
+ * @param type Record type, 'T' or 'H'.
+ * @param start_ns Start of the time window, CLOCK_REALTIME in nanoseconds.
+ * @param end_ns End of the time window, CLOCK_REALTIME in nanoseconds.
+ * @return int 0 on success, -1 on failure. `errno` will be set to indicate the error.
+ */
+int thermo_columns_load(thermo_columns_s *_Nonnull columns, thermo_log_s *_Nonnull log, uint32_t segment, char type, int64_t start_ns, int64_t end_ns);
+
+/**
+ * @brief Add the values of sensor `source` in `columns` to a running reduction.
+ *
+ * Uses SSE2 or NEON when available.
+ *
+ * @param columns The columns.
+ * @param source Source sensor ID.
+ * @param acc The running reduction.
+ */
+void thermo_query_reduce(const thermo_columns_s *_Nonnull columns, uint32_t source, thermo_query_acc_s *_Nonnull acc);
+
+/**
+ * @brief Compute the statistics of a running reduction.
+ *
+ * @param acc The running reduction.
+ * @param stats Pointer to a thermo_query_stats_s structure to store the statistics.
+ */
+void thermo_query_stats(const thermo_query_acc_s *_Nonnull acc, thermo_query_stats_s *_Nonnull stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THERMO_QUERY_H
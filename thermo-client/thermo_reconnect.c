@@ -0,0 +1,228 @@
+/**
+ * @file thermo_reconnect.c
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data client for PICTURE-D: Implementation of the reconnect manager.
+ * @version 0.0.1
+ * @date 2025-06-27
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "thermo_reconnect.h"
+
+#define THERMO_RECONNECT_POLL_MS 100 // Wake up this often to check if we should keep running
+#define THERMO_RECONNECT_MIN_MS 100  // Shortest time between two opens, unless the device node reappears
+
+struct _thermo_reconnect_s
+{
+    char *path;                     // Path of the port
+    const char *name;               // Name of the device node in its directory, within `path`
+    int inotify;                    // inotify instance watching the directory of the port, -1 if unavailable
+    int cached;                     // Set once `options` holds the port settings
+    struct termios options;         // Port settings, applied as is on every reconnect
+    uint64_t opened_ns;             // Time of the last successful open, 0 before the first one
+    thermo_reconnect_stats_s stats; // Counters
+};
+
+static uint64_t thermo_reconnect_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+thermo_reconnect_s *thermo_reconnect_create(const char *port)
+{
+    thermo_reconnect_s *reconnect = calloc(1, sizeof(thermo_reconnect_s));
+    if (reconnect == NULL)
+    {
+        return NULL;
+    }
+    reconnect->path = strdup(port);
+    if (reconnect->path == NULL)
+    {
+        free(reconnect);
+        return NULL;
+    }
+    char *slash = strrchr(reconnect->path, '/');
+    reconnect->name = slash == NULL ? reconnect->path : slash + 1;
+    // Watch the directory: the device node itself is gone while the device is away
+    char dir[4096];
+    if (slash == NULL)
+    {
+        strcpy(dir, ".");
+    }
+    else
+    {
+        size_t len = slash == reconnect->path ? 1 : (size_t)(slash - reconnect->path);
+        if (len >= sizeof(dir))
+        {
+            len = sizeof(dir) - 1;
+        }
+        memcpy(dir, reconnect->path, len);
+        dir[len] = '\0';
+    }
+    reconnect->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (reconnect->inotify >= 0 && inotify_add_watch(reconnect->inotify, dir, IN_CREATE | IN_ATTRIB | IN_MOVED_TO) < 0)
+    {
+        close(reconnect->inotify);
+        reconnect->inotify = -1; // retry every THERMO_RECONNECT_RETRY_MS instead
+    }
+    return reconnect;
+}
+
+void thermo_reconnect_destroy(thermo_reconnect_s *reconnect)
+{
+    if (reconnect == NULL)
+    {
+        return;
+    }
+    if (reconnect->inotify >= 0)
+    {
+        close(reconnect->inotify);
+    }
+    free(reconnect->path);
+    free(reconnect);
+}
+
+/**
+ * @brief Open the port once, and apply the cached settings.
+ *
+ * The settings are read from the port and flushed on the first open only, as in `thermo_client_init`.
+ *
+ * @return int Positive file descriptor on success, -1 on failure.
+ */
+static int thermo_reconnect_try(thermo_reconnect_s *reconnect)
+{
+    reconnect->stats.attempts++;
+    struct stat st;
+    if (stat(reconnect->path, &st) < 0)
+    {
+        return -1;
+    }
+    if (S_ISSOCK(st.st_mode))
+    {
+        return thermo_client_init_socket(reconnect->path);
+    }
+    int fd = open(reconnect->path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (!reconnect->cached)
+    {
+        if (tcgetattr(fd, &reconnect->options) < 0)
+        {
+            close(fd);
+            return -1;
+        }
+        thermo_client_termios(&reconnect->options);
+        tcflush(fd, TCIFLUSH); // Stale input from before the client started
+        reconnect->cached = 1;
+    }
+    if (tcsetattr(fd, TCSANOW, &reconnect->options) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Wait for up to `timeout_ms` for the device node to be created or changed.
+ *
+ * @return int 1 if the device node was notified, 0 otherwise.
+ */
+static int thermo_reconnect_wait(thermo_reconnect_s *reconnect, volatile sig_atomic_t *running, int timeout_ms)
+{
+    uint64_t deadline = thermo_reconnect_now_ns() + (uint64_t)timeout_ms * 1000000;
+    while (*running)
+    {
+        uint64_t now = thermo_reconnect_now_ns();
+        if (now >= deadline)
+        {
+            return 0;
+        }
+        int wait_ms = (deadline - now + 999999) / 1000000;
+        wait_ms = wait_ms < THERMO_RECONNECT_POLL_MS ? wait_ms : THERMO_RECONNECT_POLL_MS;
+        if (reconnect->inotify < 0)
+        {
+            struct timespec wait = {.tv_sec = 0, .tv_nsec = wait_ms * 1000000l};
+            nanosleep(&wait, NULL);
+            continue;
+        }
+        struct pollfd pfd = {.fd = reconnect->inotify, .events = POLLIN};
+        if (poll(&pfd, 1, wait_ms) <= 0)
+        {
+            continue; // Timeout, or interrupted by a signal
+        }
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        int found = 0;
+        ssize_t len;
+        while ((len = read(reconnect->inotify, buf, sizeof(buf))) > 0)
+        {
+            for (char *p = buf; p < buf + len;)
+            {
+                const struct inotify_event *event = (const struct inotify_event *)p;
+                if (event->len > 0 && strcmp(event->name, reconnect->name) == 0)
+                {
+                    reconnect->stats.events++;
+                    found = 1;
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        if (found)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int thermo_reconnect_open(thermo_reconnect_s *reconnect, volatile sig_atomic_t *running)
+{
+    uint64_t start = thermo_reconnect_now_ns();
+    // A port that was lost right after it was opened may still be going away: give it a moment
+    if (reconnect->opened_ns != 0 && start - reconnect->opened_ns < THERMO_RECONNECT_MIN_MS * 1000000ull)
+    {
+        thermo_reconnect_wait(reconnect, running, THERMO_RECONNECT_MIN_MS - (start - reconnect->opened_ns) / 1000000);
+    }
+    while (*running)
+    {
+        int fd = thermo_reconnect_try(reconnect);
+        if (fd >= 0)
+        {
+            uint64_t now = thermo_reconnect_now_ns();
+            reconnect->stats.last_wait_ns = now - start;
+            if (reconnect->stats.opens > 0 && reconnect->stats.last_wait_ns > reconnect->stats.max_wait_ns)
+            {
+                reconnect->stats.max_wait_ns = reconnect->stats.last_wait_ns;
+            }
+            reconnect->stats.opens++;
+            reconnect->opened_ns = now;
+            return fd;
+        }
+        thermo_reconnect_wait(reconnect, running, THERMO_RECONNECT_RETRY_MS);
+    }
+    errno = EINTR;
+    return -1;
+}
+
+void thermo_reconnect_get_stats(const thermo_reconnect_s *reconnect, thermo_reconnect_stats_s *stats)
+{
+    *stats = reconnect->stats;
+}
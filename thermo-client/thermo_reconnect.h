@@ -0,0 +1,96 @@
+/**
+ * @file thermo_reconnect.h
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data client for PICTURE-D: Fast reconnect to a serial port that disappears and reappears.
+ * @version 0.0.1
+ * @date 2025-06-27
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef THERMO_RECONNECT_H
+#define THERMO_RECONNECT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <stdint.h>
+#include <signal.h>
+#include "thermo_client.h"
+
+#ifndef THERMO_RECONNECT_RETRY_MS
+/**
+ * @brief Longest time between two attempts to open the port, when no hotplug notification arrives.
+ *
+ */
+#define THERMO_RECONNECT_RETRY_MS 1000
+#endif
+
+/**
+ * @brief Opaque reconnect manager of a serial port.
+ *
+ * The device node of a USB serial port (e.g. the host side of the `/dev/ttyGS0` gadget of the server)
+ * is removed when the device goes away, and created again by udev when it comes back. The manager
+ * watches the directory of the node with inotify, and opens the port as soon as the node reappears,
+ * instead of polling it every second. The port settings are read and computed on the first open only:
+ * they are applied again as is (one `tcsetattr`, no flush) on every reconnect, so the bytes the server
+ * sent right after the reconnect are kept. Unix sockets of the server are handled as well.
+ */
+typedef struct _thermo_reconnect_s thermo_reconnect_s;
+
+/**
+ * @brief Counters of a reconnect manager.
+ *
+ */
+typedef struct _thermo_reconnect_stats_s
+{
+    uint64_t opens;        // Successful opens, including the first one
+    uint64_t attempts;     // Attempts to open the port
+    uint64_t events;       // Hotplug notifications about the device node
+    uint64_t last_wait_ns; // Time spent in the last successful `thermo_reconnect_open`
+    uint64_t max_wait_ns;  // Longest time spent in a successful `thermo_reconnect_open` after the first one
+} thermo_reconnect_stats_s;
+
+/**
+ * @brief Create a reconnect manager for a serial port or server socket.
+ *
+ * If inotify is not available, the manager falls back to retrying every `THERMO_RECONNECT_RETRY_MS`.
+ *
+ * @param port The name of the serial port (e.g., "/dev/ttyACM0"), or the path of the server socket.
+ * @return thermo_reconnect_s* Reconnect manager on success, NULL on failure. `errno` will be set to indicate the error.
+ */
+thermo_reconnect_s *thermo_reconnect_create(const char *_Nonnull port);
+
+/**
+ * @brief Free a reconnect manager.
+ *
+ * @param reconnect The reconnect manager. May be NULL.
+ */
+void thermo_reconnect_destroy(thermo_reconnect_s *reconnect);
+
+/**
+ * @brief Open the port, waiting for its device node to appear if needed.
+ *
+ * Pass the file descriptor to `thermo_client_create` after the first open, and to `thermo_client_reattach`
+ * after a reconnect, so that the decoder state is kept.
+ *
+ * @param reconnect The reconnect manager.
+ * @param running Pointer to a volatile sig_atomic_t variable to indicate if the wait should continue. If this variable is set to 0, the function returns.
+ * @return int Positive file descriptor on success, -1 if `running` was cleared (`errno` is set to `EINTR`).
+ */
+int thermo_reconnect_open(thermo_reconnect_s *_Nonnull reconnect, volatile sig_atomic_t *_Nonnull running);
+
+/**
+ * @brief Get the counters of a reconnect manager.
+ *
+ * @param reconnect The reconnect manager.
+ * @param stats Pointer to a thermo_reconnect_stats_s structure to store the counters.
+ */
+void thermo_reconnect_get_stats(const thermo_reconnect_s *_Nonnull reconnect, thermo_reconnect_stats_s *_Nonnull stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THERMO_RECONNECT_H
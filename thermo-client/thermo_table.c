@@ -0,0 +1,185 @@
+/**
+ * @file thermo_table.c
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data client for PICTURE-D: Implementation of the latest value table.
+ * @version 0.0.1
+ * @date 2025-06-12
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <stdatomic.h>
+
+#include "thermo_table.h"
+
+typedef struct
+{
+    atomic_uint type;   // Sensor type, 0 if the slot is empty. Published last when a slot is claimed
+    atomic_uint source; // Source sensor ID
+    atomic_uint seq;    // Sequence counter, odd while the entry is being updated
+    float value;        // Fields below are only accessed under the sequence counter
+    uint64_t timestamp_ns;
+    uint64_t count;
+} thermo_table_entry_s; // 32 bytes, two entries per cache line
+
+struct _thermo_table_s
+{
+    size_t mask;        // Number of slots - 1
+    unsigned shift;     // 32 - log2(number of slots)
+    size_t max_sensors; // Maximum number of occupied slots
+    atomic_size_t size; // Number of occupied slots
+    thermo_table_entry_s *entries;
+};
+
+static inline size_t thermo_table_hash(const thermo_table_s *table, unsigned type, uint32_t source)
+{
+    // Fibonacci hashing, DS28EA00 IDs are already CRC32s but HDC1010 IDs are consecutive I2C addresses
+    return (uint32_t)((source ^ (type << 24)) * 2654435769u) >> table->shift;
+}
+
+thermo_table_s *thermo_table_create(size_t max_sensors)
+{
+    if (max_sensors == 0 || max_sensors > (1u << 30))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    size_t slots = 2;
+    unsigned shift = 31;
+    while (slots < 2 * max_sensors) // keep the load factor at or below 0.5
+    {
+        slots <<= 1;
+        shift--;
+    }
+    thermo_table_s *table = calloc(1, sizeof(thermo_table_s));
+    if (table == NULL)
+    {
+        return NULL;
+    }
+    table->entries = calloc(slots, sizeof(thermo_table_entry_s));
+    if (table->entries == NULL)
+    {
+        free(table);
+        return NULL;
+    }
+    table->mask = slots - 1;
+    table->shift = shift;
+    table->max_sensors = max_sensors;
+    return table;
+}
+
+void thermo_table_destroy(thermo_table_s *table)
+{
+    if (table == NULL)
+    {
+        return;
+    }
+    free(table->entries);
+    free(table);
+}
+
+/**
+ * @brief Copy an entry, retrying while the writer is updating it.
+ *
+ */
+static void thermo_table_read(const thermo_table_entry_s *entry, unsigned type, uint32_t source, thermo_sensor_s *sensor)
+{
+    unsigned start, end;
+    do
+    {
+        start = atomic_load_explicit(&entry->seq, memory_order_acquire);
+        sensor->value = entry->value;
+        sensor->timestamp_ns = entry->timestamp_ns;
+        sensor->count = entry->count;
+        atomic_thread_fence(memory_order_acquire);
+        end = atomic_load_explicit(&entry->seq, memory_order_relaxed);
+    } while (start != end || (start & 1));
+    sensor->type = (char)type;
+    sensor->source = source;
+}
+
+int thermo_table_update(thermo_table_s *table, const thermal_data_s *data, uint64_t timestamp_ns)
+{
+    unsigned type = (unsigned char)data->type;
+    size_t idx = thermo_table_hash(table, type, data->source);
+    thermo_table_entry_s *entry;
+    while (1)
+    {
+        entry = &table->entries[idx];
+        unsigned slot_type = atomic_load_explicit(&entry->type, memory_order_relaxed); // only this thread writes it
+        if (slot_type == 0)
+        {
+            if (atomic_load_explicit(&table->size, memory_order_relaxed) == table->max_sensors)
+            {
+                errno = ENOSPC;
+                return -1;
+            }
+            // Claim the slot: fill it in, then publish the key
+            entry->value = data->value;
+            entry->timestamp_ns = timestamp_ns;
+            entry->count = 1;
+            atomic_store_explicit(&entry->source, data->source, memory_order_relaxed);
+            atomic_store_explicit(&entry->type, type, memory_order_release);
+            atomic_fetch_add_explicit(&table->size, 1, memory_order_relaxed);
+            return 0;
+        }
+        if (slot_type == type && atomic_load_explicit(&entry->source, memory_order_relaxed) == data->source)
+        {
+            break;
+        }
+        idx = (idx + 1) & table->mask;
+    }
+    unsigned seq = atomic_load_explicit(&entry->seq, memory_order_relaxed);
+    atomic_store_explicit(&entry->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    entry->value = data->value;
+    entry->timestamp_ns = timestamp_ns;
+    entry->count++;
+    atomic_store_explicit(&entry->seq, seq + 2, memory_order_release);
+    return 0;
+}
+
+int thermo_table_lookup(const thermo_table_s *table, char type, uint32_t source, thermo_sensor_s *sensor)
+{
+    unsigned key = (unsigned char)type;
+    size_t idx = thermo_table_hash(table, key, source);
+    while (1)
+    {
+        const thermo_table_entry_s *entry = &table->entries[idx];
+        unsigned slot_type = atomic_load_explicit(&entry->type, memory_order_acquire);
+        if (slot_type == 0)
+        {
+            return 0; // Slots are never freed, so the probe sequence ends here
+        }
+        if (slot_type == key && atomic_load_explicit(&entry->source, memory_order_relaxed) == source)
+        {
+            thermo_table_read(entry, key, source, sensor);
+            return 1;
+        }
+        idx = (idx + 1) & table->mask;
+    }
+}
+
+size_t thermo_table_snapshot(const thermo_table_s *table, thermo_sensor_s *sensors, size_t count)
+{
+    size_t found = 0;
+    for (size_t idx = 0; idx <= table->mask && found < count; idx++)
+    {
+        const thermo_table_entry_s *entry = &table->entries[idx];
+        unsigned slot_type = atomic_load_explicit(&entry->type, memory_order_acquire);
+        if (slot_type == 0)
+        {
+            continue;
+        }
+        thermo_table_read(entry, slot_type, atomic_load_explicit(&entry->source, memory_order_relaxed), &sensors[found++]);
+    }
+    return found;
+}
+
+size_t thermo_table_size(const thermo_table_s *table)
+{
+    return atomic_load_explicit(&table->size, memory_order_relaxed);
+}
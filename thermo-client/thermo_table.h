@@ -0,0 +1,119 @@
+/**
+ * @file thermo_table.h
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Temperature and Humidity data client for PICTURE-D: Latest value table, keyed by sensor.
+ * @version 0.0.1
+ * @date 2025-06-12
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef THERMO_TABLE_H
+#define THERMO_TABLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <stddef.h>
+#include <stdint.h>
+#include "thermo_client.h"
+
+/**
+ * @brief Opaque latest value table. Open addressing hash table keyed by (type, source).
+ *
+ * The table has a single writer (the thread decoding frames) and any number of readers.
+ * Readers never block the writer: every entry is protected by a sequence counter, and a
+ * reader retries if the entry was updated while it was being copied.
+ */
+typedef struct _thermo_table_s thermo_table_s;
+
+/**
+ * @brief Snapshot of a table entry.
+ *
+ */
+typedef struct _thermo_sensor_s
+{
+    char type;             // 'T' for temperature, 'H' for humidity
+    uint32_t source;       // Source sensor ID
+    float value;           // Last value
+    uint64_t timestamp_ns; // Time of the last update, as passed to `thermo_table_update`
+    uint64_t count;        // Number of updates
+} thermo_sensor_s;
+
+/**
+ * @brief Create a latest value table.
+ *
+ * @param max_sensors Maximum number of sensors that can be stored. The table is sized to stay at most half full.
+ * @return thermo_table_s* Table on success, NULL on failure. `errno` will be set to indicate the error.
+ */
+thermo_table_s *thermo_table_create(size_t max_sensors);
+
+/**
+ * @brief Free a latest value table.
+ *
+ * @param table The table. May be NULL.
+ */
+void thermo_table_destroy(thermo_table_s *table);
+
+/**
+ * @brief Store a record as the latest value of its sensor. Must only be called from a single thread.
+ *
+ * @param table The table.
+ * @param data The record.
+ * @param timestamp_ns Time of the record, e.g. `CLOCK_MONOTONIC` in nanoseconds.
+ * @return int 0 on success, -1 if the table is full (`errno` is set to `ENOSPC`).
+ */
+int thermo_table_update(thermo_table_s *_Nonnull table, const thermal_data_s *_Nonnull data, uint64_t timestamp_ns);
+
+/**
+ * @brief Look up the latest value of a sensor. Safe to call from any thread.
+ *
+ * @param table The table.
+ * @param type Sensor type.
+ * @param source Source sensor ID.
+ * @param sensor Pointer to a thermo_sensor_s structure to store the entry.
+ * @return int 1 if the sensor was found, 0 otherwise.
+ */
+int thermo_table_lookup(const thermo_table_s *_Nonnull table, char type, uint32_t source, thermo_sensor_s *_Nonnull sensor);
+
+/**
+ * @brief Copy every entry of the table. Safe to call from any thread.
+ *
+ * Each entry is consistent, but entries may be updated between being copied.
+ *
+ * @param table The table.
+ * @param sensors Array of at least `count` thermo_sensor_s structures to store the entries.
+ * @param count Maximum number of entries to copy.
+ * @return size_t Number of entries stored in `sensors`.
+ */
+size_t thermo_table_snapshot(const thermo_table_s *_Nonnull table, thermo_sensor_s *_Nonnull sensors, size_t count);
+
+/**
+ * @brief Check if a sensor is stale, i.e. it was not updated for longer than `timeout_ns`.
+ *
+ * When the server only reports changes, a sensor that is not stale still holds its current value.
+ *
+ * @param sensor Snapshot of the sensor.
+ * @param now_ns Current time, on the clock of the `timestamp_ns` passed to `thermo_table_update`.
+ * @param timeout_ns Staleness timeout, e.g. `THERMO_CLIENT_HEARTBEAT_MS` in nanoseconds.
+ * @return int 1 if the sensor is stale, 0 otherwise.
+ */
+static inline int thermo_sensor_stale(const thermo_sensor_s *_Nonnull sensor, uint64_t now_ns, uint64_t timeout_ns)
+{
+    return now_ns > sensor->timestamp_ns && now_ns - sensor->timestamp_ns > timeout_ns;
+}
+
+/**
+ * @brief Get the number of sensors stored in the table.
+ *
+ * @param table The table.
+ * @return size_t Number of sensors.
+ */
+size_t thermo_table_size(const thermo_table_s *_Nonnull table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THERMO_TABLE_H
@@ -0,0 +1,340 @@
+use std::{
+    sync::{
+        Arc, Condvar, Mutex, MutexGuard,
+        atomic::{AtomicBool, AtomicUsize, Ordering},
+        mpsc::RecvTimeoutError,
+    },
+    time::{Duration, Instant},
+};
+
+use crate::{
+    Measurement,
+    data_format::MAX_ENCODED_LEN,
+    metrics::{self, SERIAL_SOURCE, Stage},
+    safe_mpsc,
+};
+
+#[derive(Debug)]
+struct State {
+    slots: Vec<Vec<u8>>, // Batch `n` is in slot `n % capacity`
+    next: u64,           // Sequence number of the next batch
+    closed: bool,
+}
+
+/// Ring of the last encoded batches, written by the encoder and read by any number of [`Subscriber`]s.
+///
+/// Every batch is encoded once, and copied into a slot allocated up front, so that publishing does not
+/// allocate. Subscribers copy the batch out under the lock into a buffer of their own. The encoder never
+/// waits for a subscriber: one that falls more than the ring length behind skips the batches it missed.
+#[derive(Debug)]
+pub struct Ring {
+    state: Mutex<State>,
+    published: Condvar,
+    capacity: usize,
+    slot_len: usize,
+    subscribers: AtomicUsize,
+}
+
+impl Ring {
+    /// Create a ring holding the last `capacity` batches of the encoder, which are up to `batch_max` bytes
+    /// and the measurement that fills them.
+    pub fn new(capacity: usize, batch_max: usize) -> Arc<Self> {
+        let capacity = capacity.max(1);
+        let slot_len = batch_max + MAX_ENCODED_LEN;
+        Arc::new(Self {
+            state: Mutex::new(State {
+                slots: (0..capacity)
+                    .map(|_| Vec::with_capacity(slot_len))
+                    .collect(),
+                next: 0,
+                closed: false,
+            }),
+            published: Condvar::new(),
+            capacity,
+            slot_len,
+            subscribers: AtomicUsize::new(0),
+        })
+    }
+
+    fn lock(&self) -> MutexGuard<'_, State> {
+        self.state.lock().unwrap_or_else(|e| e.into_inner())
+    }
+
+    /// Publish a batch, overwriting the oldest one if the ring is full.
+    pub fn publish(&self, batch: &[u8]) {
+        let mut state = self.lock();
+        let slot = (state.next % self.capacity as u64) as usize;
+        let slot = &mut state.slots[slot];
+        slot.clear();
+        slot.extend_from_slice(batch);
+        state.next += 1;
+        drop(state);
+        self.published.notify_all();
+    }
+
+    /// Tell the subscribers that nothing more will be published.
+    pub fn close(&self) {
+        self.lock().closed = true;
+        self.published.notify_all();
+    }
+
+    /// Receive the batches published from now on.
+    pub fn subscribe(self: &Arc<Self>) -> Subscriber {
+        self.subscribers.fetch_add(1, Ordering::Relaxed);
+        let next = self.lock().next;
+        Subscriber {
+            ring: self.clone(),
+            next,
+            skipped: 0,
+        }
+    }
+
+    /// Number of live subscribers.
+    pub fn subscribers(&self) -> usize {
+        self.subscribers.load(Ordering::Relaxed)
+    }
+}
+
+/// Reader of a [`Ring`], with its own position.
+#[derive(Debug)]
+pub struct Subscriber {
+    ring: Arc<Ring>,
+    next: u64, // Sequence number of the next batch to read
+    skipped: u64,
+}
+
+impl Subscriber {
+    /// Wait for the next batch, and copy it into `batch`. Batches that were overwritten before this
+    /// subscriber got to them are skipped.
+    ///
+    /// `batch` does not grow once it holds [`Self::slot_len`] bytes.
+    pub fn recv_timeout(
+        &mut self,
+        batch: &mut Vec<u8>,
+        timeout: Duration,
+    ) -> Result<(), RecvTimeoutError> {
+        let deadline = Instant::now() + timeout;
+        let capacity = self.ring.capacity as u64;
+        let mut state = self.ring.lock();
+        loop {
+            let oldest = state.next.saturating_sub(capacity);
+            if self.next < oldest {
+                self.skipped += oldest - self.next;
+                self.next = oldest;
+            }
+            if self.next < state.next {
+                batch.clear();
+                batch.extend_from_slice(&state.slots[(self.next % capacity) as usize]);
+                self.next += 1;
+                return Ok(());
+            }
+            if state.closed {
+                return Err(RecvTimeoutError::Disconnected);
+            }
+            let now = Instant::now();
+            if now >= deadline {
+                return Err(RecvTimeoutError::Timeout);
+            }
+            state = self
+                .ring
+                .published
+                .wait_timeout(state, deadline - now)
+                .unwrap_or_else(|e| e.into_inner())
+                .0;
+        }
+    }
+
+    /// Size of the longest batch stored without allocating, to size the buffer passed to [`Self::recv_timeout`].
+    pub fn slot_len(&self) -> usize {
+        self.ring.slot_len
+    }
+
+    /// Batches skipped because this subscriber fell behind.
+    pub fn skipped(&self) -> u64 {
+        self.skipped
+    }
+}
+
+impl Drop for Subscriber {
+    fn drop(&mut self) {
+        self.ring.subscribers.fetch_sub(1, Ordering::Relaxed);
+    }
+}
+
+/// Encode the measurements into batches, and publish them to the consumers in `ring`.
+///
+/// Measurements are only accepted while the ring has subscribers, so that the sensor buses see the
+/// same back pressure as with a single serial port.
+pub fn encoder_thread(
+    running: Arc<AtomicBool>,
+    source: safe_mpsc::SafeReceiver<(Instant, Measurement)>,
+    ring: Arc<Ring>,
+    wire_v2: bool,
+    batch_window: Duration,
+    batch_max: usize,
+) {
+    log::info!("[COM] Encoder thread started");
+    // v2 frames carry a sequence number and the acquisition time relative to this epoch, kept across reconnects
+    let epoch = Instant::now();
+    let mut seq = 0u16;
+    // Room for a full block and the measurement that fills it, so that the block never grows
+    let mut block = Vec::with_capacity(batch_max + MAX_ENCODED_LEN);
+    let mut dropped = 0;
+    let mut ready = false;
+    let queue_delay = metrics::histogram(Stage::QueueDelay, SERIAL_SOURCE);
+    source.set_ready(false);
+    while running.load(Ordering::Relaxed) {
+        if ready != (ring.subscribers() > 0) {
+            ready = !ready;
+            source.set_ready(ready); // here we are ready to receive data from various streams
+            if ready {
+                log::info!("[COM] Sink is ready to receive data");
+            } else {
+                log::info!("[COM] No consumers left, measurements are not queued");
+            }
+        }
+        let wait = if ready {
+            Duration::from_secs(2)
+        } else {
+            Duration::from_millis(100)
+        };
+        let first = match source.recv_timeout_delay(wait) {
+            Ok((samp, delay)) => {
+                queue_delay.record(delay);
+                samp
+            }
+            Err(RecvTimeoutError::Timeout) => {
+                if ready {
+                    log::warn!("[COM] Timeout while waiting for data");
+                }
+                continue;
+            }
+            Err(RecvTimeoutError::Disconnected) => {
+                log::warn!("[COM] Data source disconnected");
+                break;
+            }
+        };
+        // Collect everything that arrives within the batch window, or until the block is full,
+        // so that a tick of every sensor thread goes out in one write and one flush
+        block.clear();
+        let deadline = Instant::now() + batch_window;
+        let mut next = Some(first);
+        let mut disconnected = false;
+        while let Some((acquired, samp)) = next.take() {
+            // Diagnostics only exist as v2 frames, which a v1 client tells apart by the version byte
+            if wire_v2 || matches!(samp, Measurement::Diagnostics(_)) {
+                samp.write_v2_bytes(
+                    &mut block,
+                    &mut seq,
+                    acquired.saturating_duration_since(epoch).as_millis() as u32,
+                );
+            } else {
+                samp.write_le_bytes(&mut block);
+            }
+            if block.len() >= batch_max {
+                break;
+            }
+            match source.recv_timeout_delay(deadline.saturating_duration_since(Instant::now())) {
+                Ok((samp, delay)) => {
+                    queue_delay.record(delay);
+                    next = Some(samp);
+                }
+                Err(RecvTimeoutError::Timeout) => {}
+                Err(RecvTimeoutError::Disconnected) => {
+                    log::warn!("[COM] Data source disconnected");
+                    disconnected = true;
+                }
+            }
+        }
+        ring.publish(&block);
+        if disconnected {
+            break;
+        }
+        let stats = source.stats();
+        if stats.dropped != dropped {
+            log::warn!(
+                "[COM] Dropped {} measurements ({} total, {} coalesced), queue depth {}/{} (max {})",
+                stats.dropped - dropped,
+                stats.dropped,
+                stats.coalesced,
+                stats.depth,
+                source.capacity(),
+                stats.max_depth
+            );
+            dropped = stats.dropped;
+        }
+    }
+    ring.close();
+    log::info!("[COM] Encoder thread exiting");
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn test_subscriber_order() {
+        let ring = Ring::new(4, 16);
+        ring.publish(&[0]); // published before the subscriber, not received
+        let mut sub = ring.subscribe();
+        let mut batch = Vec::with_capacity(sub.slot_len());
+        for i in 1..4u8 {
+            ring.publish(&[i, i]);
+        }
+        for i in 1..4u8 {
+            sub.recv_timeout(&mut batch, Duration::ZERO).unwrap();
+            assert_eq!(batch, [i, i]);
+        }
+        assert_eq!(sub.skipped(), 0);
+        assert_eq!(
+            sub.recv_timeout(&mut batch, Duration::from_millis(10)),
+            Err(RecvTimeoutError::Timeout)
+        );
+    }
+
+    #[test]
+    fn test_subscriber_skip() {
+        let ring = Ring::new(4, 16);
+        let mut sub = ring.subscribe();
+        let mut batch = Vec::new();
+        for i in 0..10u8 {
+            ring.publish(&[i]);
+        }
+        // Only the last 4 batches are left
+        for i in 6..10u8 {
+            sub.recv_timeout(&mut batch, Duration::ZERO).unwrap();
+            assert_eq!(batch, [i]);
+        }
+        assert_eq!(sub.skipped(), 6);
+        ring.publish(&[10]);
+        sub.recv_timeout(&mut batch, Duration::ZERO).unwrap();
+        assert_eq!(batch, [10]);
+        assert_eq!(sub.skipped(), 6);
+        ring.close();
+        assert_eq!(
+            sub.recv_timeout(&mut batch, Duration::from_millis(10)),
+            Err(RecvTimeoutError::Disconnected)
+        );
+        assert_eq!(ring.subscribers(), 1);
+        drop(sub);
+        assert_eq!(ring.subscribers(), 0);
+    }
+
+    #[test]
+    fn test_publish_reuses_slots() {
+        let ring = Ring::new(3, 16);
+        let slots = |ring: &Ring| {
+            ring.lock()
+                .slots
+                .iter()
+                .map(|slot| slot.as_ptr())
+                .collect::<Vec<_>>()
+        };
+        let before = slots(&ring);
+        let full = vec![0xa5; 16 + MAX_ENCODED_LEN];
+        for _ in 0..10 {
+            ring.publish(&full);
+        }
+        assert_eq!(slots(&ring), before);
+    }
+}
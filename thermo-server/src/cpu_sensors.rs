@@ -1,36 +1,54 @@
-use std::{
-    sync::{
-        Arc,
-        atomic::{AtomicBool, Ordering},
-    },
-    thread,
-    time::{Duration, Instant},
+use std::time::{Duration, Instant};
+
+use crate::{
+    Measurement,
+    data_format::Readings,
+    safe_mpsc,
+    scheduler::{Job, Step},
 };
 
-use crate::{Measurement, safe_mpsc};
+/// CPU temperature readout, run by the scheduler.
+pub struct CpuSensors {
+    sink: safe_mpsc::SafeSender<(Instant, Measurement)>,
+    components: sysinfo::Components,
+}
+
+impl CpuSensors {
+    pub fn new(sink: safe_mpsc::SafeSender<(Instant, Measurement)>) -> Self {
+        Self {
+            sink,
+            // The component list is built once, and only the temperatures are refreshed every tick
+            components: sysinfo::Components::new_with_refreshed_list(),
+        }
+    }
+}
 
-pub fn cputemp_thread(running: Arc<AtomicBool>, sink: safe_mpsc::SafeSender<Measurement>) {
-    while running.load(Ordering::Relaxed) {
-        let start = Instant::now();
-        let components = sysinfo::Components::new_with_refreshed_list();
-        let mut meas = components
+impl Job for CpuSensors {
+    fn name(&self) -> &str {
+        "cpu"
+    }
+
+    fn period(&self) -> Duration {
+        Duration::from_secs(1)
+    }
+
+    fn run(&mut self, tick: Instant) -> Step {
+        self.components.refresh(false);
+        let meas = self
+            .components
             .iter()
             .enumerate()
             .filter_map(|(idx, component)| component.temperature().map(|temp| (idx as u32, temp)))
-            .collect::<Vec<_>>();
-        meas.truncate(10); // Limit to 10 measurements
+            .take(10) // Limit to 10 measurements
+            .collect::<Readings>();
         if !meas.is_empty() {
             let measurement = Measurement::Temperature(meas);
-            if let Err(e) = sink.send(measurement) {
-                log::error!("[CPU] Failed to send measurement: {e:?}");
-                continue; // we are probably shutting down
+            if let Err(e) = self.sink.send((tick, measurement)) {
+                log::error!("[CPU] Failed to send measurement: {e:?}"); // we are probably shutting down
             }
         } else {
             log::warn!("[CPU] No temperature data available");
         }
-        let elapsed = start.elapsed();
-        if elapsed < Duration::from_secs(1) {
-            thread::sleep(Duration::from_secs(1) - elapsed);
-        }
+        Step::Idle
     }
 }
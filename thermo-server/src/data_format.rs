@@ -1,30 +1,189 @@
+use std::ops::Deref;
+
+use crate::{
+    metrics::{HIST_BUCKETS, HistogramSnapshot},
+    safe_mpsc::Coalesce,
+};
+
+/// Most readings in a measurement. Buses with more sensors send them in several measurements.
+pub const MAX_READINGS: usize = 16;
+
+/// Fixed-capacity list of (sensor ID, value) readings, so that measurements are built and
+/// queued without allocating.
+#[derive(Debug, Clone, Copy)]
+pub struct Readings {
+    len: usize,
+    data: [(u32, f32); MAX_READINGS],
+}
+
+impl Readings {
+    pub const fn new() -> Self {
+        Self {
+            len: 0,
+            data: [(0, 0.0); MAX_READINGS],
+        }
+    }
+
+    /// Append a reading. Returns `false` if the list is full, and the reading is dropped.
+    pub fn push(&mut self, id: u32, value: f32) -> bool {
+        if self.len == MAX_READINGS {
+            return false;
+        }
+        self.data[self.len] = (id, value);
+        self.len += 1;
+        true
+    }
+}
+
+impl Default for Readings {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Deref for Readings {
+    type Target = [(u32, f32)];
+
+    fn deref(&self) -> &Self::Target {
+        &self.data[..self.len]
+    }
+}
+
+impl FromIterator<(u32, f32)> for Readings {
+    /// Collect up to [`MAX_READINGS`] readings, dropping the rest.
+    fn from_iter<I: IntoIterator<Item = (u32, f32)>>(iter: I) -> Self {
+        let mut readings = Self::new();
+        for (id, value) in iter.into_iter().take(MAX_READINGS) {
+            readings.push(id, value);
+        }
+        readings
+    }
+}
+
 #[derive(Debug, Clone)]
 pub enum Measurement {
-    Temperature(Vec<(u32, f32)>),
-    Humidity(Vec<(u32, f32)>),
+    Temperature(Readings),
+    Humidity(Readings),
+    /// Latency histograms of the hot paths, see [`crate::metrics`].
+    Diagnostics(Vec<HistogramSnapshot>),
 }
 
+impl Coalesce for Measurement {
+    /// A measurement supersedes an older one of the same kind that has no sensor it lacks, e.g. the
+    /// previous reading of the same bus.
+    fn supersedes(&self, older: &Self) -> bool {
+        match (self, older) {
+            (Measurement::Temperature(new), Measurement::Temperature(old))
+            | (Measurement::Humidity(new), Measurement::Humidity(old)) => old
+                .iter()
+                .all(|(id, _)| new.iter().any(|(new_id, _)| new_id == id)),
+            _ => false,
+        }
+    }
+}
+
+/// Magic number that starts every v2 frame. A v1 frame has a `,` after it instead of the version.
+pub const V2_MAGIC: &[u8; 5] = b"CHRIS";
+/// Version byte of the v2 wire format.
+pub const V2_VERSION: u8 = 2;
+/// Magic (5), version (1), type (1), count (1), sequence number (2), timestamp (4).
+pub const V2_HEADER_LEN: usize = 14;
+/// CRC32 of the header and the measurements.
+pub const V2_CRC_LEN: usize = 4;
+/// Type byte of a v2 diagnostics frame.
+pub const V2_DIAG_TYPE: u8 = b'D';
+/// Source (4), stage (1), bucket count (1), reserved (2), count (4), max (4), sum (8), buckets (4 each).
+pub const V2_DIAG_RECORD_LEN: usize = 24 + 4 * HIST_BUCKETS;
+/// Most histograms in a diagnostics frame.
+pub const V2_DIAG_MAX_RECORDS: usize = 16;
+/// Largest encoding of a measurement, in either wire format (v1, 16 bytes per reading).
+pub const MAX_ENCODED_LEN: usize = 16 * MAX_READINGS;
+const _: () = assert!(V2_HEADER_LEN + 8 * MAX_READINGS + V2_CRC_LEN <= MAX_ENCODED_LEN);
+
 impl Measurement {
-    pub fn to_le_bytes(&self) -> Vec<u8> {
-        match self {
-            Measurement::Temperature(data) => {
-                let mut bytes = Vec::with_capacity(16 * data.len()); // 4 bytes for u32 id, 4 bytes for f32 value
-                for (id, temp) in data {
-                    bytes.extend_from_slice(b"CHRIS,T,"); // Magic number for identification
-                    bytes.extend_from_slice(&id.to_le_bytes());
-                    bytes.extend_from_slice(&temp.to_le_bytes());
+    /// Append the measurement to `bytes` in the v1 wire format: one 16 byte frame per measurement.
+    ///
+    /// Diagnostics have no v1 encoding, and are left out: they are always sent as v2 frames.
+    pub fn write_le_bytes(&self, bytes: &mut Vec<u8>) {
+        let (magic, data) = match self {
+            Measurement::Temperature(data) => (b"CHRIS,T,", data), // Magic number for identification
+            Measurement::Humidity(data) => (b"CHRIS,H,", data),
+            Measurement::Diagnostics(_) => return,
+        };
+        bytes.reserve(16 * data.len()); // 4 bytes for u32 id, 4 bytes for f32 value
+        for (id, value) in data.iter() {
+            bytes.extend_from_slice(magic);
+            bytes.extend_from_slice(&id.to_le_bytes());
+            bytes.extend_from_slice(&value.to_le_bytes());
+        }
+    }
+
+    /// Append the measurement to `bytes` in the v2 wire format: one header per batch, packed (id, value) pairs, then a CRC.
+    ///
+    /// Layout (little endian):
+    /// `CHRIS` | version `2` | type `T`/`H` | count `u8` | sequence `u16` | timestamp `u32` (ms) | count x (`u32` id, `f32` value) | CRC32
+    ///
+    /// The timestamp is the acquisition time of the measurement, in ms since the serial thread started.
+    /// The CRC32 (IEEE) covers everything before it. Batches of more than 255 measurements are split
+    /// into several frames, each taking the next sequence number from `seq`.
+    ///
+    /// Diagnostics frames have the type `D`, and carry count x ([`V2_DIAG_RECORD_LEN`] bytes) histograms
+    /// instead of the (id, value) pairs:
+    /// source `u32` | stage `u8` | bucket count `u8` | reserved `u16` | samples `u32` | max `u32` (µs) | sum `u64` (µs) | buckets x `u32`
+    ///
+    /// Bucket `i` counts the samples in `[2^i, 2^(i+1))` µs. Frames hold at most [`V2_DIAG_MAX_RECORDS`] histograms.
+    pub fn write_v2_bytes(&self, bytes: &mut Vec<u8>, seq: &mut u16, timestamp_ms: u32) {
+        let (kind, data) = match self {
+            Measurement::Temperature(data) => (b'T', data),
+            Measurement::Humidity(data) => (b'H', data),
+            Measurement::Diagnostics(hists) => {
+                bytes.reserve(
+                    (V2_HEADER_LEN + V2_CRC_LEN) * hists.len().div_ceil(V2_DIAG_MAX_RECORDS)
+                        + V2_DIAG_RECORD_LEN * hists.len(),
+                );
+                for chunk in hists.chunks(V2_DIAG_MAX_RECORDS) {
+                    let start = bytes.len();
+                    write_v2_header(bytes, V2_DIAG_TYPE, chunk.len() as u8, *seq, timestamp_ms);
+                    for hist in chunk {
+                        bytes.extend_from_slice(&hist.source.to_le_bytes());
+                        bytes.push(hist.stage as u8);
+                        bytes.push(HIST_BUCKETS as u8);
+                        bytes.extend_from_slice(&[0, 0]);
+                        bytes.extend_from_slice(&hist.count.to_le_bytes());
+                        bytes.extend_from_slice(&hist.max_us.to_le_bytes());
+                        bytes.extend_from_slice(&hist.sum_us.to_le_bytes());
+                        for bucket in hist.buckets {
+                            bytes.extend_from_slice(&bucket.to_le_bytes());
+                        }
+                    }
+                    let crc = crc32fast::hash(&bytes[start..]);
+                    bytes.extend_from_slice(&crc.to_le_bytes());
+                    *seq = seq.wrapping_add(1);
                 }
-                bytes
+                return;
             }
-            Measurement::Humidity(data) => {
-                let mut bytes = Vec::with_capacity(16 * data.len()); // 4 bytes for u32 id, 4 bytes for f32 value
-                for (id, temp) in data {
-                    bytes.extend_from_slice(b"CHRIS,H,"); // Magic number for identification
-                    bytes.extend_from_slice(&id.to_le_bytes());
-                    bytes.extend_from_slice(&temp.to_le_bytes());
-                }
-                bytes
+        };
+        let frames = data.len().div_ceil(u8::MAX as usize);
+        bytes.reserve((V2_HEADER_LEN + V2_CRC_LEN) * frames + 8 * data.len());
+        for chunk in data.chunks(u8::MAX as usize) {
+            let start = bytes.len();
+            write_v2_header(bytes, kind, chunk.len() as u8, *seq, timestamp_ms);
+            for (id, value) in chunk {
+                bytes.extend_from_slice(&id.to_le_bytes());
+                bytes.extend_from_slice(&value.to_le_bytes());
             }
+            let crc = crc32fast::hash(&bytes[start..]);
+            bytes.extend_from_slice(&crc.to_le_bytes());
+            *seq = seq.wrapping_add(1);
         }
     }
 }
+
+fn write_v2_header(bytes: &mut Vec<u8>, kind: u8, count: u8, seq: u16, timestamp_ms: u32) {
+    bytes.extend_from_slice(V2_MAGIC);
+    bytes.push(V2_VERSION);
+    bytes.push(kind);
+    bytes.push(count);
+    bytes.extend_from_slice(&seq.to_le_bytes());
+    bytes.extend_from_slice(&timestamp_ms.to_le_bytes());
+}
@@ -1,28 +1,136 @@
 use std::{
     path::PathBuf,
-    sync::{
-        Arc,
-        atomic::{AtomicBool, Ordering},
-    },
+    sync::Arc,
     time::{Duration, Instant},
 };
 
-use hdc1010::{Hdc1010Builder, SlaveAddress as H10SlaveAddress, Trigger};
+use embedded_hal::i2c::{I2c, SevenBitAddress};
+use hdc1010::{Both, Hdc1010, Hdc1010Builder, Separate, SlaveAddress as H10SlaveAddress, Trigger};
+use hdc3022::{AutoMeasurement, MeasurementRate, SlaveAddress as H30SlaveAddress};
 use linux_embedded_hal::{Delay, I2cdev};
 
-use crate::{Measurement, safe_mpsc};
+use crate::{
+    Measurement,
+    data_format::Readings,
+    metrics::{self, Histogram, Stage},
+    safe_mpsc,
+    sampling::{Deadband, Sampling},
+    scheduler::{Job, Step},
+};
+
+/// Delay before retrying after an error
+const RETRY_DELAY: Duration = Duration::from_secs(1);
+
+/// An HDC1010 sensor.
+enum Hdc10 {
+    /// Measures humidity only, sent with the I2C address as the ID.
+    Separate(Hdc1010<Separate>),
+    /// Measures temperature and humidity in one conversion, sent with the ID derived from the serial number.
+    Both(Hdc1010<Both>, u32),
+}
+
+impl Hdc10 {
+    fn get_address(&self) -> u8 {
+        match self {
+            Hdc10::Separate(hdc) => hdc.get_address(),
+            Hdc10::Both(hdc, _) => hdc.get_address(),
+        }
+    }
+
+    fn trigger<T: I2c<SevenBitAddress>>(
+        &mut self,
+        i2c: &mut T,
+    ) -> Result<Duration, hdc1010::Error<T::Error>> {
+        match self {
+            Hdc10::Separate(hdc) => hdc.trigger(i2c, Trigger::Humidity),
+            Hdc10::Both(hdc, _) => hdc.trigger(i2c),
+        }
+    }
+
+    /// Read the measurement back, as humidity and, in combined mode, temperature with the ID of the sensor.
+    fn read<T: I2c<SevenBitAddress>>(
+        &mut self,
+        i2c: &mut T,
+    ) -> Result<(u32, f32, Option<f32>), hdc1010::Error<T::Error>> {
+        match self {
+            Hdc10::Separate(hdc) => {
+                let hum = hdc.read_humidity(i2c)?;
+                Ok((hdc.get_address() as u32, hum.percentage(), None))
+            }
+            Hdc10::Both(hdc, id) => {
+                let (temp, hum) = hdc.read_temperature_humidity(i2c)?;
+                Ok((*id, hum.percentage(), Some(temp.celsius())))
+            }
+        }
+    }
+}
 
-pub fn humidity_thread(
+/// An I2C bus and the HDC1010 and HDC3022 sensors on it.
+struct Devices {
+    i2c: I2cdev,
+    hdc10s: Vec<Hdc10>,
+    hdc30s: Vec<(AutoMeasurement, u32)>, // With the ID derived from the serial number
+}
+
+/// Humidity readout of one I2C bus, run by the scheduler.
+///
+/// HDC3022 sensors measure on their own in auto-measurement mode, and every tick reads their latest
+/// humidity and temperature in one transfer each. HDC1010 sensors are triggered every tick, and read back
+/// once the longest conversion is done. The worker is free for other buses in between.
+pub struct HumidityBus {
     path: PathBuf,
-    running: Arc<AtomicBool>,
-    sink: safe_mpsc::SafeSender<Measurement>,
-) {
-    let lpath = path.to_string_lossy();
-    'root: while running.load(Ordering::Relaxed) {
-        log::info!("[HUM] {lpath}> Opening bus");
+    lpath: String,
+    sink: safe_mpsc::SafeSender<(Instant, Measurement)>,
+    sampling: Sampling,
+    deadband: Deadband,
+    temp_deadband: Deadband,
+    combined: bool, // Run the HDC1010 sensors in combined temperature and humidity mode
+    pending: Readings, // Humidity read on this tick, waiting for the HDC1010 sensors
+    pending_temps: Readings, // Temperature read on this tick
+    devices: Option<Devices>, // None until the bus is set up
+    triggered: Option<Instant>, // Start of the measurement in progress
+    read_time: Arc<Histogram>,
+}
 
-        // Open the I2C busString
-        let mut i2c = I2cdev::new(&path).expect("Failed to open I2C device");
+impl HumidityBus {
+    pub fn new(
+        path: PathBuf,
+        sink: safe_mpsc::SafeSender<(Instant, Measurement)>,
+        sampling: Sampling,
+        temp_deadband: f32,
+        combined: bool,
+    ) -> Self {
+        Self {
+            lpath: path.to_string_lossy().into_owned(),
+            read_time: metrics::histogram(Stage::HumidityRead, metrics::bus_source(&path)),
+            path,
+            sink,
+            deadband: Deadband::new(&sampling),
+            temp_deadband: Deadband::new(&Sampling {
+                deadband: temp_deadband,
+                ..sampling
+            }),
+            combined,
+            pending: Readings::new(),
+            pending_temps: Readings::new(),
+            sampling,
+            devices: None,
+            triggered: None,
+        }
+    }
+
+    /// Open the bus, and reset every sensor found on it.
+    fn setup(&mut self) -> Option<Devices> {
+        let lpath = &self.lpath;
+        log::info!("[HUM] {lpath}> Opening bus");
+        // Open the I2C bus
+        let mut i2c = match I2cdev::new(&self.path) {
+            Ok(i2c) => i2c,
+            Err(e) => {
+                log::error!("[HUM] {lpath}> Failed to open bus: {e}");
+                return None;
+            }
+        };
         let mut delay = Delay;
         // Open all available devices
         let addrs = [
@@ -31,19 +139,37 @@ pub fn humidity_thread(
             H10SlaveAddress::default().with_a1(true),
             H10SlaveAddress::default().with_a0(true).with_a1(true),
         ];
-        let mut hdc10s = addrs
+        let combined = self.combined;
+        let hdc10s = addrs
             .iter()
             .filter_map(|addr| {
-                match Hdc1010Builder::default()
-                    .with_address(*addr)
-                    .build_mode_separate(&mut i2c)
-                {
+                let builder = Hdc1010Builder::default().with_address(*addr);
+                let hdc = if combined {
+                    builder.build_mode_both(&mut i2c).and_then(|mut hdc| {
+                        // Stable across buses and addresses, in the same way as the 1-Wire sensor IDs
+                        let serial = hdc.get_serial(&mut i2c)?;
+                        Ok(Hdc10::Both(hdc, crc32fast::hash(&serial.to_le_bytes())))
+                    })
+                } else {
+                    builder.build_mode_separate(&mut i2c).map(Hdc10::Separate)
+                };
+                match hdc {
                     Ok(mut hdc) => {
                         log::info!(
                             "[HUM] {lpath}> Device found at address {:02x}",
                             hdc.get_address()
                         );
-                        if let Err(e) = hdc.reset(&mut i2c, &mut delay) {
+                        let res = match &mut hdc {
+                            Hdc10::Separate(hdc) => hdc.reset(&mut i2c, &mut delay),
+                            Hdc10::Both(hdc, id) => {
+                                log::info!(
+                                    "[HUM] {lpath}> Sensor {:02x} has ID {id:08x}",
+                                    hdc.get_address()
+                                );
+                                hdc.reset(&mut i2c, &mut delay)
+                            }
+                        };
+                        if let Err(e) = res {
                             log::error!(
                                 "[HUM] {lpath}> Error resetting sensor {:02x}: {e:?}.",
                                 hdc.get_address()
@@ -62,60 +188,214 @@ pub fn humidity_thread(
                 }
             })
             .collect::<Vec<_>>();
-        log::info!("[HUM] {lpath}> {} devices found.", hdc10s.len());
-        std::thread::sleep(Duration::from_secs(1));
-        while running.load(Ordering::Relaxed) {
+        // HDC3022 sensors measure continuously, at least once per sampling period
+        let rate = MeasurementRate::at_least(self.sampling.period);
+        let addrs = [
+            H30SlaveAddress::default(),
+            H30SlaveAddress::default().with_a0(true),
+            H30SlaveAddress::default().with_a1(true),
+            H30SlaveAddress::default().with_a0(true).with_a1(true),
+        ];
+        let hdc30s = addrs
+            .iter()
+            .filter_map(
+                |addr| match AutoMeasurement::start(&mut i2c, &mut delay, *addr, rate) {
+                    Ok(hdc) => {
+                        // Stable across buses and addresses, in the same way as the HDC1010 sensor IDs
+                        let id = crc32fast::hash(&hdc.get_serial().to_le_bytes());
+                        log::info!(
+                            "[HUM] {lpath}> HDC3022 found at address {:02x} with ID {id:08x}, measuring every {:?}",
+                            hdc.get_address(),
+                            rate.period()
+                        );
+                        Some((hdc, id))
+                    }
+                    Err(e) => {
+                        log::warn!(
+                            "[HUM] {lpath}> Address {:02x} not found: {e:?}",
+                            addr.into_bits()
+                        );
+                        None
+                    }
+                },
+            )
+            .collect::<Vec<_>>();
+        log::info!(
+            "[HUM] {lpath}> {} devices found.",
+            hdc10s.len() + hdc30s.len()
+        );
+        self.deadband.reset();
+        self.temp_deadband.reset();
+        Some(Devices {
+            i2c,
+            hdc10s,
+            hdc30s,
+        })
+    }
+
+    /// Read the HDC3022 sensors and trigger a humidity measurement on the HDC1010 sensors, setting the
+    /// bus up first if needed.
+    fn trigger(&mut self, tick: Instant) -> Step {
+        if self.devices.is_none() {
+            self.devices = self.setup();
+            // Let the sensors settle after the reset, the first measurement starts on the next tick
+            return if self.devices.is_some() {
+                Step::Idle
+            } else {
+                Step::Again(RETRY_DELAY)
+            };
+        }
+        let lpath = &self.lpath;
+        let Some(Devices {
+            i2c,
+            hdc10s,
+            hdc30s,
+        }) = self.devices.as_mut()
+        else {
+            return Step::Again(RETRY_DELAY);
+        };
+        self.pending = Readings::new();
+        self.pending_temps = Readings::new();
+        let mut lost = false;
+        for (hdc, id) in hdc30s.iter_mut() {
             let start = Instant::now();
-            if let Some(delay) = hdc10s
-                .iter_mut()
-                .filter_map(|hdc| {
-                    hdc.trigger(&mut i2c, Trigger::Humidity)
-                        .map_err(|e| {
-                            log::warn!(
-                                "[HUM] {lpath} Sensor 0x{:02x}: Could not trigger: {e:?}",
-                                hdc.get_address()
-                            );
-                            e
-                        })
-                        .ok()
-                })
-                .max()
-            {
-                std::thread::sleep(delay);
-                let mes = hdc10s
-                    .iter_mut()
-                    .filter_map(|hdc| match hdc.read_humidity(&mut i2c) {
-                        Ok(r) => {
-                            log::info!(
-                                "[HUM] {lpath}> Sensor 0x{:02x}: {}%",
-                                hdc.get_address(),
-                                r.percentage()
-                            );
-                            Some((hdc.get_address() as u32, r.percentage()))
-                        }
-                        Err(e) => {
-                            log::error!(
-                                "[HUM] {lpath}> Sensor 0x{:02x}: Error reading: {e:?}",
-                                hdc.get_address()
-                            );
-                            None
-                        }
-                    })
-                    .collect::<Vec<_>>();
-                log::info!(
-                    "[HUM] {lpath}> Read {} sensors in {:.2} ms.",
-                    hdc10s.len(),
-                    start.elapsed().as_secs_f64() * 1000.0
-                );
-                if let Err(e) = sink.send(Measurement::Humidity(mes)) {
-                    log::error!("[HUM] {lpath}> We are leaving {e:?}.");
-                    continue 'root;
+            let res = hdc.fetch(i2c);
+            self.read_time.record_since(start);
+            match res {
+                Ok(r) => {
+                    log::info!(
+                        "[HUM] {lpath}> Sensor 0x{:02x}: {}%, {} °C",
+                        hdc.get_address(),
+                        r.percentage(),
+                        r.celsius()
+                    );
+                    self.pending.push(*id, r.percentage());
+                    self.pending_temps.push(*id, r.celsius());
+                }
+                Err(e) => {
+                    log::error!(
+                        "[HUM] {lpath}> Sensor 0x{:02x}: Error reading: {e:?}",
+                        hdc.get_address()
+                    );
+                    lost = true;
                 }
             }
-            if start.elapsed().as_secs() < 1 {
-                std::thread::sleep(Duration::from_secs(1) - start.elapsed());
+        }
+        if lost {
+            // A sensor that was power cycled is out of auto-measurement mode: set the bus up again
+            log::warn!("[HUM] {lpath}> Resetting bus after a failed read");
+            self.send(tick);
+            self.devices = None;
+            return Step::Again(RETRY_DELAY);
+        }
+        let delay = hdc10s
+            .iter_mut()
+            .filter_map(|hdc| {
+                hdc.trigger(i2c)
+                    .map_err(|e| {
+                        log::warn!(
+                            "[HUM] {lpath} Sensor 0x{:02x}: Could not trigger: {e:?}",
+                            hdc.get_address()
+                        );
+                        e
+                    })
+                    .ok()
+            })
+            .max();
+        match delay {
+            Some(delay) => {
+                self.triggered = Some(Instant::now());
+                Step::Again(delay)
+            }
+            None => {
+                self.send(tick);
+                Step::Idle
+            }
+        }
+    }
+
+    /// Read the measurements back from every HDC1010 sensor.
+    fn read(&mut self, tick: Instant, started: Instant) -> Step {
+        self.triggered = None;
+        let lpath = &self.lpath;
+        let Some(Devices { i2c, hdc10s, .. }) = self.devices.as_mut() else {
+            return Step::Again(RETRY_DELAY);
+        };
+        for hdc in hdc10s.iter_mut() {
+            let start = Instant::now();
+            let res = hdc.read(i2c);
+            self.read_time.record_since(start);
+            match res {
+                Ok((id, hum, temp)) => {
+                    log::info!("[HUM] {lpath}> Sensor 0x{:02x}: {hum}%", hdc.get_address(),);
+                    self.pending.push(id, hum);
+                    if let Some(temp) = temp {
+                        log::info!(
+                            "[HUM] {lpath}> Sensor 0x{:02x}: {temp} °C",
+                            hdc.get_address(),
+                        );
+                        self.pending_temps.push(id, temp);
+                    }
+                }
+                Err(e) => {
+                    log::error!(
+                        "[HUM] {lpath}> Sensor 0x{:02x}: Error reading: {e:?}",
+                        hdc.get_address()
+                    );
+                }
             }
         }
+        log::info!(
+            "[HUM] {lpath}> Read {} sensors in {:.2} ms.",
+            hdc10s.len(),
+            started.elapsed().as_secs_f64() * 1000.0
+        );
+        self.send(tick);
+        Step::Idle
+    }
+
+    /// Send the humidity and temperature read on this tick.
+    fn send(&mut self, tick: Instant) {
+        let lpath = &self.lpath;
+        let dropped = self.sink.stats().dropped;
+        self.temp_deadband.dropped(dropped);
+        self.deadband.dropped(dropped);
+        let temps = self.temp_deadband.filter(&self.pending_temps, tick);
+        if !temps.is_empty()
+            && let Err(e) = self.sink.send((tick, Measurement::Temperature(temps)))
+        {
+            log::error!("[HUM] {lpath}> Failed to send data: {e:?}");
+            self.temp_deadband.reset();
+        }
+        // Unchanged sensors are left out, the client keeps their last value
+        let mes = self.deadband.filter(&self.pending, tick);
+        if !mes.is_empty()
+            && let Err(e) = self.sink.send((tick, Measurement::Humidity(mes)))
+        {
+            log::error!("[HUM] {lpath}> Failed to send data: {e:?}");
+            self.deadband.reset(); // the sink missed this readout, send it in full next time
+        }
+    }
+}
+
+impl Job for HumidityBus {
+    fn name(&self) -> &str {
+        &self.lpath
+    }
+
+    fn period(&self) -> Duration {
+        self.sampling.period
+    }
+
+    fn run(&mut self, tick: Instant) -> Step {
+        match self.triggered {
+            None => self.trigger(tick),
+            Some(started) => self.read(tick, started),
+        }
+    }
+
+    fn reset(&mut self) {
+        self.triggered = None;
+        self.devices = None; // set the bus up again
     }
-    log::info!("[HUM] {lpath}> Exiting thread.")
 }
@@ -11,16 +11,26 @@ use std::{
 use clap::Parser;
 
 // Local imports
+mod broadcast;
 mod cpu_sensors;
 mod data_format;
 mod humi_sensors;
+mod metrics;
+mod rom_cache;
 mod safe_mpsc;
+mod sampling;
+mod scheduler;
 mod serial_comm;
+mod sim_bus;
+mod socket;
 mod temp_sensors;
 
 pub use data_format::Measurement;
-use humi_sensors::humidity_thread;
-use temp_sensors::onewire_thread;
+use cpu_sensors::CpuSensors;
+use humi_sensors::HumidityBus;
+use scheduler::Scheduler;
+use sim_bus::{SimConfig, SimMaster};
+use temp_sensors::{Ds2484Master, OneWireBus};
 
 /// Simple program to greet a person
 #[derive(Parser, Debug)]
@@ -34,12 +44,21 @@ struct Args {
         default_value = "1",
     )]
     thermo_paths: Vec<u8>,
-    /// I2C bus IDs for humidity sensors (e.g. 0,1,2 for /dev/i2c-0, /dev/i2c-1, /dev/i2c-2)
+    /// I2C bus IDs for humidity sensors, HDC1010 or HDC3022 (e.g. 0,1,2 for /dev/i2c-0, /dev/i2c-1, /dev/i2c-2)
     #[arg(long, use_value_delimiter = true, value_delimiter = ',')]
     humidity_paths: Vec<u8>,
+    /// Run HDC1010 sensors in combined mode: one conversion reads temperature and humidity, sent with an ID derived from the sensor serial number
+    #[arg(long, default_value_t = false)]
+    humidity_combined: bool,
     /// Serial port for data sink
     #[arg(long, required = false)]
     serial: Option<String>,
+    /// Unix socket on which local clients receive the same data as the serial port
+    #[arg(long, required = false)]
+    socket: Option<PathBuf>,
+    /// Encoded batches kept for the serial port and the socket clients; a consumer further behind skips the oldest
+    #[arg(long, default_value_t = 64)]
+    ring_len: usize,
     /// Enable LED control
     #[arg(long, default_value_t = false)]
     leds: bool,
@@ -49,6 +68,80 @@ struct Args {
     /// Disable overdriven mode
     #[arg(long, default_value_t = false)]
     no_overdrive: bool,
+    /// Verify the fast temperature readout of each sensor with a full CRC readout every this many readouts (0 disables, 1 always checks)
+    #[arg(long, default_value_t = 10)]
+    crc_every: u16,
+    /// Directory where the devices found on each temperature bus are cached, for a fast startup and reconnect (empty disables the cache)
+    #[arg(long, default_value = "/var/cache/thermo-server")]
+    rom_cache: PathBuf,
+    /// Use the v2 wire format (one header with sequence number and timestamp per batch, and a CRC)
+    #[arg(long, default_value_t = false)]
+    wire_v2: bool,
+    /// Time to collect measurements into one serial write, in milliseconds (0 sends what is already queued)
+    #[arg(long, default_value_t = 50)]
+    batch_window_ms: u64,
+    /// Size in bytes at which a serial write is sent without waiting for the rest of the batch window
+    #[arg(long, default_value_t = 4096)]
+    batch_max_bytes: usize,
+    /// Measurements held for the serial port before the queue policy applies
+    #[arg(long, default_value_t = 16)]
+    queue_len: usize,
+    /// What to do with new measurements when the queue is full
+    #[arg(long, value_enum, default_value_t = safe_mpsc::Policy::Coalesce)]
+    queue_policy: safe_mpsc::Policy,
+    /// Sampling period of each temperature bus in ms, in the order of --thermo-paths (the last value applies to the remaining buses)
+    #[arg(
+        long,
+        use_value_delimiter = true,
+        value_delimiter = ',',
+        default_value = "1000",
+    )]
+    thermo_period_ms: Vec<u64>,
+    /// Sampling period of each humidity bus in ms, in the order of --humidity-paths (the last value applies to the remaining buses)
+    #[arg(
+        long,
+        use_value_delimiter = true,
+        value_delimiter = ',',
+        default_value = "1000",
+    )]
+    humidity_period_ms: Vec<u64>,
+    /// Only send a temperature when it moved by more than this many °C since it was last sent (0 sends every reading)
+    #[arg(long, default_value_t = 0.0)]
+    temp_deadband: f32,
+    /// Only send a humidity when it moved by more than this many % since it was last sent (0 sends every reading)
+    #[arg(long, default_value_t = 0.0)]
+    humidity_deadband: f32,
+    /// With a deadband, send unchanged readings again after this many ms
+    #[arg(long, default_value_t = 10000)]
+    heartbeat_ms: u64,
+    /// Worker threads reading out the sensor buses
+    #[arg(long, default_value_t = 4)]
+    workers: usize,
+    /// Log latency histograms of the sensor buses and the serial port, and send them as diagnostics frames,
+    /// every this many ms (0 disables the report, the histograms are still recorded)
+    #[arg(long, default_value_t = 0)]
+    diag_interval_ms: u64,
+    /// Simulated temperature buses, read in addition to --thermo-paths, for testing without hardware
+    #[arg(long, default_value_t = 0)]
+    sim_buses: usize,
+    /// DS28EA00 sensors on each simulated bus
+    #[arg(long, default_value_t = 16)]
+    sim_devices: usize,
+    /// Extra time of every simulated bus operation in us, on top of the 1-Wire time slots (a DS2484 command takes about 100 us over I2C)
+    #[arg(long, default_value_t = 0)]
+    sim_latency_us: u64,
+    /// Simulated sensors do not switch to overdrive speed
+    #[arg(long, default_value_t = false)]
+    sim_no_overdrive: bool,
+    /// Probability that a simulated scratchpad readout has a bit error
+    #[arg(long, default_value_t = 0.0)]
+    sim_crc_error_rate: f64,
+    /// Probability that a simulated bus reset sees no presence pulse
+    #[arg(long, default_value_t = 0.0)]
+    sim_no_presence_rate: f64,
+    /// Seed of the simulated sensor ROMs, temperatures and faults
+    #[arg(long, default_value_t = 1)]
+    sim_seed: u64,
 }
 
 fn main() {
@@ -91,86 +184,131 @@ fn main() {
         .expect("Error setting Ctrl-C handler");
     }
     // Channel
-    let (data_tx, data_rx) = safe_mpsc::channel();
+    let (data_tx, data_rx) = safe_mpsc::channel(args.queue_len, args.queue_policy);
+    // Spawn the encoder, which publishes every batch once for all the consumers
+    let ring = broadcast::Ring::new(args.ring_len, args.batch_max_bytes);
+    let enc_hdl = if args.serial.is_some() || args.socket.is_some() {
+        let running = running.clone();
+        let ring = ring.clone();
+        let wire_v2 = args.wire_v2;
+        let batch_window = Duration::from_millis(args.batch_window_ms);
+        let batch_max = args.batch_max_bytes;
+        Some(thread::spawn(move || {
+            broadcast::encoder_thread(running, data_rx, ring, wire_v2, batch_window, batch_max)
+        }))
+    } else {
+        None
+    };
     // Spawn the serial communication thread
     let ser_hdl = if let Some(ref serial) = args.serial {
         let running = running.clone();
         let serial = serial.clone();
-        Some(thread::spawn(move || {
-            serial_comm::serial_thread(serial, running, data_rx)
-        }))
+        let ring = ring.clone();
+        Some(thread::spawn(move || serial_comm::serial_thread(serial, running, ring)))
     } else {
         None
     };
-    // Spawn the temperature sensor threads
-    let mut temp_hdls = args
-        .thermo_paths
-        .iter()
-        .filter_map(|path| {
-            let path = PathBuf::from(format!("/dev/i2c-{path}"));
-            if path.exists() {
-                let running = running.clone();
-                let sink = data_tx.clone();
-                let exclude = exclude.clone();
-                let print = args.serial.is_none();
-                Some(thread::spawn({
-                    move || {
-                        onewire_thread(path, running, args.leds, sink, exclude, args.no_overdrive, print)
-                    }
-                }))
-            } else {
-                None
-            }
-        })
-        .collect::<Vec<_>>();
-    temp_hdls.push(thread::spawn({
+    // Spawn the socket server thread
+    let soc_hdl = if let Some(ref socket) = args.socket {
         let running = running.clone();
-        let sink = data_tx.clone();
-        move || cpu_sensors::cputemp_thread(running, sink)
-    }));
-    // Spawn humidity sensor threads if needed
-    let hum_hdls = args
-        .humidity_paths
-        .iter()
-        .filter_map(|path| {
-            let path = PathBuf::from(format!("/dev/i2c-{path}"));
-            if path.exists() {
-                let running = running.clone();
-                let sink = data_tx.clone();
-                Some(thread::spawn({
-                    move || humidity_thread(path, running, sink)
-                }))
-            } else {
-                None
-            }
-        })
-        .collect::<Vec<_>>();
-    // Main thread: wait for threads to finish
-    while running.load(Ordering::Relaxed) {
-        thread::sleep(Duration::from_secs(1));
-    }
-    // Join temp sensor threads
-    for temp_hdl in temp_hdls {
-        if let Err(e) = temp_hdl.join() {
-            log::error!("[TMP] Thread panicked with error: {e:#?}");
-        } else {
-            log::info!("[TMP] Thread joined successfully.");
+        let socket = socket.clone();
+        let ring = ring.clone();
+        Some(thread::spawn(move || socket::socket_thread(socket, running, ring)))
+    } else {
+        None
+    };
+    // Measurements are only printed when nothing consumes them
+    let print = args.serial.is_none() && args.socket.is_none();
+    // Schedule the temperature sensor buses
+    let mut scheduler = Scheduler::new(args.workers);
+    let heartbeat = Duration::from_millis(args.heartbeat_ms);
+    let rom_cache = Some(args.rom_cache.clone()).filter(|dir| !dir.as_os_str().is_empty());
+    for (idx, path) in args.thermo_paths.iter().enumerate() {
+        let path = PathBuf::from(format!("/dev/i2c-{path}"));
+        if path.exists() {
+            let sampling = sampling::Sampling {
+                period: sampling::Sampling::period_for(&args.thermo_period_ms, idx),
+                deadband: args.temp_deadband,
+                heartbeat,
+            };
+            scheduler.add(Box::new(OneWireBus::new(
+                path.clone(),
+                Ds2484Master::new(&path),
+                args.leds,
+                data_tx.clone(),
+                exclude.clone(),
+                args.no_overdrive,
+                print,
+                args.crc_every,
+                rom_cache.clone(),
+                sampling,
+            )));
         }
     }
-    // Join humidity sensor threads
-    for humi_hdl in hum_hdls {
-        if let Err(e) = humi_hdl.join() {
-            log::error!("[HUM] Thread panicked with error: {e:#?}");
-        } else {
-            log::info!("[HUM] Thread joined successfully.");
+    for idx in 0..args.sim_buses {
+        let path = PathBuf::from(format!("sim-{idx}"));
+        let sampling = sampling::Sampling {
+            period: sampling::Sampling::period_for(&args.thermo_period_ms, args.thermo_paths.len() + idx),
+            deadband: args.temp_deadband,
+            heartbeat,
+        };
+        let sim = SimConfig {
+            devices: args.sim_devices,
+            latency: Duration::from_micros(args.sim_latency_us),
+            overdrive: !args.sim_no_overdrive,
+            crc_error_rate: args.sim_crc_error_rate,
+            no_presence_rate: args.sim_no_presence_rate,
+            seed: args.sim_seed.wrapping_add(idx as u64),
+        };
+        scheduler.add(Box::new(OneWireBus::new(
+            path,
+            SimMaster(sim),
+            args.leds,
+            data_tx.clone(),
+            exclude.clone(),
+            args.no_overdrive,
+            print,
+            args.crc_every,
+            None, // keep simulated ROMs out of the cache of the real buses
+            sampling,
+        )));
+    }
+    scheduler.add(Box::new(CpuSensors::new(data_tx.clone())));
+    // Schedule humidity sensor buses if needed
+    for (idx, path) in args.humidity_paths.iter().enumerate() {
+        let path = PathBuf::from(format!("/dev/i2c-{path}"));
+        if path.exists() {
+            let sampling = sampling::Sampling {
+                period: sampling::Sampling::period_for(&args.humidity_period_ms, idx),
+                deadband: args.humidity_deadband,
+                heartbeat,
+            };
+            scheduler.add(Box::new(HumidityBus::new(
+                path,
+                data_tx.clone(),
+                sampling,
+                args.temp_deadband,
+                args.humidity_combined,
+            )));
         }
     }
-    // Join the serial communication thread
-    if let Some(ser_hdl) = ser_hdl {
-        if let Err(e) = ser_hdl.join() {
-            log::error!("[COM] Thread panicked: {e:#?}");
-        } else {
-            log::info!("[COM] Thread joined successfully.");
+    if args.diag_interval_ms > 0 {
+        scheduler.add(Box::new(metrics::Report::new(
+            Duration::from_millis(args.diag_interval_ms),
+            data_tx.clone(),
+        )));
+    }
+    drop(data_tx); // the encoder thread sees the disconnection once the jobs are dropped
+    // Main thread: run the sensor buses until stopped
+    scheduler.run(&running);
+    // Join the encoder, then its consumers, which see the ring closed
+    for (hdl, name) in [(enc_hdl, "[COM]"), (ser_hdl, "[COM]"), (soc_hdl, "[SOC]")] {
+        if let Some(hdl) = hdl {
+            if let Err(e) = hdl.join() {
+                log::error!("{name} Thread panicked: {e:#?}");
+            } else {
+                log::info!("{name} Thread joined successfully.");
+            }
         }
     }
 }
@@ -0,0 +1,210 @@
+use std::{
+    path::Path,
+    sync::{
+        Arc, Mutex,
+        atomic::{AtomicU32, AtomicU64, Ordering},
+    },
+    time::{Duration, Instant},
+};
+
+use crate::{
+    Measurement, safe_mpsc,
+    scheduler::{Job, Step},
+};
+
+/// Buckets of a histogram. Bucket `i` counts latencies in `[2^i, 2^(i+1))` µs, bucket 0 also counts
+/// latencies under 1 µs, and the last bucket counts everything from 2^23 µs (about 8 s) on.
+pub const HIST_BUCKETS: usize = 24;
+
+/// Source ID of the stages that are not tied to a sensor bus.
+pub const SERIAL_SOURCE: u32 = u32::MAX;
+
+/// Instrumented stages of the hot paths. The values are sent in diagnostic frames.
+#[repr(u8)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Stage {
+    /// 1-Wire bus reset, skip ROM and convert command that start a conversion.
+    BusReset = 0,
+    /// Start of a DS28EA00 conversion until every device reports done.
+    ConversionWait = 1,
+    /// Scratchpad read of one DS28EA00.
+    ScratchpadRead = 2,
+    /// Time a measurement spends in the channel to the serial thread.
+    QueueDelay = 3,
+    /// Serial write of a batch.
+    SerialWrite = 4,
+    /// Serial flush of a batch.
+    SerialFlush = 5,
+    /// Readout of one humidity sensor.
+    HumidityRead = 6,
+}
+
+impl Stage {
+    pub fn name(self) -> &'static str {
+        match self {
+            Stage::BusReset => "bus reset",
+            Stage::ConversionWait => "conversion wait",
+            Stage::ScratchpadRead => "scratchpad read",
+            Stage::QueueDelay => "queue delay",
+            Stage::SerialWrite => "serial write",
+            Stage::SerialFlush => "serial flush",
+            Stage::HumidityRead => "humidity read",
+        }
+    }
+}
+
+/// Fixed-bucket latency histogram, recorded to without locking from any thread.
+#[derive(Debug)]
+pub struct Histogram {
+    stage: Stage,
+    source: u32,
+    count: AtomicU32,
+    max_us: AtomicU32,
+    sum_us: AtomicU64,
+    buckets: [AtomicU32; HIST_BUCKETS],
+}
+
+/// Counts of a histogram since the previous snapshot.
+#[derive(Debug, Clone)]
+pub struct HistogramSnapshot {
+    pub stage: Stage,
+    /// Bus the stage ran on (the I2C bus number), or [`SERIAL_SOURCE`].
+    pub source: u32,
+    pub count: u32,
+    pub max_us: u32,
+    pub sum_us: u64,
+    pub buckets: [u32; HIST_BUCKETS],
+}
+
+impl Histogram {
+    fn new(stage: Stage, source: u32) -> Self {
+        Self {
+            stage,
+            source,
+            count: AtomicU32::new(0),
+            max_us: AtomicU32::new(0),
+            sum_us: AtomicU64::new(0),
+            buckets: std::array::from_fn(|_| AtomicU32::new(0)),
+        }
+    }
+
+    pub fn record(&self, elapsed: Duration) {
+        let us = elapsed.as_micros().min(u32::MAX as u128) as u32;
+        let bucket = (u32::BITS - us.leading_zeros()).saturating_sub(1) as usize;
+        self.buckets[bucket.min(HIST_BUCKETS - 1)].fetch_add(1, Ordering::Relaxed);
+        self.count.fetch_add(1, Ordering::Relaxed);
+        self.sum_us.fetch_add(us as u64, Ordering::Relaxed);
+        self.max_us.fetch_max(us, Ordering::Relaxed);
+    }
+
+    /// Record the time elapsed since `start`.
+    pub fn record_since(&self, start: Instant) {
+        self.record(start.elapsed());
+    }
+
+    /// Take the counts, and start over.
+    fn take(&self) -> HistogramSnapshot {
+        HistogramSnapshot {
+            stage: self.stage,
+            source: self.source,
+            count: self.count.swap(0, Ordering::Relaxed),
+            max_us: self.max_us.swap(0, Ordering::Relaxed),
+            sum_us: self.sum_us.swap(0, Ordering::Relaxed),
+            buckets: std::array::from_fn(|idx| self.buckets[idx].swap(0, Ordering::Relaxed)),
+        }
+    }
+}
+
+impl HistogramSnapshot {
+    /// Upper bound of the bucket holding the `q` quantile, in µs.
+    pub fn quantile_us(&self, q: f64) -> u64 {
+        let target = (self.count as f64 * q).ceil() as u64;
+        let mut seen = 0;
+        for (idx, count) in self.buckets.iter().enumerate() {
+            seen += *count as u64;
+            if seen >= target.max(1) {
+                return (1u64 << (idx + 1)).min(self.max_us as u64);
+            }
+        }
+        self.max_us as u64
+    }
+}
+
+/// Every histogram, so that they can be reported together. Only registration and reporting take the lock.
+static REGISTRY: Mutex<Vec<Arc<Histogram>>> = Mutex::new(Vec::new());
+
+/// Get the histogram of `stage` on `source`, creating it if needed.
+pub fn histogram(stage: Stage, source: u32) -> Arc<Histogram> {
+    let mut registry = REGISTRY.lock().unwrap_or_else(|e| e.into_inner());
+    if let Some(hist) = registry
+        .iter()
+        .find(|hist| hist.stage == stage && hist.source == source)
+    {
+        return hist.clone();
+    }
+    let hist = Arc::new(Histogram::new(stage, source));
+    registry.push(hist.clone());
+    hist
+}
+
+/// Source ID of a bus: the number of `/dev/i2c-N`, or a hash of the path of other buses (e.g. simulated buses).
+pub fn bus_source(path: &Path) -> u32 {
+    let name = path.to_string_lossy();
+    name.strip_prefix("/dev/i2c-")
+        .and_then(|n| n.parse().ok())
+        .unwrap_or_else(|| crc32fast::hash(name.as_bytes()))
+}
+
+/// Take the counts of every histogram that recorded something since the previous snapshot.
+pub fn snapshot() -> Vec<HistogramSnapshot> {
+    let registry = REGISTRY.lock().unwrap_or_else(|e| e.into_inner());
+    registry
+        .iter()
+        .map(|hist| hist.take())
+        .filter(|snap| snap.count > 0)
+        .collect()
+}
+
+/// Periodic report of the histograms, to the log and as a diagnostic frame to the serial port.
+pub struct Report {
+    period: Duration,
+    sink: safe_mpsc::SafeSender<(Instant, Measurement)>,
+}
+
+impl Report {
+    pub fn new(period: Duration, sink: safe_mpsc::SafeSender<(Instant, Measurement)>) -> Self {
+        Self { period, sink }
+    }
+}
+
+impl Job for Report {
+    fn name(&self) -> &str {
+        "diagnostics"
+    }
+
+    fn period(&self) -> Duration {
+        self.period
+    }
+
+    fn run(&mut self, tick: Instant) -> Step {
+        let snaps = snapshot();
+        for snap in snaps.iter() {
+            log::info!(
+                "[DIAG] {} on {:08x}: {} samples, mean {} us, p50 <= {} us, p99 <= {} us, max {} us",
+                snap.stage.name(),
+                snap.source,
+                snap.count,
+                snap.sum_us / snap.count as u64,
+                snap.quantile_us(0.5),
+                snap.quantile_us(0.99),
+                snap.max_us
+            );
+        }
+        if !snaps.is_empty()
+            && let Err(e) = self.sink.send((tick, Measurement::Diagnostics(snaps)))
+        {
+            log::debug!("[DIAG] Diagnostics not sent: {e:?}");
+        }
+        Step::Idle
+    }
+}
@@ -0,0 +1,145 @@
+use std::{
+    fs,
+    io::{self, Write},
+    path::{Path, PathBuf},
+};
+
+/// Devices last found on a 1-Wire bus, kept across restarts so that the bus can be set up without a search.
+#[derive(Debug, Default, Clone, PartialEq, Eq)]
+pub struct RomCache {
+    /// The devices worked in overdrive mode.
+    pub overdrive: bool,
+    /// ROM addresses of the devices, in enumeration order.
+    pub roms: Vec<u64>,
+}
+
+impl RomCache {
+    /// Cache file of the bus at `bus` (e.g. `/dev/i2c-1`) in the directory `dir`.
+    pub fn path(dir: &Path, bus: &Path) -> PathBuf {
+        let name = bus.file_name().map_or_else(
+            || bus.to_string_lossy().replace('/', "_"),
+            |name| name.to_string_lossy().into_owned(),
+        );
+        dir.join(format!("{name}.roms"))
+    }
+
+    /// Read a cache file. Returns `None` if the file does not exist or can not be parsed.
+    pub fn load(path: &Path) -> Option<Self> {
+        let text = fs::read_to_string(path).ok()?;
+        let mut cache = Self::default();
+        for line in text.lines().map(str::trim) {
+            match line.split_once(' ') {
+                _ if line.is_empty() || line.starts_with('#') => {}
+                Some(("overdrive", value)) => cache.overdrive = value.trim() == "1",
+                Some(("rom", value)) => cache
+                    .roms
+                    .push(u64::from_str_radix(value.trim().trim_start_matches("0x"), 16).ok()?),
+                _ => return None,
+            }
+        }
+        if cache.roms.is_empty() {
+            None
+        } else {
+            Some(cache)
+        }
+    }
+
+    /// Write a cache file, replacing the previous one atomically.
+    pub fn store(&self, path: &Path) -> io::Result<()> {
+        if let Some(dir) = path.parent() {
+            fs::create_dir_all(dir)?;
+        }
+        let tmp = path.with_extension("tmp");
+        {
+            let mut file = io::BufWriter::new(fs::File::create(&tmp)?);
+            writeln!(
+                file,
+                "# thermo-server 1-Wire ROM cache, delete this file to force a bus search"
+            )?;
+            writeln!(file, "overdrive {}", self.overdrive as u8)?;
+            for rom in self.roms.iter() {
+                writeln!(file, "rom 0x{rom:016x}")?;
+            }
+            file.flush()?;
+        }
+        fs::rename(&tmp, path)
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    /// Scratch directory of a test, removed when dropped.
+    struct TempDir(PathBuf);
+
+    impl TempDir {
+        fn new(name: &str) -> Self {
+            let dir =
+                std::env::temp_dir().join(format!("thermo-server-{name}-{}", std::process::id()));
+            let _ = fs::remove_dir_all(&dir);
+            Self(dir)
+        }
+    }
+
+    impl Drop for TempDir {
+        fn drop(&mut self) {
+            let _ = fs::remove_dir_all(&self.0);
+        }
+    }
+
+    #[test]
+    fn test_path() {
+        let dir = Path::new("/var/cache/thermo");
+        assert_eq!(
+            RomCache::path(dir, Path::new("/dev/i2c-1")),
+            dir.join("i2c-1.roms")
+        );
+        assert_eq!(
+            RomCache::path(dir, Path::new("sim-0")),
+            dir.join("sim-0.roms")
+        );
+    }
+
+    #[test]
+    fn test_store_load() {
+        let dir = TempDir::new("store");
+        let path = RomCache::path(&dir.0.join("nested"), Path::new("/dev/i2c-1"));
+        assert_eq!(RomCache::load(&path), None);
+        let cache = RomCache {
+            overdrive: true,
+            roms: vec![0x2e00_0000_1234_5642, 0x0100_00ab_cdef_0142],
+        };
+        cache.store(&path).unwrap();
+        assert_eq!(RomCache::load(&path), Some(cache.clone()));
+        assert!(!path.with_extension("tmp").exists());
+        // Stored again over the previous file
+        let cache = RomCache {
+            overdrive: false,
+            roms: vec![0x0100_00ab_cdef_0142],
+        };
+        cache.store(&path).unwrap();
+        assert_eq!(RomCache::load(&path), Some(cache));
+    }
+
+    #[test]
+    fn test_load_invalid() {
+        let dir = TempDir::new("invalid");
+        fs::create_dir_all(&dir.0).unwrap();
+        let path = dir.0.join("i2c-1.roms");
+        let load = |text: &str| {
+            fs::write(&path, text).unwrap();
+            RomCache::load(&path)
+        };
+        assert_eq!(
+            load("# comment\n\noverdrive 1\nrom 0x42\n"),
+            Some(RomCache {
+                overdrive: true,
+                roms: vec![0x42]
+            })
+        );
+        assert_eq!(load("overdrive 1\n"), None); // no devices
+        assert_eq!(load("rom 0xzz\n"), None);
+        assert_eq!(load("rom 0x42\nunknown 1\n"), None);
+    }
+}
@@ -1,74 +1,237 @@
 #![allow(dead_code)]
-use std::sync::{
-    Arc,
-    atomic::AtomicBool,
-    mpsc::{self, Receiver, Sender},
+use std::{
+    collections::VecDeque,
+    sync::{
+        Arc, Condvar, Mutex, MutexGuard,
+        atomic::{AtomicBool, Ordering},
+        mpsc::RecvTimeoutError,
+    },
+    time::{Duration, Instant},
 };
 
-#[derive(Debug, Clone)]
+/// What a full channel does with a new value.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, clap::ValueEnum)]
+pub enum Policy {
+    /// Drop the oldest queued value to make room.
+    DropOldest,
+    /// Drop the new value.
+    DropNewest,
+    /// Replace the queued value that the new one supersedes (see [`Coalesce`]), even if the channel is not full.
+    /// Drop the oldest value if the channel is full and nothing is superseded.
+    Coalesce,
+}
+
+/// Values that can replace older values in a channel with the [`Policy::Coalesce`] policy.
+pub trait Coalesce {
+    /// Whether `self` carries the latest value of everything in `older`, so that `older` can be dropped.
+    fn supersedes(&self, older: &Self) -> bool;
+}
+
+impl<T: Coalesce> Coalesce for (Instant, T) {
+    fn supersedes(&self, older: &Self) -> bool {
+        self.1.supersedes(&older.1)
+    }
+}
+
+/// Channel counters, shared by the senders and the receiver.
+#[derive(Debug, Clone, Copy, Default)]
+pub struct ChannelStats {
+    /// Values in the queue.
+    pub depth: usize,
+    /// Largest number of values that were in the queue.
+    pub max_depth: usize,
+    /// Values accepted by `send`.
+    pub sent: u64,
+    /// Values dropped because the channel was full, or flushed when the receiver stopped being ready.
+    pub dropped: u64,
+    /// Values replaced by a newer value.
+    pub coalesced: u64,
+}
+
+#[derive(Debug)]
+struct State<T> {
+    queue: VecDeque<(Instant, T)>, // values with the time they were queued
+    senders: usize,
+    receiver: bool,
+    stats: ChannelStats,
+}
+
+#[derive(Debug)]
+struct Shared<T> {
+    state: Mutex<State<T>>,
+    available: Condvar,
+    capacity: usize,
+    policy: Policy,
+    ready: AtomicBool,
+}
+
+impl<T> Shared<T> {
+    fn lock(&self) -> MutexGuard<'_, State<T>> {
+        self.state.lock().unwrap_or_else(|e| e.into_inner())
+    }
+}
+
+#[derive(Debug)]
 pub struct SafeSender<T> {
-    sender: Sender<T>,
-    ready: Arc<AtomicBool>,
+    shared: Arc<Shared<T>>,
 }
 
 #[derive(Debug)]
 pub struct SafeReceiver<T> {
-    receiver: Receiver<T>,
-    ready: Arc<AtomicBool>,
+    shared: Arc<Shared<T>>,
 }
 
-pub fn channel<T>() -> (SafeSender<T>, SafeReceiver<T>) {
-    let (tx, rx) = mpsc::channel();
-    let ready = Arc::new(AtomicBool::new(true));
+/// Create a bounded channel holding at most `capacity` values, so that memory stays flat when the receiver stalls.
+pub fn channel<T>(capacity: usize, policy: Policy) -> (SafeSender<T>, SafeReceiver<T>) {
+    let capacity = capacity.max(1);
+    let shared = Arc::new(Shared {
+        state: Mutex::new(State {
+            queue: VecDeque::with_capacity(capacity),
+            senders: 1,
+            receiver: true,
+            stats: ChannelStats::default(),
+        }),
+        available: Condvar::new(),
+        capacity,
+        policy,
+        ready: AtomicBool::new(true),
+    });
     (
         SafeSender {
-            sender: tx,
-            ready: ready.clone(),
-        },
-        SafeReceiver {
-            receiver: rx,
-            ready,
+            shared: shared.clone(),
         },
+        SafeReceiver { shared },
     )
 }
 
-impl<T> SafeSender<T> {
+impl<T: Coalesce> SafeSender<T> {
+    /// Queue a value. A value dropped by the channel policy is not an error.
     pub fn send(&self, value: T) -> Result<(), SafeSendError<T>> {
-        if self.ready.load(std::sync::atomic::Ordering::Relaxed) {
-            self.sender.send(value).map_err(SafeSendError::from)
-        } else {
-            Err(mpsc::SendError(value).into())
+        if !self.shared.ready.load(Ordering::Relaxed) {
+            return Err(SafeSendError::NotReady(value));
+        }
+        let mut state = self.shared.lock();
+        if !state.receiver {
+            return Err(SafeSendError::Disconnected(value));
         }
+        state.stats.sent += 1;
+        if self.shared.policy == Policy::Coalesce
+            && let Some(idx) = state
+                .queue
+                .iter()
+                .rposition(|(_, old)| value.supersedes(old))
+        {
+            state.queue.remove(idx);
+            state.stats.coalesced += 1;
+        }
+        if state.queue.len() == self.shared.capacity {
+            state.stats.dropped += 1;
+            if self.shared.policy == Policy::DropNewest {
+                return Ok(());
+            }
+            state.queue.pop_front();
+        }
+        state.queue.push_back((Instant::now(), value));
+        state.stats.max_depth = state.stats.max_depth.max(state.queue.len());
+        drop(state);
+        self.shared.available.notify_one();
+        Ok(())
     }
+}
 
+impl<T> SafeSender<T> {
     pub fn is_ready(&self) -> bool {
-        self.ready.load(std::sync::atomic::Ordering::Relaxed)
+        self.shared.ready.load(Ordering::Relaxed)
     }
 
-    pub fn sender(&self) -> &Sender<T> {
-        &self.sender
+    pub fn stats(&self) -> ChannelStats {
+        let state = self.shared.lock();
+        ChannelStats {
+            depth: state.queue.len(),
+            ..state.stats
+        }
+    }
+}
+
+impl<T> Clone for SafeSender<T> {
+    fn clone(&self) -> Self {
+        self.shared.lock().senders += 1;
+        SafeSender {
+            shared: self.shared.clone(),
+        }
+    }
+}
+
+impl<T> Drop for SafeSender<T> {
+    fn drop(&mut self) {
+        self.shared.lock().senders -= 1;
+        self.shared.available.notify_all(); // wake the receiver to report the disconnection
     }
 }
 
 impl<T> SafeReceiver<T> {
+    /// Stop or resume accepting values. Values queued while the receiver is not ready are stale, and are dropped.
     pub fn set_ready(&self, ready: bool) {
-        self.ready
-            .store(ready, std::sync::atomic::Ordering::Relaxed);
+        self.shared.ready.store(ready, Ordering::Relaxed);
+        if !ready {
+            let mut state = self.shared.lock();
+            state.stats.dropped += state.queue.len() as u64;
+            state.queue.clear();
+        }
     }
 
-    pub fn receiver(&self) -> &Receiver<T> {
-        &self.receiver
+    /// Wait up to `timeout` for a value.
+    pub fn recv_timeout(&self, timeout: Duration) -> Result<T, RecvTimeoutError> {
+        self.recv_timeout_delay(timeout).map(|(value, _)| value)
     }
-}
 
-#[derive(Debug)]
-pub enum SafeSendError<T> {
-    SendError(mpsc::SendError<T>),
-    NotReady,
+    /// Wait up to `timeout` for a value, and return it with the time it spent in the queue.
+    pub fn recv_timeout_delay(&self, timeout: Duration) -> Result<(T, Duration), RecvTimeoutError> {
+        let deadline = Instant::now() + timeout;
+        let mut state = self.shared.lock();
+        loop {
+            if let Some((queued, value)) = state.queue.pop_front() {
+                return Ok((value, queued.elapsed()));
+            }
+            if state.senders == 0 {
+                return Err(RecvTimeoutError::Disconnected);
+            }
+            let now = Instant::now();
+            if now >= deadline {
+                return Err(RecvTimeoutError::Timeout);
+            }
+            state = self
+                .shared
+                .available
+                .wait_timeout(state, deadline - now)
+                .unwrap_or_else(|e| e.into_inner())
+                .0;
+        }
+    }
+
+    pub fn capacity(&self) -> usize {
+        self.shared.capacity
+    }
+
+    pub fn stats(&self) -> ChannelStats {
+        let state = self.shared.lock();
+        ChannelStats {
+            depth: state.queue.len(),
+            ..state.stats
+        }
+    }
 }
 
-impl<T> From<mpsc::SendError<T>> for SafeSendError<T> {
-    fn from(err: mpsc::SendError<T>) -> Self {
-        SafeSendError::SendError(err)
+impl<T> Drop for SafeReceiver<T> {
+    fn drop(&mut self) {
+        self.shared.lock().receiver = false;
     }
 }
+
+#[derive(Debug)]
+pub enum SafeSendError<T> {
+    /// The receiver has been dropped.
+    Disconnected(T),
+    /// The receiver is not ready to accept values.
+    NotReady(T),
+}
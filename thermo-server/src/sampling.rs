@@ -0,0 +1,173 @@
+use std::time::{Duration, Instant};
+
+use crate::data_format::Readings;
+
+/// Sampling configuration of a sensor bus.
+#[derive(Debug, Clone, Copy)]
+pub struct Sampling {
+    /// Interval between the starts of two readouts of the bus.
+    pub period: Duration,
+    /// A reading is only sent when it moved by more than this since it was last sent. 0 sends every reading.
+    pub deadband: f32,
+    /// With a deadband, a reading is sent again after this long even if it did not change.
+    pub heartbeat: Duration,
+}
+
+impl Sampling {
+    /// Sampling period of bus `idx`, taken from `periods_ms` in bus order. The last period applies to the remaining buses.
+    pub fn period_for(periods_ms: &[u64], idx: usize) -> Duration {
+        Duration::from_millis(
+            periods_ms
+                .get(idx)
+                .or(periods_ms.last())
+                .copied()
+                .unwrap_or(1000),
+        )
+    }
+}
+
+/// Change-triggered reporting for the sensors of one bus.
+///
+/// Sensors left out of a filtered measurement have not changed: the client keeps their last value,
+/// and hears from them at least once per heartbeat. A bus may send its sensors in several measurements.
+///
+/// A reading counts as sent once the channel accepts it, but the channel may still drop it later. Pass
+/// the drop count of the channel to [`Self::dropped`] before each filter, so that the next measurement
+/// goes out in full after a drop, instead of a heartbeat later.
+#[derive(Debug)]
+pub struct Deadband {
+    deadband: f32,
+    heartbeat: Duration,
+    sent: Vec<(u32, f32, Instant)>, // Last reading sent for each sensor, and when
+    dropped: u64,                   // Drop count of the channel at the last check
+}
+
+impl Deadband {
+    pub fn new(sampling: &Sampling) -> Self {
+        Self {
+            deadband: sampling.deadband,
+            heartbeat: sampling.heartbeat,
+            sent: Vec::new(),
+            dropped: 0,
+        }
+    }
+
+    /// Forget what was sent, so that the next measurement is sent in full, e.g. after the sensors were
+    /// enumerated again or the serial sink was down.
+    pub fn reset(&mut self) {
+        self.sent.clear();
+    }
+
+    /// Check the drop count of the channel (see [`crate::safe_mpsc::ChannelStats::dropped`]), and forget
+    /// what was sent if it moved: the channel may have dropped a reading that was recorded as sent.
+    pub fn dropped(&mut self, dropped: u64) {
+        if dropped != self.dropped {
+            self.dropped = dropped;
+            self.reset();
+        }
+    }
+
+    /// Keep the readings that changed by more than the deadband, or that are due for a heartbeat.
+    pub fn filter(&mut self, readings: &Readings, now: Instant) -> Readings {
+        if self.deadband <= 0.0 {
+            return *readings;
+        }
+        let mut out = Readings::new();
+        for &(id, value) in readings.iter() {
+            match self.sent.iter_mut().find(|(sent_id, _, _)| *sent_id == id) {
+                Some(sent) => {
+                    if (value - sent.1).abs() > self.deadband
+                        || now.saturating_duration_since(sent.2) >= self.heartbeat
+                    {
+                        *sent = (id, value, now);
+                        out.push(id, value);
+                    }
+                }
+                None => {
+                    self.sent.push((id, value, now)); // allocates only for new sensors
+                    out.push(id, value);
+                }
+            }
+        }
+        out
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn readings(values: &[(u32, f32)]) -> Readings {
+        values.iter().copied().collect()
+    }
+
+    fn deadband(deadband: f32) -> Deadband {
+        Deadband::new(&Sampling {
+            period: Duration::from_secs(1),
+            deadband,
+            heartbeat: Duration::from_secs(10),
+        })
+    }
+
+    #[test]
+    fn test_deadband_filter() {
+        let mut deadband = deadband(0.5);
+        let now = Instant::now();
+        let first = readings(&[(1, 20.0), (2, 30.0)]);
+        // Every sensor is sent the first time
+        assert_eq!(*deadband.filter(&first, now), *first);
+        // Changes within the deadband are left out
+        let small = readings(&[(1, 20.4), (2, 29.6)]);
+        assert!(deadband.filter(&small, now).is_empty());
+        // Measured against the last value sent, not the last value read
+        let drift = readings(&[(1, 20.6), (2, 29.8)]);
+        assert_eq!(*deadband.filter(&drift, now), [(1, 20.6)]);
+        // New sensors are sent right away
+        let new = readings(&[(2, 29.8), (3, 40.0)]);
+        assert_eq!(*deadband.filter(&new, now), [(3, 40.0)]);
+    }
+
+    #[test]
+    fn test_deadband_heartbeat() {
+        let mut deadband = deadband(0.5);
+        let now = Instant::now();
+        let values = readings(&[(1, 20.0), (2, 30.0)]);
+        deadband.filter(&values, now);
+        let later = now + Duration::from_secs(5);
+        deadband.filter(&readings(&[(2, 31.0)]), later);
+        // Sensor 1 is due for a heartbeat, sensor 2 was sent 5 s ago
+        let heartbeat = now + Duration::from_secs(10);
+        assert_eq!(
+            *deadband.filter(&readings(&[(1, 20.0), (2, 31.0)]), heartbeat),
+            [(1, 20.0)]
+        );
+        // Everything is sent again after a reset
+        deadband.reset();
+        assert_eq!(*deadband.filter(&values, heartbeat), *values);
+    }
+
+    #[test]
+    fn test_deadband_dropped() {
+        let mut deadband = deadband(0.5);
+        let now = Instant::now();
+        let values = readings(&[(1, 20.0), (2, 30.0)]);
+        deadband.dropped(0);
+        deadband.filter(&values, now);
+        let changed = readings(&[(1, 21.0), (2, 30.0)]);
+        assert_eq!(*deadband.filter(&changed, now), [(1, 21.0)]);
+        // The channel dropped something since: it may have been the change above
+        deadband.dropped(3);
+        assert_eq!(*deadband.filter(&changed, now), *changed);
+        deadband.dropped(3);
+        assert!(deadband.filter(&changed, now).is_empty());
+    }
+
+    #[test]
+    fn test_deadband_disabled() {
+        let mut deadband = deadband(0.0);
+        let now = Instant::now();
+        let values = readings(&[(1, 20.0)]);
+        assert_eq!(*deadband.filter(&values, now), *values);
+        assert_eq!(*deadband.filter(&values, now), *values);
+    }
+}
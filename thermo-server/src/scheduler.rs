@@ -0,0 +1,352 @@
+use std::{
+    panic::{self, AssertUnwindSafe},
+    sync::{
+        Arc, Mutex,
+        atomic::{AtomicBool, Ordering},
+        mpsc,
+    },
+    thread,
+    time::{Duration, Instant},
+};
+
+/// Resolution of the timer wheel.
+const WHEEL_RESOLUTION: Duration = Duration::from_millis(10);
+/// Slots in the timer wheel, one revolution is 1.28 s. Longer delays wait for several revolutions.
+const WHEEL_SLOTS: usize = 128;
+/// Longest time the scheduler sleeps before checking whether it should stop.
+const MAX_IDLE: Duration = Duration::from_secs(1);
+/// Delay before running a job again after it panicked, doubled on every consecutive panic.
+const PANIC_BACKOFF: Duration = Duration::from_secs(1);
+/// Longest delay before running a job again after it panicked.
+const PANIC_BACKOFF_MAX: Duration = Duration::from_secs(60);
+
+/// What a job wants to happen after a run.
+#[derive(Debug, Clone, Copy)]
+pub enum Step {
+    /// Run again at the next tick of the job period.
+    Idle,
+    /// Run again after this long, within the same tick, e.g. once a conversion is done.
+    Again(Duration),
+}
+
+/// Periodic work on a sensor bus, run by the scheduler on a worker thread.
+pub trait Job: Send {
+    /// Name of the job, for logging.
+    fn name(&self) -> &str;
+    /// Interval between two ticks of the job.
+    fn period(&self) -> Duration;
+    /// Do the work due at `tick`. `tick` is the scheduled start of the current period, shared by every
+    /// job with the same period, and is used as the acquisition time of the measurements.
+    fn run(&mut self, tick: Instant) -> Step;
+    /// Drop the devices after [`Self::run`] panicked, so that the next run sets the bus up again.
+    fn reset(&mut self) {}
+}
+
+/// Hashed timer wheel of `(deadline tick, item)` entries.
+struct TimerWheel<T> {
+    epoch: Instant,
+    current: u64, // First tick that has not been expired yet
+    slots: Vec<Vec<(u64, T)>>,
+}
+
+impl<T> TimerWheel<T> {
+    fn new(epoch: Instant) -> Self {
+        Self {
+            epoch,
+            current: 0,
+            slots: (0..WHEEL_SLOTS).map(|_| Vec::new()).collect(),
+        }
+    }
+
+    /// Tick at or after `time`, so that an entry never expires early.
+    fn tick_after(&self, time: Instant) -> u64 {
+        let ns = time.saturating_duration_since(self.epoch).as_nanos();
+        ns.div_ceil(WHEEL_RESOLUTION.as_nanos()) as u64
+    }
+
+    fn insert(&mut self, deadline: Instant, item: T) {
+        let tick = self.tick_after(deadline).max(self.current);
+        self.slots[tick as usize % WHEEL_SLOTS].push((tick, item));
+    }
+
+    /// Move the entries that are due at `now` to `expired`.
+    fn expire(&mut self, now: Instant, expired: &mut Vec<T>) {
+        let target = (now.saturating_duration_since(self.epoch).as_nanos()
+            / WHEEL_RESOLUTION.as_nanos()) as u64;
+        if target < self.current {
+            return;
+        }
+        let steps = (target - self.current + 1).min(WHEEL_SLOTS as u64);
+        for step in 0..steps {
+            let slot = &mut self.slots[(self.current + step) as usize % WHEEL_SLOTS];
+            let mut idx = 0;
+            while idx < slot.len() {
+                if slot[idx].0 <= target {
+                    expired.push(slot.swap_remove(idx).1);
+                } else {
+                    idx += 1;
+                }
+            }
+        }
+        self.current = target + 1;
+    }
+
+    /// Time of the earliest entry.
+    fn next_deadline(&self) -> Option<Instant> {
+        self.slots
+            .iter()
+            .flat_map(|slot| slot.iter().map(|(tick, _)| *tick))
+            .min()
+            .map(|tick| {
+                self.epoch + Duration::from_nanos(tick * WHEEL_RESOLUTION.as_nanos() as u64)
+            })
+    }
+}
+
+/// A job that is due: its index, and the tick it runs for.
+type Due = (usize, Instant);
+/// A job sent to a worker, or returned by it with the step it asked for.
+type Work = (usize, Instant, Box<dyn Job>);
+type Done = (usize, Instant, Box<dyn Job>, Option<Step>);
+
+/// Runs every sensor bus from one timer wheel, on a small pool of worker threads.
+///
+/// Ticks are phase aligned: a job with period `p` runs at `epoch + k * p`, so that buses with the same
+/// period convert at the same instant, and their measurements land in the same serial batch.
+/// A job never runs on two workers at once, and ticks missed by a slow job are skipped. A job that
+/// panics is reset and runs again after a backoff; the process exits if the reset panics as well.
+pub struct Scheduler {
+    workers: usize,
+    jobs: Vec<Option<Box<dyn Job>>>,
+}
+
+impl Scheduler {
+    pub fn new(workers: usize) -> Self {
+        Self {
+            workers: workers.max(1),
+            jobs: Vec::new(),
+        }
+    }
+
+    pub fn add(&mut self, job: Box<dyn Job>) {
+        self.jobs.push(Some(job));
+    }
+
+    /// Start of the first tick of `period` after `now`.
+    fn next_tick(epoch: Instant, period: Duration, now: Instant) -> Instant {
+        let period_ns = period.as_nanos().max(1);
+        let elapsed = now.saturating_duration_since(epoch).as_nanos();
+        let ticks = elapsed / period_ns + 1;
+        epoch + Duration::from_nanos((ticks * period_ns) as u64)
+    }
+
+    /// Run the jobs until `running` is cleared, then wait for the workers to finish their current job.
+    pub fn run(mut self, running: &AtomicBool) {
+        let epoch = Instant::now();
+        let mut wheel = TimerWheel::<Due>::new(epoch);
+        for (idx, job) in self.jobs.iter().enumerate() {
+            if let Some(job) = job {
+                log::info!("[SCH] {}: Period {:?}", job.name(), job.period());
+            }
+            wheel.insert(epoch, (idx, epoch)); // every job starts on the first tick
+        }
+        let (work_tx, work_rx) = mpsc::channel::<Work>();
+        let work_rx = Arc::new(Mutex::new(work_rx));
+        let (done_tx, done_rx) = mpsc::channel::<Done>();
+        let workers = (0..self.workers.min(self.jobs.len().max(1)))
+            .map(|id| {
+                let work_rx = work_rx.clone();
+                let done_tx = done_tx.clone();
+                thread::spawn(move || worker(id, work_rx, done_tx))
+            })
+            .collect::<Vec<_>>();
+        drop(done_tx);
+        log::info!(
+            "[SCH] Running {} jobs on {} workers",
+            self.jobs.len(),
+            workers.len()
+        );
+        let mut expired = Vec::with_capacity(self.jobs.len());
+        let mut panics = vec![0u32; self.jobs.len()]; // Consecutive panics of each job
+        while running.load(Ordering::Relaxed) {
+            let now = Instant::now();
+            wheel.expire(now, &mut expired);
+            for (idx, tick) in expired.drain(..) {
+                if let Some(job) = self.jobs[idx].take() {
+                    let _ = work_tx.send((idx, tick, job));
+                }
+            }
+            let timeout = wheel
+                .next_deadline()
+                .map_or(MAX_IDLE, |deadline| deadline.saturating_duration_since(now))
+                .min(MAX_IDLE);
+            let mut done = done_rx.recv_timeout(timeout).ok();
+            while let Some((idx, tick, job, step)) = done {
+                let now = Instant::now();
+                match step {
+                    Some(Step::Idle) => {
+                        panics[idx] = 0;
+                        let next = Self::next_tick(epoch, job.period(), now);
+                        wheel.insert(next, (idx, next));
+                        self.jobs[idx] = Some(job);
+                    }
+                    Some(Step::Again(delay)) => {
+                        wheel.insert(now + delay, (idx, tick));
+                        self.jobs[idx] = Some(job);
+                    }
+                    None => {
+                        panics[idx] = panics[idx].saturating_add(1);
+                        let backoff = PANIC_BACKOFF
+                            .saturating_mul(1 << (panics[idx] - 1).min(16))
+                            .min(PANIC_BACKOFF_MAX);
+                        log::error!(
+                            "[SCH] {}: Job panicked ({} in a row), running it again in {backoff:?}",
+                            job.name(),
+                            panics[idx]
+                        );
+                        let next = Self::next_tick(epoch, job.period(), now + backoff);
+                        wheel.insert(next, (idx, next));
+                        self.jobs[idx] = Some(job);
+                    }
+                }
+                done = done_rx.try_recv().ok();
+            }
+        }
+        drop(work_tx); // workers exit once they are done with their current job
+        for hdl in workers {
+            if let Err(e) = hdl.join() {
+                log::error!("[SCH] Worker panicked with error: {e:#?}");
+            }
+        }
+        log::info!("[SCH] Scheduler stopped");
+    }
+}
+
+fn worker(id: usize, work: Arc<Mutex<mpsc::Receiver<Work>>>, done: mpsc::Sender<Done>) {
+    log::info!("[SCH] Worker {id} started");
+    loop {
+        let next = work.lock().unwrap_or_else(|e| e.into_inner()).recv();
+        let Ok((idx, tick, mut job)) = next else {
+            break; // the scheduler is stopping
+        };
+        let step = panic::catch_unwind(AssertUnwindSafe(|| job.run(tick))).ok();
+        if step.is_none() && panic::catch_unwind(AssertUnwindSafe(|| job.reset())).is_err() {
+            // The job can not be recovered: exit, so that the service manager restarts the server
+            log::error!(
+                "[SCH] {}: Job panicked while resetting, exiting",
+                job.name()
+            );
+            std::process::exit(1);
+        }
+        if done.send((idx, tick, job, step)).is_err() {
+            break;
+        }
+    }
+    log::info!("[SCH] Worker {id} exiting");
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn expire(wheel: &mut TimerWheel<u32>, now: Instant) -> Vec<u32> {
+        let mut expired = Vec::new();
+        wheel.expire(now, &mut expired);
+        expired.sort();
+        expired
+    }
+
+    #[test]
+    fn test_wheel_expiry() {
+        let epoch = Instant::now();
+        let mut wheel = TimerWheel::new(epoch);
+        assert_eq!(wheel.next_deadline(), None);
+        wheel.insert(epoch + Duration::from_millis(25), 3);
+        wheel.insert(epoch + Duration::from_millis(5), 1);
+        wheel.insert(epoch, 0);
+        assert_eq!(wheel.next_deadline(), Some(epoch));
+        assert_eq!(expire(&mut wheel, epoch), [0]);
+        // Deadlines are rounded up to the next tick, never down
+        assert_eq!(expire(&mut wheel, epoch + Duration::from_millis(9)), []);
+        assert_eq!(expire(&mut wheel, epoch + Duration::from_millis(10)), [1]);
+        assert_eq!(
+            wheel.next_deadline(),
+            Some(epoch + Duration::from_millis(30))
+        );
+        assert_eq!(expire(&mut wheel, epoch + Duration::from_millis(29)), []);
+        assert_eq!(expire(&mut wheel, epoch + Duration::from_millis(35)), [3]);
+        assert_eq!(wheel.next_deadline(), None);
+        // Entries in the past expire on the first tick that has not been expired yet
+        wheel.insert(epoch, 4);
+        assert_eq!(expire(&mut wheel, epoch + Duration::from_millis(35)), []);
+        assert_eq!(expire(&mut wheel, epoch + Duration::from_millis(40)), [4]);
+    }
+
+    #[test]
+    fn test_wheel_revolutions() {
+        let epoch = Instant::now();
+        let mut wheel = TimerWheel::new(epoch);
+        let revolution = WHEEL_RESOLUTION * WHEEL_SLOTS as u32;
+        wheel.insert(epoch + revolution + WHEEL_RESOLUTION, 1); // same slot as the next entry
+        wheel.insert(epoch + WHEEL_RESOLUTION, 0);
+        wheel.insert(epoch + revolution * 3, 2);
+        assert_eq!(expire(&mut wheel, epoch + WHEEL_RESOLUTION), [0]);
+        assert_eq!(expire(&mut wheel, epoch + revolution), []);
+        // A late call still expires everything that is due, after skipping whole revolutions
+        assert_eq!(expire(&mut wheel, epoch + revolution * 3), [1, 2]);
+        assert_eq!(wheel.next_deadline(), None);
+    }
+
+    /// Panics on its first run, and counts its runs and resets.
+    struct Flaky {
+        runs: Arc<std::sync::atomic::AtomicUsize>,
+        resets: Arc<std::sync::atomic::AtomicUsize>,
+    }
+
+    impl Job for Flaky {
+        fn name(&self) -> &str {
+            "flaky"
+        }
+
+        fn period(&self) -> Duration {
+            Duration::from_millis(20)
+        }
+
+        fn run(&mut self, _tick: Instant) -> Step {
+            if self.runs.fetch_add(1, Ordering::Relaxed) == 0 {
+                panic!("flaky job");
+            }
+            Step::Idle
+        }
+
+        fn reset(&mut self) {
+            self.resets.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+
+    #[test]
+    fn test_panic_backoff() {
+        let runs = Arc::new(std::sync::atomic::AtomicUsize::new(0));
+        let resets = Arc::new(std::sync::atomic::AtomicUsize::new(0));
+        let mut scheduler = Scheduler::new(1);
+        scheduler.add(Box::new(Flaky {
+            runs: runs.clone(),
+            resets: resets.clone(),
+        }));
+        let running = Arc::new(AtomicBool::new(true));
+        let hdl = {
+            let running = running.clone();
+            thread::spawn(move || scheduler.run(&running))
+        };
+        thread::sleep(PANIC_BACKOFF / 2);
+        // Reset, and held back for the backoff
+        assert_eq!(runs.load(Ordering::Relaxed), 1);
+        assert_eq!(resets.load(Ordering::Relaxed), 1);
+        thread::sleep(PANIC_BACKOFF);
+        // Back to its period
+        assert!(runs.load(Ordering::Relaxed) > 10);
+        assert_eq!(resets.load(Ordering::Relaxed), 1);
+        running.store(false, Ordering::Relaxed);
+        hdl.join().unwrap();
+    }
+}
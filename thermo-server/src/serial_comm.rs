@@ -7,22 +7,22 @@ use std::{
         atomic::{AtomicBool, Ordering},
         mpsc,
     },
-    time::Duration,
+    time::{Duration, Instant},
 };
 
-use crate::{Measurement, safe_mpsc};
+use crate::{
+    broadcast,
+    metrics::{self, SERIAL_SOURCE, Stage},
+};
 
 const BOOT_CONFIG: &str = "/boot/firmware/cmdline.txt";
 const BOOTLOADER_MODE_CMD: &str = "tmu_bootloader";
 
-pub fn serial_thread(
-    path: String,
-    running: Arc<AtomicBool>,
-    source: safe_mpsc::SafeReceiver<Measurement>,
-) {
+pub fn serial_thread(path: String, running: Arc<AtomicBool>, ring: Arc<broadcast::Ring>) {
     log::info!("[COM] Serial thread started");
+    let write_time = metrics::histogram(Stage::SerialWrite, SERIAL_SOURCE);
+    let flush_time = metrics::histogram(Stage::SerialFlush, SERIAL_SOURCE);
     'root: while running.load(Ordering::Relaxed) {
-        source.set_ready(false);
         let ser = serialport::new(&path, 115200).timeout(Duration::from_secs(1));
         let mut ser = match serialport::TTYPort::open(&ser) {
             Ok(ser) => {
@@ -43,34 +43,50 @@ pub fn serial_thread(
             let sig = sig.clone();
             std::thread::spawn(move || serial_reader(reader, sig))
         };
-        source.set_ready(true); // here we are ready to receive data from various streams
+        // Batches published while the port was closed are not sent
+        let mut sub = ring.subscribe();
+        let mut skipped = 0;
+        let mut block = Vec::with_capacity(sub.slot_len());
         log::info!("[COM] Serial sink is ready to receive data");
+        let mut disconnected = false;
         'readout: while running.load(Ordering::Relaxed) {
-            let samp = match source.receiver().recv_timeout(Duration::from_secs(2)) {
-                Ok(samp) => samp,
-                Err(e) => match e {
-                    mpsc::RecvTimeoutError::Timeout => {
-                        log::warn!("[COM] Timeout while waiting for data: {e}");
-                        continue 'readout;
-                    }
-                    mpsc::RecvTimeoutError::Disconnected => {
-                        log::warn!("[COM] Data source disconnected: {e}");
-                        break 'root;
-                    }
-                },
-            };
-            if let Err(e) = ser.write_all(&samp.to_le_bytes()) {
+            match sub.recv_timeout(&mut block, Duration::from_secs(1)) {
+                Ok(()) => {}
+                Err(mpsc::RecvTimeoutError::Timeout) => continue 'readout,
+                Err(mpsc::RecvTimeoutError::Disconnected) => {
+                    log::warn!("[COM] Encoder stopped");
+                    disconnected = true;
+                    break 'readout;
+                }
+            }
+            if sub.skipped() != skipped {
+                log::warn!(
+                    "[COM] Serial port fell behind, skipped {} batches ({} total)",
+                    sub.skipped() - skipped,
+                    sub.skipped()
+                );
+                skipped = sub.skipped();
+            }
+            let start = Instant::now();
+            if let Err(e) = ser.write_all(&block) {
                 log::error!("[COM] Failed to write data to serial port: {e}");
                 break 'readout;
             }
+            write_time.record_since(start);
+            let start = Instant::now();
             if let Err(e) = ser.flush() {
                 log::error!("[COM] Failed to flush serial port: {e}");
                 break 'readout;
             }
+            flush_time.record_since(start);
         }
+        drop(sub);
         log::info!("[COM] Closing serial port");
         sig.store(false, Ordering::Relaxed);
         reader_hdl.join().expect("[COM] Reader thread panicked");
+        if disconnected {
+            break 'root;
+        }
     }
     log::info!("[COM] Serial thread exiting");
 }
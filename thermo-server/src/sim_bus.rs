@@ -0,0 +1,676 @@
+use std::{
+    convert::Infallible,
+    f32::consts::TAU,
+    thread,
+    time::{Duration, Instant},
+};
+
+use embedded_onewire::{OneWire, OneWireError, OneWireResult, OneWireStatus};
+
+use crate::temp_sensors::Master;
+
+/// Family code of the DS28EA00
+const FAMILY: u8 = 0x42;
+/// Skip ROM: address every device
+const SKIP_ROM: u8 = 0xcc;
+/// Overdrive skip ROM: address every device, and switch them to overdrive
+const OD_SKIP_ROM: u8 = 0x3c;
+/// Match ROM: address one device
+const MATCH_ROM: u8 = 0x55;
+/// Overdrive match ROM: address one device, and switch it to overdrive
+const OD_MATCH_ROM: u8 = 0x69;
+/// Search ROM
+const SEARCH_ROM: u8 = 0xf0;
+/// Read ROM, with a single device on the bus
+const READ_ROM: u8 = 0x33;
+/// Resume: address the device selected by the last match ROM or search
+const RESUME: u8 = 0xa5;
+/// Start a temperature conversion
+const START_CONV: u8 = 0x44;
+/// Read the scratchpad
+const READ_SCRATCH: u8 = 0xbe;
+/// Write the alarm thresholds and the configuration register
+const WRITE_SCRATCH: u8 = 0x4e;
+/// Read the power mode
+const READ_POWERMODE: u8 = 0xb4;
+/// Scratchpad after power up: 85 °C, and 12-bit resolution
+const POWER_ON_SCRATCHPAD: [u8; 8] = [0x50, 0x05, 0x55, 0x00, 0x7f, 0xff, 0x0c, 0x10];
+/// Waits shorter than this are added up, `thread::sleep` overshoots by more than a 1-Wire time slot
+const SLEEP_MIN: Duration = Duration::from_millis(1);
+
+/// Shape of a simulated bus.
+#[derive(Debug, Clone)]
+pub struct SimConfig {
+    /// DS28EA00 devices on the bus
+    pub devices: usize,
+    /// Extra time of every operation, on top of the 1-Wire time slots, e.g. an I2C transaction to the bus master
+    pub latency: Duration,
+    /// The devices switch to overdrive speed when asked to
+    pub overdrive: bool,
+    /// Probability that a scratchpad readout has a flipped bit
+    pub crc_error_rate: f64,
+    /// Probability that a reset sees no presence pulse
+    pub no_presence_rate: f64,
+    /// Seed of the ROMs, the temperatures and the faults. Simulated buses with the same seed have the same devices
+    pub seed: u64,
+}
+
+/// xorshift64* generator, enough for ROMs and fault injection.
+#[derive(Debug, Clone)]
+struct Rng(u64);
+
+impl Rng {
+    fn new(seed: u64) -> Self {
+        Self(seed.wrapping_mul(0x9e37_79b9_7f4a_7c15) | 1)
+    }
+
+    fn next(&mut self) -> u64 {
+        self.0 ^= self.0 >> 12;
+        self.0 ^= self.0 << 25;
+        self.0 ^= self.0 >> 27;
+        self.0.wrapping_mul(0x2545_f491_4f6c_dd1d)
+    }
+
+    /// Uniform in [0, 1)
+    fn unit(&mut self) -> f64 {
+        (self.next() >> 11) as f64 / (1u64 << 53) as f64
+    }
+
+    fn chance(&mut self, probability: f64) -> bool {
+        probability > 0.0 && self.unit() < probability
+    }
+}
+
+/// Dallas/Maxim CRC-8 of the ROMs and scratchpads.
+fn crc8(data: &[u8]) -> u8 {
+    data.iter().fold(0, |mut crc, &byte| {
+        let mut byte = byte;
+        for _ in 0..8 {
+            let mix = (crc ^ byte) & 1;
+            crc >>= 1;
+            if mix != 0 {
+                crc ^= 0x8c;
+            }
+            byte >>= 1;
+        }
+        crc
+    })
+}
+
+/// A simulated DS28EA00.
+#[derive(Debug)]
+struct Device {
+    rom: u64,
+    scratchpad: [u8; 9],
+    base: f32,             // Mean temperature, in °C
+    phase: f32,            // Of the slow temperature swing
+    speed: f32,            // Fraction of the worst case conversion time this device takes
+    done: Option<Instant>, // End of the conversion in progress
+    overdrive: bool,
+    resume: bool, // Selected by the last match ROM or search, and answers a resume
+}
+
+impl Device {
+    fn new(rng: &mut Rng, index: usize) -> Self {
+        let mut rom = [0; 8];
+        rom[0] = FAMILY;
+        rom[1..7].copy_from_slice(&rng.next().to_le_bytes()[..6]);
+        rom[7] = crc8(&rom[..7]);
+        let mut scratchpad = [0; 9];
+        scratchpad[..8].copy_from_slice(&POWER_ON_SCRATCHPAD);
+        scratchpad[8] = crc8(&scratchpad[..8]);
+        Self {
+            rom: u64::from_le_bytes(rom),
+            scratchpad,
+            base: 20.0 + (index % 32) as f32 * 0.25,
+            phase: rng.unit() as f32 * TAU,
+            speed: 0.7 + 0.2 * rng.unit() as f32,
+            done: None,
+            overdrive: false,
+            resume: false,
+        }
+    }
+
+    /// Resolution in bits beyond 9, from the configuration register
+    fn resolution(&self) -> u8 {
+        (self.scratchpad[4] >> 5) & 0b11
+    }
+
+    fn start_conversion(&mut self, now: Instant) {
+        let worst = Duration::from_micros(93_750 << self.resolution());
+        self.done = Some(now + worst.mul_f32(self.speed));
+    }
+
+    /// Latch the temperature once the conversion in progress is done. Returns whether it is done.
+    fn settle(&mut self, now: Instant, epoch: Instant) -> bool {
+        match self.done {
+            Some(done) if done <= now => {
+                self.done = None;
+                let swing = 0.5 * (TAU * epoch.elapsed().as_secs_f32() / 300.0 + self.phase).sin();
+                let mask = !((1i16 << (3 - self.resolution())) - 1);
+                let raw = ((self.base + swing) * 16.0).round() as i16 & mask;
+                self.scratchpad[..2].copy_from_slice(&raw.to_le_bytes());
+                self.scratchpad[8] = crc8(&self.scratchpad[..8]);
+                true
+            }
+            Some(_) => false,
+            None => true,
+        }
+    }
+}
+
+/// Where the bus is in a transaction, after the last reset.
+#[derive(Debug, Clone, Copy)]
+enum Phase {
+    /// Nothing answers until the next reset
+    Idle,
+    /// Waiting for a ROM command
+    Rom,
+    /// Receiving the ROM of a (overdrive) match ROM command
+    Match { rom: u64, len: u8, overdrive: bool },
+    /// Search ROM: the id bit, its complement, and the chosen direction, for each bit of the ROM
+    Search { bit: u8, step: u8 },
+    /// Sending the ROM of the single device on the bus
+    ReadRom(usize),
+    /// Waiting for a function command from the selected devices
+    Function,
+    /// Read slots return whether the conversion is done
+    Converting,
+    /// Sending the scratchpad
+    ReadScratch(usize),
+    /// Receiving the alarm thresholds and the configuration register
+    WriteScratch(usize),
+    /// Read slots return the power mode
+    PowerMode,
+}
+
+/// Status of a simulated reset.
+#[derive(Debug, Clone, Copy)]
+pub struct SimStatus {
+    presence: bool,
+}
+
+impl OneWireStatus for SimStatus {
+    fn presence(&self) -> bool {
+        self.presence
+    }
+
+    fn shortcircuit(&self) -> bool {
+        false
+    }
+}
+
+/// A simulated 1-Wire bus master, with DS28EA00 devices on its bus.
+///
+/// The devices answer ROM searches, (overdrive) match and skip ROM, conversions, scratchpad reads and
+/// writes and power mode reads, with the resolution dependent conversion time and the time slots of
+/// the bus speed. Devices that do not follow the bus into overdrive stop answering until a standard
+/// speed reset, as on a real bus.
+#[derive(Debug)]
+pub struct SimBus {
+    name: String,
+    config: SimConfig,
+    rng: Rng,
+    epoch: Instant,
+    due: Instant, // Simulated time, ahead of the clock by the waits not slept yet
+    devices: Vec<Device>,
+    selected: Vec<bool>,
+    phase: Phase,
+    overdrive: bool,
+    corrupt: Option<(usize, u8)>, // Byte and bit flipped in the scratchpad readout in progress
+}
+
+impl SimBus {
+    pub fn new(name: &str, config: SimConfig) -> Self {
+        let mut rng = Rng::new(config.seed);
+        let devices = (0..config.devices)
+            .map(|i| Device::new(&mut rng, i))
+            .collect();
+        let now = Instant::now();
+        Self {
+            name: name.to_owned(),
+            selected: vec![false; config.devices],
+            config,
+            rng,
+            epoch: now,
+            due: now,
+            devices,
+            phase: Phase::Idle,
+            overdrive: false,
+            corrupt: None,
+        }
+    }
+
+    /// Spend the time of an operation with `slots` time slots, on top of the configured latency.
+    fn spend(&mut self, slots: u32) {
+        let slot = if self.overdrive {
+            Duration::from_micros(10)
+        } else {
+            Duration::from_micros(70)
+        };
+        let now = Instant::now();
+        self.due = self.due.max(now) + self.config.latency + slot * slots;
+        if self.due - now >= SLEEP_MIN {
+            thread::sleep(self.due - now);
+        }
+    }
+
+    /// Wired AND of the selected devices: an unselected or absent device leaves the bus high.
+    fn wired_and(&self, value: impl Fn(&Device) -> u8) -> u8 {
+        self.devices
+            .iter()
+            .zip(self.selected.iter())
+            .filter(|(_, selected)| **selected)
+            .fold(0xff, |acc, (device, _)| acc & value(device))
+    }
+
+    /// Switch the selected devices to overdrive. Devices that do not support it drop out.
+    fn enter_overdrive(&mut self) {
+        for (device, selected) in self.devices.iter_mut().zip(self.selected.iter_mut()) {
+            if *selected {
+                if self.config.overdrive {
+                    device.overdrive = true;
+                } else {
+                    *selected = false;
+                }
+            }
+        }
+    }
+
+    fn now(&self) -> Instant {
+        self.due.max(Instant::now())
+    }
+}
+
+impl OneWire for SimBus {
+    type Status = SimStatus;
+    type BusError = Infallible;
+
+    fn reset(&mut self) -> OneWireResult<Self::Status, Self::BusError> {
+        self.spend(16); // reset pulse and presence detect take about 16 time slots at either speed
+        self.corrupt = None;
+        if self.rng.chance(self.config.no_presence_rate) {
+            log::debug!("[TMP] {}> Simulated missing presence pulse", self.name);
+            self.selected.fill(false);
+            self.phase = Phase::Idle;
+            return Ok(SimStatus { presence: false });
+        }
+        // A standard speed reset brings every device back to standard speed, an overdrive
+        // reset is too short for the devices at standard speed
+        let overdrive = self.overdrive;
+        for (device, selected) in self.devices.iter_mut().zip(self.selected.iter_mut()) {
+            if !overdrive {
+                device.overdrive = false;
+            }
+            *selected = device.overdrive == overdrive;
+        }
+        let presence = self.selected.iter().any(|s| *s);
+        self.phase = if presence { Phase::Rom } else { Phase::Idle };
+        Ok(SimStatus { presence })
+    }
+
+    fn address(&mut self, rom: Option<u64>) -> OneWireResult<(), Self::BusError> {
+        if !self.reset()?.presence() {
+            return Err(OneWireError::NoDevicePresent);
+        }
+        match rom {
+            None => self.write_byte(SKIP_ROM),
+            Some(rom) => {
+                self.write_byte(MATCH_ROM)?;
+                for byte in rom.to_le_bytes() {
+                    self.write_byte(byte)?;
+                }
+                Ok(())
+            }
+        }
+    }
+
+    fn write_byte(&mut self, byte: u8) -> OneWireResult<(), Self::BusError> {
+        self.spend(8);
+        self.phase = match self.phase {
+            Phase::Rom => match byte {
+                SKIP_ROM => {
+                    self.devices
+                        .iter_mut()
+                        .for_each(|device| device.resume = false);
+                    Phase::Function
+                }
+                OD_SKIP_ROM => {
+                    self.devices
+                        .iter_mut()
+                        .for_each(|device| device.resume = false);
+                    self.enter_overdrive();
+                    Phase::Function
+                }
+                RESUME => {
+                    for (device, selected) in self.devices.iter().zip(self.selected.iter_mut()) {
+                        *selected &= device.resume;
+                    }
+                    Phase::Function
+                }
+                MATCH_ROM | OD_MATCH_ROM => Phase::Match {
+                    rom: 0,
+                    len: 0,
+                    overdrive: byte == OD_MATCH_ROM,
+                },
+                SEARCH_ROM => Phase::Search { bit: 0, step: 0 },
+                READ_ROM => Phase::ReadRom(0),
+                _ => Phase::Idle,
+            },
+            Phase::Match {
+                rom,
+                len,
+                overdrive,
+            } => {
+                let rom = rom | (byte as u64) << (8 * len);
+                if len < 7 {
+                    Phase::Match {
+                        rom,
+                        len: len + 1,
+                        overdrive,
+                    }
+                } else {
+                    for (device, selected) in self.devices.iter_mut().zip(self.selected.iter_mut())
+                    {
+                        *selected &= device.rom == rom;
+                        device.resume = *selected;
+                    }
+                    if overdrive {
+                        self.enter_overdrive();
+                    }
+                    Phase::Function
+                }
+            }
+            Phase::Function => match byte {
+                START_CONV => {
+                    let now = self.now();
+                    for (device, selected) in self.devices.iter_mut().zip(self.selected.iter()) {
+                        if *selected {
+                            device.start_conversion(now);
+                        }
+                    }
+                    Phase::Converting
+                }
+                READ_SCRATCH => {
+                    let (now, epoch) = (self.now(), self.epoch);
+                    for (device, selected) in self.devices.iter_mut().zip(self.selected.iter()) {
+                        if *selected {
+                            device.settle(now, epoch);
+                        }
+                    }
+                    if self.rng.chance(self.config.crc_error_rate) {
+                        let at = (self.rng.next() % 9) as usize;
+                        let bit = 1 << (self.rng.next() % 8);
+                        log::debug!(
+                            "[TMP] {}> Simulated bit error in scratchpad byte {at}",
+                            self.name
+                        );
+                        self.corrupt = Some((at, bit));
+                    }
+                    Phase::ReadScratch(0)
+                }
+                WRITE_SCRATCH => Phase::WriteScratch(0),
+                READ_POWERMODE => Phase::PowerMode,
+                _ => Phase::Idle, // PIO access and the EEPROM commands are not modelled
+            },
+            Phase::WriteScratch(at) => {
+                for (device, selected) in self.devices.iter_mut().zip(self.selected.iter()) {
+                    if *selected {
+                        device.scratchpad[2 + at] = byte;
+                        device.scratchpad[8] = crc8(&device.scratchpad[..8]);
+                    }
+                }
+                if at < 2 {
+                    Phase::WriteScratch(at + 1)
+                } else {
+                    Phase::Idle
+                }
+            }
+            _ => Phase::Idle,
+        };
+        Ok(())
+    }
+
+    fn read_byte(&mut self) -> OneWireResult<u8, Self::BusError> {
+        self.spend(8);
+        let byte = match self.phase {
+            Phase::ReadScratch(at) => {
+                self.phase = Phase::ReadScratch(at + 1);
+                let byte =
+                    self.wired_and(|device| device.scratchpad.get(at).copied().unwrap_or(0xff));
+                match self.corrupt {
+                    Some((pos, bit)) if pos == at => byte ^ bit,
+                    _ => byte,
+                }
+            }
+            Phase::ReadRom(at) => {
+                self.phase = Phase::ReadRom(at + 1);
+                self.wired_and(|device| device.rom.to_le_bytes().get(at).copied().unwrap_or(0xff))
+            }
+            _ => 0xff,
+        };
+        Ok(byte)
+    }
+
+    fn write_bit(&mut self, bit: bool) -> OneWireResult<(), Self::BusError> {
+        self.spend(1);
+        if let Phase::Search { bit: at, step: 2 } = self.phase {
+            for (device, selected) in self.devices.iter_mut().zip(self.selected.iter_mut()) {
+                *selected &= (device.rom >> at & 1 == 1) == bit;
+                device.resume = *selected;
+            }
+            self.phase = if at < 63 {
+                Phase::Search {
+                    bit: at + 1,
+                    step: 0,
+                }
+            } else {
+                Phase::Function
+            };
+        }
+        Ok(())
+    }
+
+    fn read_bit(&mut self) -> OneWireResult<bool, Self::BusError> {
+        self.spend(1);
+        let bit = match self.phase {
+            Phase::Search { bit: at, step } if step < 2 => {
+                self.phase = Phase::Search {
+                    bit: at,
+                    step: step + 1,
+                };
+                let complement = if step == 1 { 1 } else { 0 };
+                self.wired_and(|device| ((device.rom >> at) as u8 & 1) ^ complement) & 1 == 1
+            }
+            Phase::Converting => {
+                let (now, epoch) = (self.now(), self.epoch);
+                self.devices
+                    .iter_mut()
+                    .zip(self.selected.iter())
+                    .filter(|(_, selected)| **selected)
+                    .fold(true, |done, (device, _)| device.settle(now, epoch) && done)
+            }
+            Phase::PowerMode => true, // externally powered
+            _ => true,
+        };
+        Ok(bit)
+    }
+
+    fn get_overdrive_mode(&mut self) -> bool {
+        self.overdrive
+    }
+
+    fn set_overdrive_mode(&mut self, enable: bool) -> OneWireResult<(), Self::BusError> {
+        if enable {
+            // Overdrive skip ROM at standard speed, then follow the devices
+            self.overdrive = false;
+            if !self.reset()?.presence() {
+                return Err(OneWireError::NoDevicePresent);
+            }
+            self.write_byte(OD_SKIP_ROM)?;
+            self.overdrive = true;
+        } else {
+            // A standard speed reset brings the devices back to standard speed
+            self.overdrive = false;
+            self.reset()?;
+        }
+        Ok(())
+    }
+}
+
+/// Opens a [`SimBus`] for a [`OneWireBus`](crate::temp_sensors::OneWireBus).
+///
+/// Every open starts from powered up devices with the same ROMs, like a power cycled bus.
+pub struct SimMaster(pub SimConfig);
+
+impl Master for SimMaster {
+    type Bus = SimBus;
+
+    fn open(&mut self, lpath: &str) -> Option<Self::Bus> {
+        log::info!(
+            "[TMP] {lpath}> Simulating {} devices, {:?} latency, overdrive {}, CRC error rate {}, missing presence rate {}",
+            self.0.devices,
+            self.0.latency,
+            if self.0.overdrive {
+                "supported"
+            } else {
+                "not supported"
+            },
+            self.0.crc_error_rate,
+            self.0.no_presence_rate,
+        );
+        Some(SimBus::new(lpath, self.0.clone()))
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use ds28ea00::{Ds28ea00GroupVec, ReadoutResolution, Temperature};
+
+    use super::*;
+
+    const DEVICES: usize = 6;
+
+    fn bus(overdrive: bool) -> SimBus {
+        SimBus::new(
+            "sim-test",
+            SimConfig {
+                devices: DEVICES,
+                latency: Duration::ZERO,
+                overdrive,
+                crc_error_rate: 0.0,
+                no_presence_rate: 0.0,
+                seed: 7,
+            },
+        )
+    }
+
+    /// 9-bit conversions, so that a test waits less than 100 ms per conversion.
+    fn group() -> Ds28ea00GroupVec {
+        Ds28ea00GroupVec::default().with_resolution(ReadoutResolution::Resolution9bit)
+    }
+
+    fn convert(bus: &mut SimBus, sensors: &Ds28ea00GroupVec) {
+        sensors.start_temperature_conversion(bus).unwrap();
+        while !sensors.conversion_done(bus).unwrap() {
+            thread::sleep(Duration::from_millis(5));
+        }
+    }
+
+    #[test]
+    fn test_enumerate_read() {
+        let mut bus = bus(true);
+        let mut sensors = group();
+        assert_eq!(sensors.enumerate(&mut bus).unwrap(), DEVICES);
+        let mut found = sensors.roms().collect::<Vec<_>>();
+        let mut roms = bus
+            .devices
+            .iter()
+            .map(|device| device.rom)
+            .collect::<Vec<_>>();
+        found.sort();
+        roms.sort();
+        assert_eq!(found, roms);
+        assert!(!sensors.parasite_powered());
+        sensors.enable_overdrive(&mut bus).unwrap();
+        sensors.verify(&mut bus).unwrap();
+        convert(&mut bus, &sensors);
+        let readout = sensors.read_temperatures(&mut bus, true, false).unwrap();
+        assert_eq!(readout.len(), DEVICES);
+        for (_, temp) in readout {
+            let temp = f32::from(*temp);
+            assert!((19.0..29.0).contains(&temp), "{temp} °C");
+        }
+    }
+
+    #[test]
+    fn test_restore() {
+        let mut sensors = group();
+        sensors.enumerate(&mut bus(true)).unwrap();
+        let roms = sensors.roms().collect::<Vec<_>>();
+        // Same seed, same devices
+        let mut bus = bus(true);
+        let mut restored = group();
+        restored.enable_overdrive(&mut bus).unwrap();
+        assert_eq!(restored.restore(&mut bus, &roms).unwrap(), DEVICES);
+        assert_eq!(restored.roms().collect::<Vec<_>>(), roms);
+        convert(&mut bus, &restored);
+        restored.read_temperatures(&mut bus, true, false).unwrap();
+        // A device that is gone fails the restore
+        let mut missing = roms.clone();
+        missing[0] ^= 1 << 8;
+        assert!(matches!(
+            restored.restore(&mut bus, &missing),
+            Err(OneWireError::InvalidCrc)
+        ));
+        assert_eq!(restored.roms().count(), 0);
+    }
+
+    #[test]
+    fn test_no_overdrive_fallback() {
+        let mut bus = bus(false);
+        let mut sensors = group();
+        assert_eq!(sensors.enumerate(&mut bus).unwrap(), DEVICES);
+        // The devices stay at standard speed, and do not answer an overdrive reset
+        sensors.enable_overdrive(&mut bus).unwrap();
+        assert!(matches!(
+            sensors.verify(&mut bus),
+            Err(OneWireError::NoDevicePresent)
+        ));
+        sensors.disable_overdrive(&mut bus).unwrap();
+        assert!(!sensors.overdrive());
+        sensors.verify(&mut bus).unwrap();
+        // A cache saved in overdrive mode does not restore either
+        let roms = sensors.roms().collect::<Vec<_>>();
+        sensors.enable_overdrive(&mut bus).unwrap();
+        assert!(sensors.restore(&mut bus, &roms).is_err());
+        sensors.disable_overdrive(&mut bus).unwrap();
+        assert_eq!(sensors.restore(&mut bus, &roms).unwrap(), DEVICES);
+        convert(&mut bus, &sensors);
+        sensors.read_temperatures(&mut bus, true, false).unwrap();
+    }
+
+    #[test]
+    fn test_crc_errors() {
+        let mut bus = bus(true);
+        let mut sensors = group().with_crc_check(10, Temperature::from_bits(5 << 4));
+        sensors.enumerate(&mut bus).unwrap();
+        bus.config.crc_error_rate = 1.0; // every scratchpad readout has a flipped bit
+        convert(&mut bus, &sensors);
+        assert!(matches!(
+            sensors.read_temperatures(&mut bus, true, false),
+            Err(OneWireError::InvalidCrc)
+        ));
+        // The first fast readout is verified, and each failed device reads as -85 °C
+        let readout = sensors.read_temperatures(&mut bus, false, true).unwrap();
+        assert!(
+            readout
+                .iter()
+                .all(|(_, temp)| *temp == Temperature::from_num(-85))
+        );
+        assert_eq!(sensors.crc_errors(), DEVICES as u32);
+        bus.config.crc_error_rate = 0.0;
+        sensors.read_temperatures(&mut bus, false, false).unwrap();
+        assert_eq!(sensors.crc_errors(), DEVICES as u32);
+    }
+}
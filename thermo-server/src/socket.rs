@@ -0,0 +1,122 @@
+use std::{
+    fs,
+    io::{ErrorKind, Write},
+    os::unix::{fs::FileTypeExt, net::UnixListener, net::UnixStream},
+    path::PathBuf,
+    sync::{
+        Arc,
+        atomic::{AtomicBool, Ordering},
+        mpsc,
+    },
+    thread::JoinHandle,
+    time::Duration,
+};
+
+use crate::broadcast;
+
+/// Longest a client may take to accept a batch before it is disconnected.
+const WRITE_TIMEOUT: Duration = Duration::from_secs(5);
+
+/// Serve the encoded batches to every client connected on the Unix socket at `path`.
+///
+/// Clients receive the same byte stream as the serial port, from the batch published after they
+/// connected. Each client is written to from its own thread, so that a slow client only skips
+/// batches and never holds back the other clients or the serial port.
+pub fn socket_thread(path: PathBuf, running: Arc<AtomicBool>, ring: Arc<broadcast::Ring>) {
+    log::info!("[SOC] Socket thread started");
+    // A socket left over from a previous run would make the bind fail
+    if fs::symlink_metadata(&path).is_ok_and(|meta| meta.file_type().is_socket())
+        && let Err(e) = fs::remove_file(&path)
+    {
+        log::warn!(
+            "[SOC] Failed to remove stale socket {}: {e}",
+            path.display()
+        );
+    }
+    let listener = match UnixListener::bind(&path) {
+        Ok(listener) => listener,
+        Err(e) => {
+            log::error!("[SOC] Failed to bind socket {}: {e}", path.display());
+            return;
+        }
+    };
+    if let Err(e) = listener.set_nonblocking(true) {
+        log::error!("[SOC] Failed to set socket to non-blocking: {e}");
+        return;
+    }
+    log::info!("[SOC] Listening on {}", path.display());
+    let mut clients: Vec<JoinHandle<()>> = Vec::new();
+    let mut connected = 0;
+    while running.load(Ordering::Relaxed) {
+        match listener.accept() {
+            Ok((stream, _)) => {
+                // Subscribe here, so that the encoder starts queueing measurements right away
+                let sub = ring.subscribe();
+                let running = running.clone();
+                let id = connected;
+                connected += 1;
+                clients.retain(|client| !client.is_finished());
+                clients.push(std::thread::spawn(move || {
+                    client_thread(id, stream, sub, running)
+                }));
+                log::info!(
+                    "[SOC] Client {id} connected, {} subscribers",
+                    ring.subscribers()
+                );
+            }
+            Err(e) if e.kind() == ErrorKind::WouldBlock => {
+                std::thread::sleep(Duration::from_millis(100));
+            }
+            Err(e) => {
+                log::error!("[SOC] Failed to accept client: {e}");
+                std::thread::sleep(Duration::from_millis(100));
+            }
+        }
+    }
+    for client in clients {
+        if client.join().is_err() {
+            log::error!("[SOC] Client thread panicked");
+        }
+    }
+    if let Err(e) = fs::remove_file(&path) {
+        log::warn!("[SOC] Failed to remove socket {}: {e}", path.display());
+    }
+    log::info!("[SOC] Socket thread exiting");
+}
+
+fn client_thread(
+    id: usize,
+    mut stream: UnixStream,
+    mut sub: broadcast::Subscriber,
+    running: Arc<AtomicBool>,
+) {
+    if let Err(e) = stream
+        .set_nonblocking(false)
+        .and_then(|_| stream.set_write_timeout(Some(WRITE_TIMEOUT)))
+    {
+        log::error!("[SOC] Client {id}: failed to configure stream: {e}");
+        return;
+    }
+    let mut skipped = 0;
+    let mut block = Vec::with_capacity(sub.slot_len());
+    while running.load(Ordering::Relaxed) {
+        match sub.recv_timeout(&mut block, Duration::from_secs(1)) {
+            Ok(()) => {}
+            Err(mpsc::RecvTimeoutError::Timeout) => continue,
+            Err(mpsc::RecvTimeoutError::Disconnected) => break,
+        }
+        if sub.skipped() != skipped {
+            log::warn!(
+                "[SOC] Client {id} fell behind, skipped {} batches ({} total)",
+                sub.skipped() - skipped,
+                sub.skipped()
+            );
+            skipped = sub.skipped();
+        }
+        if let Err(e) = stream.write_all(&block) {
+            log::info!("[SOC] Client {id} disconnected: {e}");
+            return;
+        }
+    }
+    log::info!("[SOC] Client {id} closed");
+}
@@ -1,66 +1,88 @@
 use std::{
-    path::PathBuf,
-    sync::{
-        Arc,
-        atomic::{AtomicBool, Ordering},
-    },
-    thread,
+    fmt::{Debug, Write},
+    path::{Path, PathBuf},
+    sync::Arc,
     time::{Duration, Instant},
 };
 
-use ds28ea00::{Ds28ea00Group, ReadoutResolution};
-use ds2484::{DeviceConfiguration, Ds2484Builder, Interact, OneWireConfigurationBuilder};
+use ds28ea00::{Ds28ea00GroupVec, READ_ERROR_TEMPERATURE, ReadoutResolution, Temperature};
+use ds2484::{DeviceConfiguration, Ds2484, Ds2484Builder, Interact, OneWireConfigurationBuilder};
+use embedded_onewire::OneWire;
 use linux_embedded_hal::{Delay, I2cdev};
 
-use crate::{Measurement, safe_mpsc};
+use crate::{
+    Measurement,
+    data_format::{MAX_READINGS, Readings},
+    metrics::{self, Histogram, Stage},
+    safe_mpsc,
+    rom_cache::RomCache,
+    sampling::{Deadband, Sampling},
+    scheduler::{Job, Step},
+};
+
+/// Interval between conversion done polls, a small fraction of the 750 ms 12-bit conversion time
+const CONVERSION_POLL: Duration = Duration::from_millis(10);
+/// A change larger than this between two fast readouts of a sensor is verified with a CRC readout, in 1/16 °C
+const CRC_MAX_JUMP: Temperature = Temperature::from_bits(5 << 4);
+/// Delay before retrying after an error, the first retry is immediate
+const RETRY_DELAY: Duration = Duration::from_secs(1);
+
+/// Opens the 1-Wire bus master of a [`OneWireBus`], when the bus is set up and again after errors.
+pub trait Master: Send {
+    /// The bus master.
+    type Bus: OneWire<BusError: Debug> + Send;
+    /// Open and configure the bus master. Errors are logged.
+    fn open(&mut self, lpath: &str) -> Option<Self::Bus>;
+}
 
-pub fn onewire_thread(
+/// A DS2484 bus master on an I2C bus.
+pub struct Ds2484Master {
     path: PathBuf,
-    running: Arc<AtomicBool>,
-    leds: bool,
-    sink: safe_mpsc::SafeSender<Measurement>,
-    exclude: Vec<u32>,
-    no_overdrive: bool,
-    print: bool,
-) {
-    let lpath = path.to_string_lossy();
-    'root: while running.load(Ordering::Relaxed) {
+}
+
+impl Ds2484Master {
+    pub fn new(path: &Path) -> Self {
+        Self {
+            path: path.to_owned(),
+        }
+    }
+}
+
+impl Master for Ds2484Master {
+    type Bus = Ds2484<I2cdev, Delay>;
+
+    fn open(&mut self, lpath: &str) -> Option<Self::Bus> {
         log::info!("[TMP] {lpath}> Opening bus",);
         // Open the I2C bus
-        let mut i2c = match I2cdev::new(&path) {
+        let i2c = match I2cdev::new(&self.path) {
             Ok(i2c) => {
                 log::info!("[TMP] {lpath}> Bus opened successfully",);
                 i2c
             }
             Err(e) => {
                 log::error!("[TMP] {lpath}> Failed to open bus: {e}",);
-                thread::sleep(Duration::from_secs(1));
-                continue 'root;
+                return None;
             }
         };
-        let mut delay = Delay;
-        let mut ds2484 = match Ds2484Builder::default().build(&mut i2c, &mut delay) {
+        let mut ds2484 = match Ds2484Builder::default().build(i2c, Delay) {
             Ok(ds2484) => {
                 log::info!("[TMP] {lpath}> DS2484 instance created successfully",);
                 ds2484
             }
             Err(e) => {
                 log::error!("[TMP] {lpath}> Failed to create DS2484 instance: {e:?}",);
-                thread::sleep(Duration::from_secs(1));
-                continue 'root;
+                return None;
             }
         };
         let mut cfg = DeviceConfiguration::default();
         if let Err(e) = cfg.read(&mut ds2484) {
             log::error!("[TMP] {lpath}> Failed to read device configuration: {e:?}",);
-            thread::sleep(Duration::from_secs(1));
-            continue 'root;
+            return None;
         }
         cfg.set_active_pullup(true);
         if let Err(e) = cfg.write(&mut ds2484) {
             log::error!("[TMP] {lpath}> Failed to write device configuration: {e:?}",);
-            thread::sleep(Duration::from_secs(1));
-            continue 'root;
+            return None;
         }
         let mut port_cfg = OneWireConfigurationBuilder::default()
             .reset_pulse(440000, 44000)
@@ -74,107 +96,340 @@ pub fn onewire_thread(
         } else {
             log::info!("[TMP] {lpath}> Port configuration written successfully",);
         }
-        let mut delay = Delay;
-        let mut temp_sensors = Ds28ea00Group::<16>::default()
+        Some(ds2484)
+    }
+}
+
+/// A 1-Wire bus master and the DS28EA00 sensors on its bus.
+struct Devices<B> {
+    bus: B,
+    sensors: Ds28ea00GroupVec, // Sized when the bus is enumerated
+}
+
+/// Temperature readout of one 1-Wire bus, run by the scheduler.
+///
+/// Every tick starts a conversion on all sensors of the bus, then polls the bus until the sensors
+/// report done, and reads the temperatures back. The worker is free for other buses in between.
+pub struct OneWireBus<M: Master> {
+    path: PathBuf,
+    lpath: String,
+    master: M,
+    leds: bool,
+    sink: safe_mpsc::SafeSender<(Instant, Measurement)>,
+    exclude: Vec<u32>,
+    no_overdrive: bool,
+    print: bool,
+    crc_every: u16,
+    crc_errors: u32, // CRC errors already reported
+    rom_cache: Option<PathBuf>, // Directory of the ROM cache files
+    failures: u32,              // Consecutive failed attempts
+    sampling: Sampling,
+    deadband: Deadband,
+    msg: String, // Printed readout, reused so that steady state operation does not allocate
+    devices: Option<Devices<M::Bus>>, // None until the bus is set up
+    converting: Option<Instant>, // Start of the conversion in progress
+    reset_time: Arc<Histogram>,
+    conversion_time: Arc<Histogram>,
+    read_time: Arc<Histogram>,
+}
+
+impl<M: Master> OneWireBus<M> {
+    #[allow(clippy::too_many_arguments)]
+    pub fn new(
+        path: PathBuf,
+        master: M,
+        leds: bool,
+        sink: safe_mpsc::SafeSender<(Instant, Measurement)>,
+        exclude: Vec<u32>,
+        no_overdrive: bool,
+        print: bool,
+        crc_every: u16,
+        rom_cache: Option<PathBuf>,
+        sampling: Sampling,
+    ) -> Self {
+        let source = metrics::bus_source(&path);
+        Self {
+            lpath: path.to_string_lossy().into_owned(),
+            reset_time: metrics::histogram(Stage::BusReset, source),
+            conversion_time: metrics::histogram(Stage::ConversionWait, source),
+            read_time: metrics::histogram(Stage::ScratchpadRead, source),
+            path,
+            master,
+            leds,
+            sink,
+            exclude,
+            no_overdrive,
+            print,
+            crc_every,
+            crc_errors: 0,
+            rom_cache,
+            failures: 0,
+            deadband: Deadband::new(&sampling),
+            sampling,
+            msg: String::new(),
+            devices: None,
+            converting: None,
+        }
+    }
+
+    /// Open the bus, and enumerate the sensors.
+    fn setup(&mut self) -> Option<Devices<M::Bus>> {
+        let lpath = &self.lpath;
+        let mut bus = self.master.open(lpath)?;
+        let mut temp_sensors = Ds28ea00GroupVec::default()
             .with_resolution(ReadoutResolution::Resolution12bit)
             .with_t_low(-40)
             .with_t_high(50)
-            .with_toggle_pio(leds);
-        match temp_sensors.enumerate(&mut ds2484) {
-            Ok(devices) => {
-                log::info!("[TMP] {lpath}> Found {devices} devices",);
-                devices
+            .with_toggle_pio(self.leds)
+            .with_crc_check(self.crc_every, CRC_MAX_JUMP);
+        // Try the devices found last time first, a search and an overdrive probe take much longer
+        let cache_path = self
+            .rom_cache
+            .as_deref()
+            .map(|dir| RomCache::path(dir, &self.path));
+        let cache = cache_path.as_deref().and_then(RomCache::load);
+        let restored = cache.as_ref().is_some_and(|cache| {
+            Self::restore(lpath, &mut bus, &mut temp_sensors, cache, self.no_overdrive)
+        });
+        if !restored {
+            match temp_sensors.enumerate(&mut bus) {
+                Ok(devices) => {
+                    log::info!("[TMP] {lpath}> Found {devices} devices",);
+                }
+                Err(e) => {
+                    log::error!("[TMP] {lpath}> Failed to enumerate devices: {e:?}",);
+                    return None;
+                }
+            };
+            if !self.no_overdrive {
+                log::info!("[TMP] {lpath}> Enabling overdrive mode",);
+                if let Err(e) = temp_sensors.enable_overdrive(&mut bus) {
+                    log::error!("[TMP] {lpath}> Failed to enable overdrive mode: {e:?}",);
+                }
+                // At this point, we SHOULD have overdrive mode enabled
+                // Read every device back to verify
+                if let Err(e) = temp_sensors.verify(&mut bus) {
+                    log::warn!(
+                        "[TMP] {lpath}> Devices do not answer in overdrive mode ({e:?}), disabling overdrive",
+                    );
+                    if let Err(e) = temp_sensors.disable_overdrive(&mut bus) {
+                        log::error!("[TMP] {lpath}> Failed to disable overdrive mode: {e:?}",);
+                    } else {
+                        log::info!("[TMP] {lpath}> Overdrive mode disabled successfully",);
+                    }
+                }
             }
-            Err(e) => {
-                log::error!("[TMP] {lpath}> Failed to enumerate devices: {e:?}",);
-                thread::sleep(Duration::from_secs(1));
-                continue 'root;
+            let found = RomCache {
+                overdrive: temp_sensors.overdrive(),
+                roms: temp_sensors.roms().collect(),
+            };
+            if let Some(path) = cache_path.as_deref()
+                && !found.roms.is_empty()
+                && cache.as_ref() != Some(&found)
+            {
+                match found.store(path) {
+                    Ok(()) => log::info!("[TMP] {lpath}> ROM cache saved to {path:?}",),
+                    Err(e) => log::warn!("[TMP] {lpath}> Failed to save ROM cache to {path:?}: {e}",),
+                }
             }
-        };
+        }
+        self.deadband.reset();
+        self.crc_errors = 0;
         let roms = temp_sensors
             .roms()
             .map(|x| format!("0x{}", (x & 0x00ffffff_ffffffff) >> 8))
             .collect::<Vec<_>>();
         let roms = roms.join(", ");
         log::info!("[TMP] {lpath}> Roms enumerated: {roms}",);
-        if !no_overdrive {
-            log::info!("[TMP] {lpath}> Enabling overdrive mode",);
-            if let Err(e) = temp_sensors.enable_overdrive(&mut ds2484) {
-                log::error!("[TMP] {lpath}> Failed to enable overdrive mode: {e:?}",);
+        if temp_sensors.parasite_powered() {
+            log::warn!(
+                "[TMP] {lpath}> Parasite powered devices found, waiting the full conversion time",
+            );
+        }
+        Some(Devices {
+            bus,
+            sensors: temp_sensors,
+        })
+    }
+
+    /// Set the group up from the devices found last time, with a presence check instead of a search.
+    fn restore(
+        lpath: &str,
+        bus: &mut M::Bus,
+        sensors: &mut Ds28ea00GroupVec,
+        cache: &RomCache,
+        no_overdrive: bool,
+    ) -> bool {
+        if cache.overdrive
+            && !no_overdrive
+            && let Err(e) = sensors.enable_overdrive(bus)
+        {
+            log::error!("[TMP] {lpath}> Failed to enable overdrive mode: {e:?}",);
+            return false;
+        }
+        match sensors.restore(bus, &cache.roms) {
+            Ok(devices) => {
+                log::info!("[TMP] {lpath}> Restored {devices} devices from the ROM cache",);
+                true
             }
-            // At this point, we SHOULD have overdrive mode enabled
-            // Do a conversion to verify
-            if let Err(e) = temp_sensors.trigger_temperature_conversion(&mut ds2484, &mut delay) {
-                match e {
-                    ds2484::OneWireError::NoDevicePresent => {
-                        log::warn!(
-                            "[TMP] {lpath}> No device present on the bus in overdrive mode, disabling overdrive",
-                        );
-                        if let Err(e) = temp_sensors.disable_overdrive(&mut ds2484) {
-                            log::error!("[TMP] {lpath}> Failed to disable overdrive mode: {e:?}",);
-                        } else {
-                            log::info!("[TMP] {lpath}> Overdrive mode disabled successfully",);
-                        }
-                    }
-                    _ => {
-                        log::error!("[TMP] {lpath}> Failed to trigger temperature conversion: {e:?}",);
-                    }
+            Err(e) => {
+                log::warn!("[TMP] {lpath}> Cached devices did not answer ({e:?}), searching the bus",);
+                if sensors.overdrive()
+                    && let Err(e) = sensors.disable_overdrive(bus)
+                {
+                    log::error!("[TMP] {lpath}> Failed to disable overdrive mode: {e:?}",);
                 }
+                false
             }
         }
-        // Do a readout
-        'readout: while running.load(Ordering::Relaxed) {
-            // Timekeeping
-            let start = Instant::now();
-            // Trigger temperature conversion
-            if let Err(e) = temp_sensors.trigger_temperature_conversion(&mut ds2484, &mut delay) {
-                log::error!("[TMP] {lpath}> Failed to trigger temperature conversion: {e:?}",);
-                thread::sleep(Duration::from_secs(1));
-                continue 'root;
-            }
-            // Wait for the conversion to complete
-            let readout = match temp_sensors.read_temperatures(&mut ds2484, false, true) {
-                Ok(readout) => readout,
+    }
+
+    /// Step after an error. The bus is set up again right away, and then every [`RETRY_DELAY`] while it keeps failing.
+    fn retry(&mut self) -> Step {
+        self.failures += 1;
+        if self.failures == 1 {
+            Step::Again(Duration::ZERO)
+        } else {
+            Step::Again(RETRY_DELAY)
+        }
+    }
+
+    /// Start a conversion, setting the bus up first if needed.
+    fn start(&mut self) -> Step {
+        if self.devices.is_none() {
+            self.devices = self.setup();
+        }
+        let Some(devices) = self.devices.as_mut() else {
+            return self.retry();
+        };
+        let start = Instant::now();
+        if let Err(e) = devices.sensors.start_temperature_conversion(&mut devices.bus) {
+            log::error!("[TMP] {}> Failed to trigger temperature conversion: {e:?}", self.lpath);
+            self.devices = None; // set the bus up again
+            return self.retry();
+        }
+        self.reset_time.record_since(start);
+        let conversion = Duration::from_micros(devices.sensors.conversion_time_us() as u64);
+        self.converting = Some(Instant::now());
+        // Devices finish well before the worst case; parasite powered devices can not be polled
+        if devices.sensors.parasite_powered() {
+            Step::Again(conversion)
+        } else {
+            Step::Again(conversion / 2)
+        }
+    }
+
+    /// Poll the conversion in progress, and read the temperatures back once it is done.
+    fn poll(&mut self, tick: Instant, started: Instant) -> Step {
+        let lpath = &self.lpath;
+        let Some(devices) = self.devices.as_mut() else {
+            self.converting = None;
+            return self.retry();
+        };
+        let conversion = Duration::from_micros(devices.sensors.conversion_time_us() as u64);
+        let remaining = conversion.saturating_sub(started.elapsed());
+        if !remaining.is_zero() {
+            match devices.sensors.conversion_done(&mut devices.bus) {
+                Ok(true) => {}
+                Ok(false) if devices.sensors.parasite_powered() => return Step::Again(remaining),
+                Ok(false) => return Step::Again(CONVERSION_POLL.min(remaining)),
                 Err(e) => {
-                    log::error!("[TMP] {lpath}> Failed to read temperatures: {e:?}",);
-                    thread::sleep(Duration::from_secs(1));
-                    continue 'readout;
+                    log::error!("[TMP] {lpath}> Failed to poll temperature conversion: {e:?}",);
+                    self.converting = None;
+                    self.devices = None;
+                    return self.retry();
                 }
-            };
-            // Send the readout data here
-            let data =
-                readout
-                    .iter()
-                    .filter_map(|(id, temp)| {
-                        let id = crc32fast::hash(&((id & 0x00ffffff_ffffffff) >> 8).to_le_bytes()); // strip the CRC and the family code bytes, and convert to u32 by calculating the CRC32 hash of the serial number bytes
-                        if exclude.contains(&id) {
-                            log::warn!(
-                                "[TMP] {lpath}> Excluding sensor with ID {id:08x} from readout",
-                            );
-                            None // skip excluded sensors
-                        } else {
-                            let temp = f32::from(*temp);
-                            Some((id, temp))
-                        }
-                    })
-                    .collect::<Vec<_>>();
-            if print {
-                let mut msg = String::new();
-                for (id, temp) in &data {
-                    msg.push_str(&format!("{id:08x}: {temp:.2} °C, "));
+            }
+        }
+        self.converting = None;
+        self.conversion_time.record_since(started);
+        log::trace!(
+            "[TMP] {lpath}> Conversion done in {} ms",
+            started.elapsed().as_millis()
+        );
+        let read_time = &self.read_time;
+        let mut last = Instant::now();
+        let readout = match devices.sensors.read_temperatures_with(&mut devices.bus, false, true, |_| {
+            let now = Instant::now();
+            read_time.record(now - last);
+            last = now;
+        }) {
+            Ok(readout) => readout,
+            Err(e) => {
+                log::error!("[TMP] {lpath}> Failed to read temperatures: {e:?}",);
+                return self.retry();
+            }
+        };
+        // Send the readout data here, in measurements of up to MAX_READINGS sensors
+        self.deadband.dropped(self.sink.stats().dropped);
+        let exclude = &self.exclude;
+        self.msg.clear();
+        for chunk in readout.chunks(MAX_READINGS) {
+            let data = chunk
+                .iter()
+                .filter_map(|(id, temp)| {
+                    let id = crc32fast::hash(&((id & 0x00ffffff_ffffffff) >> 8).to_le_bytes()); // strip the CRC and the family code bytes, and convert to u32 by calculating the CRC32 hash of the serial number bytes
+                    if exclude.contains(&id) {
+                        log::warn!("[TMP] {lpath}> Excluding sensor with ID {id:08x} from readout",);
+                        None // skip excluded sensors
+                    } else if *temp == READ_ERROR_TEMPERATURE {
+                        log::debug!("[TMP] {lpath}> Sensor {id:08x} failed to read, left out");
+                        None // the client keeps the last good reading
+                    } else {
+                        let temp = f32::from(*temp);
+                        Some((id, temp))
+                    }
+                })
+                .collect::<Readings>();
+            if self.print {
+                for (id, temp) in data.iter() {
+                    let _ = write!(self.msg, "{id:08x}: {temp:.2} °C, ");
                 }
-                log::info!("[TMP] {lpath}> {msg}");
             }
-            if let Err(e) = sink.send(Measurement::Temperature(data)) {
+            // Unchanged sensors are left out, the client keeps their last value
+            let data = self.deadband.filter(&data, tick);
+            if !data.is_empty()
+                && let Err(e) = self.sink.send((tick, Measurement::Temperature(data)))
+            {
                 log::error!("[TMP] {lpath}> Failed to send data: {e:?}",);
-                continue 'readout; // probably the receiver has been dropped, meaning we are leaving
-            }
-            // wait so that there is 1 second interval between measurements
-            let dur = start.elapsed();
-            if dur.as_secs_f32() < 1.0 {
-                thread::sleep(Duration::from_secs_f32(1.0 - dur.as_secs_f32()));
+                self.deadband.reset(); // the sink missed this readout, send it in full next time
+                break;
             }
         }
+        let crc_errors = devices.sensors.crc_errors();
+        if crc_errors != self.crc_errors {
+            log::warn!(
+                "[TMP] {lpath}> {} readouts failed CRC verification ({crc_errors} total)",
+                crc_errors.wrapping_sub(self.crc_errors)
+            );
+            self.crc_errors = crc_errors;
+        }
+        if self.print {
+            log::info!("[TMP] {lpath}> {}", self.msg);
+        }
+        self.failures = 0;
+        Step::Idle
+    }
+}
+
+impl<M: Master> Job for OneWireBus<M> {
+    fn name(&self) -> &str {
+        &self.lpath
+    }
+
+    fn period(&self) -> Duration {
+        self.sampling.period
+    }
+
+    fn run(&mut self, tick: Instant) -> Step {
+        match self.converting {
+            None => self.start(),
+            Some(started) => self.poll(tick, started),
+        }
+    }
+
+    fn reset(&mut self) {
+        self.converting = None;
+        self.devices = None; // set the bus up again
     }
-    log::info!("[TMP] {lpath}> Exiting thread",);
 }